@@ -16,33 +16,83 @@ namespace mh::detail::async_hpp
 }
 #endif
 
+#ifdef MH_COROUTINES_SUPPORTED
+#include "thread_pool.hpp"
+#endif
+
+#include <exception>
+#include <functional>
+#include <memory>
 #include <thread>
+#include <tuple>
 #include <type_traits>
+#include <utility>
 
 namespace mh
 {
-	template<typename TFunc, typename... TArgs>
-	auto async(TFunc&& func, TArgs&&... args)
+	enum class launch
+	{
+		pool,   // Runs on mh::default_thread_pool() (or a new thread, if coroutines aren't supported)
+		thread, // Runs on a new thread of its own, for work that blocks for a long time
+	};
+
+	namespace detail::async_hpp
 	{
-		using ret_type = std::invoke_result_t<TFunc, TArgs...>;
-		using promise_type = detail::async_hpp::promise_type<ret_type>;
-		promise_type promise;
-		auto future = promise.get_future();
+		// Everything the call needs, decay-copied like std::thread/std::async would
+		template<typename TFunc, typename... TArgs>
+		struct job
+		{
+			using ret_type = std::invoke_result_t<std::decay_t<TFunc>, std::decay_t<TArgs>...>;
+
+			promise_type<ret_type> m_Promise;
+			std::decay_t<TFunc> m_Func;
+			std::tuple<std::decay_t<TArgs>...> m_Args;
 
-		std::thread t([](promise_type promise, TFunc&& func, TArgs&&... args)
+			void operator()()
 			{
 				try
 				{
-					promise.set_value(func(std::forward<TArgs>(args)...));
+					m_Promise.set_value(std::apply(std::move(m_Func), std::move(m_Args)));
 				}
 				catch (...)
 				{
-					promise.set_exception(std::current_exception());
+					m_Promise.set_exception(std::current_exception());
 				}
-			}, std::move(promise), std::forward<TFunc>(func), std::forward<TArgs>(args)...);
+			}
 
-		t.detach();
+			static void run_and_delete(void* userData)
+			{
+				std::unique_ptr<job> self(static_cast<job*>(userData));
+				(*self)();
+			}
+		};
+	}
 
+	template<typename TFunc, typename... TArgs>
+	auto async(launch policy, TFunc&& func, TArgs&&... args)
+	{
+		using job_type = detail::async_hpp::job<TFunc, TArgs...>;
+
+		auto job = std::make_unique<job_type>(job_type{ {}, std::forward<TFunc>(func), { std::forward<TArgs>(args)... } });
+		auto future = job->m_Promise.get_future();
+
+#ifdef MH_COROUTINES_SUPPORTED
+		if (policy == launch::pool)
+		{
+			default_thread_pool().post(&job_type::run_and_delete, job.get());
+			job.release();
+			return future;
+		}
+#endif
+
+		std::thread([job = std::move(job)] { (*job)(); }).detach();
 		return future;
 	}
+
+	// Runs func(args...) on mh::default_thread_pool()
+	template<typename TFunc, typename... TArgs, typename = std::enable_if_t<!std::is_same_v<std::decay_t<TFunc>, launch>>>
+	auto async(TFunc&& func, TArgs&&... args)
+	{
+		return async(launch::pool, std::forward<TFunc>(func), std::forward<TArgs>(args)...);
+	}
 }
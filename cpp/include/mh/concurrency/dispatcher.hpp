@@ -6,7 +6,10 @@
 
 #ifdef MH_COROUTINES_SUPPORTED
 
+#include <mh/coroutine/cancellation.hpp>
+
 #include <chrono>
+#include <cstddef>
 #include <memory>
 
 #ifndef MH_STUFF_API
@@ -25,24 +28,77 @@ namespace mh
 			co_dispatch_task(std::shared_ptr<thread_data> threadData) noexcept;
 
 			MH_STUFF_API bool await_ready() const;
-			MH_STUFF_API void await_resume() const;
+			MH_STUFF_API void await_resume() const; // Throws mh::task_cancelled if we were cancelled while queued
 			MH_STUFF_API bool await_suspend(coro::coroutine_handle<> parent);
 
+			// Tasks that have already been cancelled don't bother queueing up. Once queued, there's no
+			// taking it back, but it bails out as soon as it gets to run.
+			template<typename TPromise>
+			bool await_suspend(coro::coroutine_handle<TPromise> parent)
+			{
+				if constexpr (cancellation_hpp::is_cancellable_v<TPromise>)
+				{
+					m_CancelState = &parent.promise();
+					if (m_CancelState->is_cancel_requested())
+						return false;
+				}
+
+				return await_suspend(coro::coroutine_handle<>(parent));
+			}
+
 		private:
 			std::shared_ptr<thread_data> m_ThreadData;
+			const cancellation_hpp::cancellation_state* m_CancelState = nullptr;
 		};
 
-		struct [[nodiscard]] co_delay_task
+		// An intrusive timer entry, for things that need to be able to cancel their timers (see mh::with_timeout()).
+		// Must stay alive until it has either expired or been successfully removed.
+		struct timer_node
+		{
+			static constexpr size_t NOT_SCHEDULED = size_t(-1);
+
+			clock_t::time_point m_ExpireTime;
+
+			// Called (without any dispatcher locks held) on a thread running the dispatcher once the timer
+			// expires. Returns the coroutine to resume, if any. The node is no longer scheduled at this point.
+			coro::coroutine_handle<> (*m_OnExpired)(timer_node& node) noexcept = nullptr;
+
+			size_t m_HeapIndex = NOT_SCHEDULED; // Owned by the dispatcher
+		};
+
+		// Waits on a dispatcher timer. If the awaiting task is cancelled, the timer is removed and the
+		// task is resumed early (on the dispatcher), with mh::task_cancelled thrown out of the co_await.
+		struct [[nodiscard]] co_delay_task : private timer_node, private cancellation_hpp::cancel_callback
 		{
 			co_delay_task(std::shared_ptr<thread_data> threadData, clock_t::time_point delayUntilTime) noexcept;
 
+			// Only the delay is copied, the timer is only ever registered by the copy being awaited
+			co_delay_task(const co_delay_task& other) noexcept : co_delay_task(other.m_ThreadData, other.m_ExpireTime) {}
+			co_delay_task& operator=(const co_delay_task&) = delete;
+
 			MH_STUFF_API bool await_ready() const;
-			MH_STUFF_API void await_resume() const;
+			MH_STUFF_API void await_resume();
 			MH_STUFF_API bool await_suspend(coro::coroutine_handle<> parent);
 
+			template<typename TPromise>
+			bool await_suspend(coro::coroutine_handle<TPromise> parent)
+			{
+				if constexpr (cancellation_hpp::is_cancellable_v<TPromise>)
+					return await_suspend_cancellable(parent, parent.promise());
+				else
+					return await_suspend(coro::coroutine_handle<>(parent));
+			}
+
 		private:
+			MH_STUFF_API bool await_suspend_cancellable(coro::coroutine_handle<> parent,
+				const cancellation_hpp::cancellation_state& cancelState);
+
+			static coro::coroutine_handle<> on_expired(timer_node& node) noexcept;
+			static void on_cancelled(cancellation_hpp::cancel_callback& callback) noexcept;
+
 			std::shared_ptr<thread_data> m_ThreadData;
-			clock_t::time_point m_DelayUntilTime;
+			coro::coroutine_handle<> m_Parent;
+			const cancellation_hpp::cancellation_state* m_CancelState = nullptr;
 		};
 	}
 
@@ -54,6 +110,7 @@ namespace mh
 		using dispatch_task_t = detail::dispatcher_hpp::co_dispatch_task;
 		using delay_task_t = detail::dispatcher_hpp::co_delay_task;
 		using clock_t = detail::dispatcher_hpp::clock_t;
+		using timer_node_t = detail::dispatcher_hpp::timer_node;
 
 		MH_STUFF_API dispatcher(bool singleThread = true);
 
@@ -69,6 +126,16 @@ namespace mh
 			return co_delay_until(clock_t::now() + std::chrono::duration_cast<clock_t::duration>(duration));
 		}
 
+		// Queues up a plain function to be called by run()/run_one(), for work that doesn't need a whole
+		// coroutine of its own (see mh::task::then()). Like co_dispatch(), but nothing has to be suspended.
+		MH_STUFF_API void post(void (*func)(void* userData), void* userData);
+
+		// Low level timer registration. Unlike co_delay_until(), timers can be removed again before they
+		// expire, so things that usually finish long before their timer don't leave it behind.
+		MH_STUFF_API void add_timer(timer_node_t& node);
+		// Returns false if the timer has already expired (its m_OnExpired has been or is about to be called)
+		MH_STUFF_API bool remove_timer(timer_node_t& node);
+
 		MH_STUFF_API size_t run();
 		MH_STUFF_API bool run_one();
 		template<typename TFunc>
@@ -115,6 +182,8 @@ namespace mh
 		}
 
 	private:
+		friend class task_watchdog;
+
 		std::shared_ptr<thread_data> m_ThreadData;
 	};
 }
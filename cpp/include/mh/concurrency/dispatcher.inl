@@ -6,8 +6,8 @@
 
 #ifdef MH_COROUTINES_SUPPORTED
 
-#include <mh/error/not_implemented_error.hpp>
-#include <mh/containers/heap.hpp>
+#include <mh/coroutine/current_executor.hpp>
+#include "mutex_debug.hpp"
 
 #include <atomic>
 #include <cassert>
@@ -15,6 +15,8 @@
 #include <mutex>
 #include <queue>
 #include <thread>
+#include <type_traits>
+#include <vector>
 
 #undef min
 #undef max
@@ -32,16 +34,121 @@ namespace mh
 			coro::coroutine_handle<> m_Handle;
 		};
 
-		struct task_delay_data
+		// Binary min-heap of timers that keeps each node's m_HeapIndex up to date, so any of them
+		// can be removed in O(log n)
+		class timer_heap final
 		{
-			constexpr bool operator<(const task_delay_data& rhs) const
+		public:
+			bool empty() const { return m_Nodes.empty(); }
+			size_t size() const { return m_Nodes.size(); }
+			timer_node& front() const { return *m_Nodes.front(); }
+
+			void push(timer_node& node)
 			{
-				// intentionally reversed
-				return rhs.m_DelayUntilTime < m_DelayUntilTime;
+				assert(node.m_HeapIndex == timer_node::NOT_SCHEDULED);
+				node.m_HeapIndex = m_Nodes.size();
+				m_Nodes.push_back(&node);
+				sift_up(node.m_HeapIndex);
 			}
 
-			clock_t::time_point m_DelayUntilTime;
-			coro::coroutine_handle<> m_Handle;
+			bool remove(timer_node& node)
+			{
+				const size_t index = node.m_HeapIndex;
+				if (index == timer_node::NOT_SCHEDULED)
+					return false;
+
+				assert(index < m_Nodes.size() && m_Nodes[index] == &node);
+
+				const size_t last = m_Nodes.size() - 1;
+				if (index != last)
+					swap_nodes(index, last);
+
+				m_Nodes.pop_back();
+				node.m_HeapIndex = timer_node::NOT_SCHEDULED;
+
+				if (index < m_Nodes.size())
+				{
+					sift_down(index);
+					sift_up(index);
+				}
+
+				return true;
+			}
+
+		private:
+			bool is_before(size_t lhs, size_t rhs) const
+			{
+				return m_Nodes[lhs]->m_ExpireTime < m_Nodes[rhs]->m_ExpireTime;
+			}
+
+			void swap_nodes(size_t lhs, size_t rhs)
+			{
+				std::swap(m_Nodes[lhs], m_Nodes[rhs]);
+				m_Nodes[lhs]->m_HeapIndex = lhs;
+				m_Nodes[rhs]->m_HeapIndex = rhs;
+			}
+
+			void sift_up(size_t index)
+			{
+				while (index > 0)
+				{
+					const size_t parent = (index - 1) / 2;
+					if (!is_before(index, parent))
+						break;
+
+					swap_nodes(index, parent);
+					index = parent;
+				}
+			}
+
+			void sift_down(size_t index)
+			{
+				while (true)
+				{
+					const size_t left = index * 2 + 1;
+					const size_t right = left + 1;
+					size_t smallest = index;
+
+					if (left < m_Nodes.size() && is_before(left, smallest))
+						smallest = left;
+					if (right < m_Nodes.size() && is_before(right, smallest))
+						smallest = right;
+
+					if (smallest == index)
+						break;
+
+					swap_nodes(index, smallest);
+					index = smallest;
+				}
+			}
+
+			std::vector<timer_node*> m_Nodes;
+		};
+
+		// Either a coroutine to resume, or a plain function posted with dispatcher::post()
+		struct queued_task
+		{
+			queued_task() noexcept = default;
+			queued_task(coro::coroutine_handle<> handle) noexcept :
+				m_Func(&resume_coroutine), m_UserData(handle.address())
+			{
+			}
+			queued_task(void (*func)(void* userData), void* userData) noexcept :
+				m_Func(func), m_UserData(userData)
+			{
+			}
+
+			explicit operator bool() const noexcept { return m_Func; }
+			void operator()() const { m_Func(m_UserData); }
+
+		private:
+			static void resume_coroutine(void* address)
+			{
+				coro::coroutine_handle<>::from_address(address).resume();
+			}
+
+			void (*m_Func)(void* userData) = nullptr;
+			void* m_UserData = nullptr;
 		};
 
 		struct thread_data
@@ -51,45 +158,66 @@ namespace mh
 			{
 			}
 
-			coro::coroutine_handle<> try_pop_task()
+			queued_task try_pop_task()
 			{
-				if (!m_Tasks.empty() || !m_DelayTasks.empty())
+				while (!m_Tasks.empty() || !m_Timers.empty())
 				{
-					std::lock_guard lock(m_TasksMutex);
+					timer_node* expiredTimer = nullptr;
 
-					if (!m_DelayTasks.empty())
 					{
-						auto now = clock_t::now();
-						const task_delay_data& taskDelayData = m_DelayTasks.front();
-						if (taskDelayData.m_DelayUntilTime <= now)
+						std::lock_guard lock(m_TasksMutex);
+
+						if (!m_Timers.empty() && m_Timers.front().m_ExpireTime <= clock_t::now())
 						{
-							auto task = taskDelayData.m_Handle;
-							m_DelayTasks.pop();
+							expiredTimer = &m_Timers.front();
+							m_Timers.remove(*expiredTimer);
+						}
+						else if (!m_Tasks.empty())
+						{
+							auto task = m_Tasks.front();
+							m_Tasks.pop();
 							return task;
 						}
+						else
+						{
+							return {};
+						}
 					}
 
-					if (!m_Tasks.empty())
-					{
-						auto task = m_Tasks.front();
-						m_Tasks.pop();
+					// Not holding the lock, the timer might want to talk to us
+					if (coro::coroutine_handle<> task = expiredTimer->m_OnExpired(*expiredTimer))
 						return task;
-					}
 				}
 
-				return nullptr;
+				return {};
 			}
 
-			void add_task(coro::coroutine_handle<> task)
+			void add_task(queued_task task)
 			{
 				std::lock_guard lock(m_TasksMutex);
 				m_Tasks.push(task);
 				m_TasksAvailableCV.notify_one();
 			}
-			void add_delay_task(task_delay_data data)
+			void add_timer(timer_node& node)
+			{
+				std::lock_guard lock(m_TasksMutex);
+				push_timer(node);
+			}
+			// Checking under the lock means anyone cancelling either sees the timer and can remove it,
+			// or gets in first and we don't add it at all
+			bool try_add_timer(timer_node& node, const cancellation_hpp::cancellation_state& cancelState)
+			{
+				std::lock_guard lock(m_TasksMutex);
+				if (cancelState.is_cancel_requested())
+					return false;
+
+				push_timer(node);
+				return true;
+			}
+			bool remove_timer(timer_node& node)
 			{
 				std::lock_guard lock(m_TasksMutex);
-				m_DelayTasks.push(std::move(data));
+				return m_Timers.remove(node);
 			}
 
 			bool wait_tasks_until(const clock_t::time_point endTime) const
@@ -98,7 +226,7 @@ namespace mh
 
 				const auto IsTaskAvailable = [&]
 				{
-					if (!m_DelayTasks.empty() && m_DelayTasks.front().m_DelayUntilTime <= clock_t::now())
+					if (!m_Timers.empty() && m_Timers.front().m_ExpireTime <= clock_t::now())
 						return true;
 
 					if (!m_Tasks.empty())
@@ -110,8 +238,8 @@ namespace mh
 				while (endTime > clock_t::now())
 				{
 					auto localEndTime = endTime;
-					if (!m_DelayTasks.empty())
-						localEndTime = std::min(localEndTime, m_DelayTasks.front().m_DelayUntilTime);
+					if (!m_Timers.empty())
+						localEndTime = std::min(localEndTime, m_Timers.front().m_ExpireTime);
 
 					if (m_TasksAvailableCV.wait_until(lock, localEndTime, IsTaskAvailable))
 						return true;
@@ -120,17 +248,32 @@ namespace mh
 				return false;
 			}
 
-			size_t task_count() const { return m_Tasks.size() + m_DelayTasks.size(); }
+			// Delays and timers count as tasks too
+			size_t task_count() const { return m_Tasks.size() + m_Timers.size(); }
 
 			bool m_IsSingleThread{};
 
 			const std::thread::id m_OwnerThread = std::this_thread::get_id();
 
 		private:
-			mutable std::mutex m_TasksMutex;
-			mutable std::condition_variable m_TasksAvailableCV;
-			std::queue<coro::coroutine_handle<>> m_Tasks;
-			mh::heap<task_delay_data> m_DelayTasks;
+			void push_timer(timer_node& node)
+			{
+				assert(node.m_OnExpired);
+				m_Timers.push(node);
+
+				// Anyone already waiting might be planning to sleep past this
+				if (&m_Timers.front() == &node)
+					m_TasksAvailableCV.notify_one();
+			}
+
+			using tasks_mutex_t = mh::profiled_mutex_t<std::mutex>;
+			using tasks_cv_t = std::conditional_t<std::is_same_v<tasks_mutex_t, std::mutex>,
+				std::condition_variable, std::condition_variable_any>;
+
+			mutable tasks_mutex_t m_TasksMutex;
+			mutable tasks_cv_t m_TasksAvailableCV;
+			std::queue<queued_task> m_Tasks;
+			timer_heap m_Timers;
 		};
 
 		MH_COMPILE_LIBRARY_INLINE co_dispatch_task::co_dispatch_task(std::shared_ptr<thread_data> threadData) noexcept :
@@ -145,6 +288,9 @@ namespace mh
 
 		MH_COMPILE_LIBRARY_INLINE void co_dispatch_task::await_resume() const
 		{
+			if (m_CancelState && m_CancelState->is_cancel_requested())
+				throw mh::task_cancelled();
+
 			assert(!m_ThreadData->m_IsSingleThread || m_ThreadData->m_OwnerThread == std::this_thread::get_id());
 			//assert(m_TaskData);
 			//std::unique_lock lock(m_TaskData->m_TaskCompleteCVMutex);
@@ -165,32 +311,61 @@ namespace mh
 
 		MH_COMPILE_LIBRARY_INLINE co_delay_task::co_delay_task(
 			std::shared_ptr<thread_data> threadData, clock_t::time_point delayUntilTime) noexcept :
-			m_ThreadData(std::move(threadData)), m_DelayUntilTime(std::move(delayUntilTime))
+			m_ThreadData(std::move(threadData))
 		{
+			m_ExpireTime = delayUntilTime;
+			m_OnExpired = &on_expired;
+			m_OnCancel = &on_cancelled;
 		}
 
 		MH_COMPILE_LIBRARY_INLINE bool co_delay_task::await_ready() const
 		{
-			return m_DelayUntilTime <= clock_t::now();
+			return m_ExpireTime <= clock_t::now();
 		}
-		MH_COMPILE_LIBRARY_INLINE void co_delay_task::await_resume() const
+		MH_COMPILE_LIBRARY_INLINE void co_delay_task::await_resume()
 		{
-			//throw mh::not_implemented_error();
+			if (m_CancelState)
+			{
+				m_CancelState->unregister_callback(*this);
+				if (m_CancelState->is_cancel_requested())
+					throw mh::task_cancelled();
+			}
 		}
 		MH_COMPILE_LIBRARY_INLINE bool co_delay_task::await_suspend(coro::coroutine_handle<> parent)
 		{
 			if (await_ready())
 				return false; // no need for suspension
 
-			{
-				task_delay_data data;
-				data.m_DelayUntilTime = m_DelayUntilTime;
-				data.m_Handle = parent;
-				m_ThreadData->add_delay_task(std::move(data));
-			}
-
+			m_Parent = parent;
+			m_ThreadData->add_timer(*this);
 			return true; // suspend
 		}
+		MH_COMPILE_LIBRARY_INLINE bool co_delay_task::await_suspend_cancellable(coro::coroutine_handle<> parent,
+			const cancellation_hpp::cancellation_state& cancelState)
+		{
+			// await_resume() checks (and cleans up after) this even if we never suspend
+			m_CancelState = &cancelState;
+			if (!cancelState.try_register_callback(*this))
+				return false;
+
+			if (await_ready())
+				return false;
+
+			m_Parent = parent;
+			return m_ThreadData->try_add_timer(*this, cancelState);
+		}
+
+		MH_COMPILE_LIBRARY_INLINE coro::coroutine_handle<> co_delay_task::on_expired(timer_node& node) noexcept
+		{
+			return static_cast<co_delay_task&>(node).m_Parent;
+		}
+		MH_COMPILE_LIBRARY_INLINE void co_delay_task::on_cancelled(cancellation_hpp::cancel_callback& callback) noexcept
+		{
+			// If this fails, the timer has already expired (or was never added) and we're resumed anyway
+			auto& self = static_cast<co_delay_task&>(callback);
+			if (self.m_ThreadData->remove_timer(self))
+				self.m_ThreadData->add_task(self.m_Parent);
+		}
 	}
 
 	MH_COMPILE_LIBRARY_INLINE dispatcher::dispatcher(bool singleThread) :
@@ -198,6 +373,21 @@ namespace mh
 	{
 	}
 
+	MH_COMPILE_LIBRARY_INLINE void dispatcher::post(void (*func)(void* userData), void* userData)
+	{
+		assert(func);
+		m_ThreadData->add_task({ func, userData });
+	}
+
+	MH_COMPILE_LIBRARY_INLINE void dispatcher::add_timer(timer_node_t& node)
+	{
+		m_ThreadData->add_timer(node);
+	}
+	MH_COMPILE_LIBRARY_INLINE bool dispatcher::remove_timer(timer_node_t& node)
+	{
+		return m_ThreadData->remove_timer(node);
+	}
+
 	MH_COMPILE_LIBRARY_INLINE size_t dispatcher::run()
 	{
 		size_t count = 0;
@@ -219,10 +409,18 @@ namespace mh
 
 		using detail::dispatcher_hpp::task_data;
 
-		if (mh::detail::coro::coroutine_handle<> task = m_ThreadData->try_pop_task())
+		if (const detail::dispatcher_hpp::queued_task task = m_ThreadData->try_pop_task())
 		{
+			// Lets tasks that complete with several waiters queue the extra ones back up with us,
+			// instead of resuming them recursively
+			detail::current_executor_hpp::current_executor_scope executorScope(m_ThreadData.get(),
+				[](void* threadData, mh::detail::coro::coroutine_handle<> handle)
+				{
+					static_cast<thread_data*>(threadData)->add_task(handle);
+				});
+
 			// This could throw (...can it? what about promise_type::unhandled_exception()?)
-			task.resume();
+			task();
 			return true;
 		}
 
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "futex.hpp"
+
+#include <atomic>
+#include <cstdint>
+
+#ifndef MH_STUFF_API
+#define MH_STUFF_API
+#endif
+
+namespace mh
+{
+	// A mutex that is just a futex word (4 bytes instead of std::mutex's 40 on glibc). Contended lockers
+	// spin for a little while before going to sleep, since most of the critical sections this is meant
+	// for are shorter than a trip through the kernel. How long they spin adapts to how long it has
+	// recently taken to get this particular mutex, like glibc's PTHREAD_MUTEX_ADAPTIVE_NP. Not
+	// recursive, and not fair.
+	class fast_mutex final
+	{
+	public:
+		using native_handle_type = futex_word*;
+
+		constexpr fast_mutex() noexcept = default;
+		fast_mutex(const fast_mutex&) = delete;
+		fast_mutex& operator=(const fast_mutex&) = delete;
+
+		void lock()
+		{
+			std::uint32_t expected = m_State.load(std::memory_order_relaxed) & ~STATE_MASK;
+			if (!m_State.compare_exchange_strong(expected, expected | LOCKED, std::memory_order_acquire, std::memory_order_relaxed))
+				lock_contended();
+		}
+
+		bool try_lock() noexcept
+		{
+			std::uint32_t state = m_State.load(std::memory_order_relaxed);
+			while (!(state & LOCKED))
+			{
+				if (m_State.compare_exchange_weak(state, state | LOCKED, std::memory_order_acquire, std::memory_order_relaxed))
+					return true;
+			}
+
+			return false;
+		}
+
+		void unlock() noexcept
+		{
+			if (m_State.fetch_and(~STATE_MASK, std::memory_order_release) & WAITERS)
+				futex_wake_one(m_State);
+		}
+
+		native_handle_type native_handle() noexcept { return &m_State; }
+
+	private:
+		// The low bits are the lock itself, the high bits are the spin estimate, which only the owner
+		// changes. Everything has to share the one word, since that's all the futex can wait on.
+		static constexpr std::uint32_t LOCKED = 1;
+		static constexpr std::uint32_t WAITERS = 2; // Someone might be asleep, unlock() has to wake them
+		static constexpr std::uint32_t STATE_MASK = LOCKED | WAITERS;
+		static constexpr unsigned SPIN_ESTIMATE_SHIFT = 16;
+
+		MH_STUFF_API void lock_contended();
+		void update_spin_estimate(unsigned spinCount) noexcept;
+
+		futex_word m_State{ 0 };
+	};
+
+	static_assert(sizeof(fast_mutex) == sizeof(std::uint32_t));
+}
+
+#ifndef MH_COMPILE_LIBRARY
+#include "fast_mutex.inl"
+#endif
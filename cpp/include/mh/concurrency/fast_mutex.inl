@@ -0,0 +1,70 @@
+#ifdef MH_COMPILE_LIBRARY
+#include "fast_mutex.hpp"
+#endif
+
+#include <algorithm>
+
+#ifndef MH_COMPILE_LIBRARY_INLINE
+#define MH_COMPILE_LIBRARY_INLINE inline
+#endif
+
+namespace mh
+{
+	MH_COMPILE_LIBRARY_INLINE void fast_mutex::lock_contended()
+	{
+		// Same numbers as glibc: spin for up to twice as long as it took recently (plus a bit, so the
+		// estimate can grow again after dropping to zero), but never more than MAX_SPIN_COUNT times
+		constexpr unsigned MAX_SPIN_COUNT = 100;
+		const unsigned estimate = m_State.load(std::memory_order_relaxed) >> SPIN_ESTIMATE_SHIFT;
+		const unsigned spinLimit = std::min(MAX_SPIN_COUNT, estimate * 2 + 10);
+
+		// Spin while the owner is (hopefully) still running. If anyone's already asleep, the lock has been
+		// held for long enough that spinning is unlikely to help, so go straight to sleep too.
+		unsigned spinCount = 0;
+		for (; spinCount < spinLimit; spinCount++)
+		{
+			std::uint32_t state = m_State.load(std::memory_order_relaxed);
+
+			if (!(state & LOCKED))
+			{
+				if (m_State.compare_exchange_weak(state, state | LOCKED, std::memory_order_acquire, std::memory_order_relaxed))
+				{
+					update_spin_estimate(spinCount);
+					return;
+				}
+			}
+			else if (state & WAITERS)
+			{
+				break;
+			}
+
+			mh::cpu_relax();
+		}
+
+		// We can't tell whether there are other sleepers left once we get the lock, so it always stays
+		// marked as having WAITERS from here on. Worst case, unlock() makes a syscall it didn't need to.
+		std::uint32_t state;
+		while ((state = m_State.fetch_or(LOCKED | WAITERS, std::memory_order_acquire)) & LOCKED)
+			futex_wait(m_State, state | LOCKED | WAITERS);
+
+		// Spinning for as long as we were allowed to didn't help, so allow a bit more next time. Giving
+		// up early because of the sleepers doesn't say anything either way.
+		if (spinCount == spinLimit)
+			update_spin_estimate(spinLimit);
+	}
+
+	MH_COMPILE_LIBRARY_INLINE void fast_mutex::update_spin_estimate(unsigned spinCount) noexcept
+	{
+		// Moves an eighth of the way towards spinCount each time. Other threads can still set WAITERS
+		// while we hold the lock, so this has to preserve the low bits.
+		std::uint32_t state = m_State.load(std::memory_order_relaxed);
+		std::uint32_t newState;
+		do
+		{
+			const int estimate = int(state >> SPIN_ESTIMATE_SHIFT);
+			const int newEstimate = estimate + (int(spinCount) - estimate) / 8;
+			newState = (std::uint32_t(newEstimate) << SPIN_ESTIMATE_SHIFT) | (state & STATE_MASK);
+		} while (newState != state &&
+			!m_State.compare_exchange_weak(state, newState, std::memory_order_relaxed, std::memory_order_relaxed));
+	}
+}
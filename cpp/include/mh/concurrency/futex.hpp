@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <intrin.h>
+#elif defined(__i386__) || defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#ifndef MH_STUFF_API
+#define MH_STUFF_API
+#endif
+
+namespace mh
+{
+	// Thin wrappers around the platform's "wait on address" primitive (futex on Linux,
+	// WaitOnAddress on Windows). Waiting returns when the word no longer equals expected,
+	// when woken, or spuriously, so callers must always re-check their condition in a loop.
+	// A word must only be woken with futex_wake_*, never with std::atomic::notify_*.
+	using futex_word = std::atomic<std::uint32_t>;
+
+	MH_STUFF_API void futex_wait(futex_word& word, std::uint32_t expected);
+
+	// Returns false if the timeout elapsed
+	MH_STUFF_API bool futex_wait_for(futex_word& word, std::uint32_t expected, std::chrono::nanoseconds timeout);
+
+	template<typename TClock, typename TDuration>
+	bool futex_wait_until(futex_word& word, std::uint32_t expected, const std::chrono::time_point<TClock, TDuration>& timeout_time)
+	{
+		const auto now = TClock::now();
+		if (now >= timeout_time)
+			return false;
+
+		return futex_wait_for(word, expected, std::chrono::duration_cast<std::chrono::nanoseconds>(timeout_time - now));
+	}
+
+	MH_STUFF_API void futex_wake_one(futex_word& word);
+	MH_STUFF_API void futex_wake_all(futex_word& word);
+
+	// Hint to the cpu that we are in a spin-wait loop
+	inline void cpu_relax() noexcept
+	{
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+		_mm_pause();
+#elif defined(__i386__) || defined(__x86_64__)
+		_mm_pause();
+#elif defined(_MSC_VER) && (defined(_M_ARM) || defined(_M_ARM64))
+		__yield();
+#elif defined(__aarch64__) || defined(__arm__)
+		asm volatile("yield");
+#endif
+	}
+}
+
+#ifndef MH_COMPILE_LIBRARY
+#include "futex.inl"
+#endif
@@ -0,0 +1,128 @@
+#ifdef MH_COMPILE_LIBRARY
+#include "futex.hpp"
+#endif
+
+#ifndef MH_COMPILE_LIBRARY_INLINE
+#define MH_COMPILE_LIBRARY_INLINE inline
+#endif
+
+#if defined(__linux__)
+#include <cerrno>
+#include <climits>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#include <Windows.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "Synchronization.lib")
+#endif
+#undef min
+#undef max
+#else
+#include <algorithm>
+#include <thread>
+#endif
+
+namespace mh
+{
+#if defined(__linux__)
+	namespace detail::futex_hpp
+	{
+		MH_COMPILE_LIBRARY_INLINE long futex(futex_word& word, int op, std::uint32_t val, const timespec* timeout)
+		{
+			static_assert(sizeof(futex_word) == sizeof(std::uint32_t));
+			return syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), op, val, timeout, nullptr, 0);
+		}
+	}
+
+	MH_COMPILE_LIBRARY_INLINE void futex_wait(futex_word& word, std::uint32_t expected)
+	{
+		detail::futex_hpp::futex(word, FUTEX_WAIT_PRIVATE, expected, nullptr);
+	}
+
+	MH_COMPILE_LIBRARY_INLINE bool futex_wait_for(futex_word& word, std::uint32_t expected, std::chrono::nanoseconds timeout)
+	{
+		if (timeout <= timeout.zero())
+			return false;
+
+		timespec ts;
+		ts.tv_sec = static_cast<time_t>(std::chrono::duration_cast<std::chrono::seconds>(timeout).count());
+		ts.tv_nsec = static_cast<long>((timeout - std::chrono::seconds(ts.tv_sec)).count());
+
+		if (detail::futex_hpp::futex(word, FUTEX_WAIT_PRIVATE, expected, &ts) == -1 && errno == ETIMEDOUT)
+			return false;
+
+		return true;
+	}
+
+	MH_COMPILE_LIBRARY_INLINE void futex_wake_one(futex_word& word)
+	{
+		detail::futex_hpp::futex(word, FUTEX_WAKE_PRIVATE, 1, nullptr);
+	}
+	MH_COMPILE_LIBRARY_INLINE void futex_wake_all(futex_word& word)
+	{
+		detail::futex_hpp::futex(word, FUTEX_WAKE_PRIVATE, INT_MAX, nullptr);
+	}
+
+#elif defined(_WIN32)
+	MH_COMPILE_LIBRARY_INLINE void futex_wait(futex_word& word, std::uint32_t expected)
+	{
+		WaitOnAddress(&word, &expected, sizeof(expected), INFINITE);
+	}
+
+	MH_COMPILE_LIBRARY_INLINE bool futex_wait_for(futex_word& word, std::uint32_t expected, std::chrono::nanoseconds timeout)
+	{
+		if (timeout <= timeout.zero())
+			return false;
+
+		// Round up, so we never spin on a zero millisecond timeout
+		const auto ms = std::chrono::ceil<std::chrono::milliseconds>(timeout).count();
+		const DWORD waitMS = ms >= INFINITE ? (INFINITE - 1) : static_cast<DWORD>(ms);
+
+		if (!WaitOnAddress(&word, &expected, sizeof(expected), waitMS) && GetLastError() == ERROR_TIMEOUT)
+			return false;
+
+		return true;
+	}
+
+	MH_COMPILE_LIBRARY_INLINE void futex_wake_one(futex_word& word)
+	{
+		WakeByAddressSingle(&word);
+	}
+	MH_COMPILE_LIBRARY_INLINE void futex_wake_all(futex_word& word)
+	{
+		WakeByAddressAll(&word);
+	}
+
+#else
+	// No native primitive, fall back to std::atomic wait/notify. There is no timed
+	// std::atomic::wait, so timed waits poll with a bounded sleep.
+	MH_COMPILE_LIBRARY_INLINE void futex_wait(futex_word& word, std::uint32_t expected)
+	{
+		word.wait(expected, std::memory_order_relaxed);
+	}
+
+	MH_COMPILE_LIBRARY_INLINE bool futex_wait_for(futex_word& word, std::uint32_t expected, std::chrono::nanoseconds timeout)
+	{
+		if (timeout <= timeout.zero())
+			return false;
+
+		if (word.load(std::memory_order_relaxed) != expected)
+			return true;
+
+		std::this_thread::sleep_for(std::min<std::chrono::nanoseconds>(timeout, std::chrono::milliseconds(1)));
+		return timeout > std::chrono::milliseconds(1) || word.load(std::memory_order_relaxed) != expected;
+	}
+
+	MH_COMPILE_LIBRARY_INLINE void futex_wake_one(futex_word& word)
+	{
+		word.notify_one();
+	}
+	MH_COMPILE_LIBRARY_INLINE void futex_wake_all(futex_word& word)
+	{
+		word.notify_all();
+	}
+#endif
+}
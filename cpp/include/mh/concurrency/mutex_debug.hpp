@@ -1,28 +1,129 @@
 #pragma once
 
+#include "../source_location.hpp"
+
+#include <array>
 #include <atomic>
 #include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
 #include <mutex>
 #include <thread>
+#include <type_traits>
+#include <vector>
+
+#ifndef MH_STUFF_API
+#define MH_STUFF_API
+#endif
+
+// Set to 1 to have every mutex_debug keep track of how often it is contended, how long it is waited
+// on and held for, and where it was locked from when it was contended (see mh::get_mutex_profiles()).
+#ifndef MH_MUTEX_DEBUG_PROFILING
+#define MH_MUTEX_DEBUG_PROFILING 0
+#endif
+
+#if MH_MUTEX_DEBUG_PROFILING && !(__cpp_lib_source_location >= 201907 || _MSC_VER >= 1927)
+#error MH_MUTEX_DEBUG_PROFILING requires mh::source_location::current()
+#endif
 
 namespace mh
 {
+	// A snapshot of the contention data for every mutex_debug constructed in the same place
+	struct mutex_profile
+	{
+		using clock_t = std::chrono::steady_clock;
+
+		// Bucket i counts durations of [2^i, 2^(i+1)) nanoseconds. The first and last buckets also take
+		// anything shorter/longer.
+		static constexpr std::size_t HISTOGRAM_BUCKET_COUNT = 32;
+		using histogram_t = std::array<std::uint64_t, HISTOGRAM_BUCKET_COUNT>;
+
+		struct site
+		{
+			mh::source_location m_Location; // Where lock() was called from
+			std::uint64_t m_ContendedCount = 0;
+			clock_t::duration m_TotalWaitTime{};
+		};
+
+		mh::source_location m_Location; // Where the mutexes were constructed
+		std::uint64_t m_AcquireCount = 0;
+		std::uint64_t m_ContendedCount = 0;
+		clock_t::duration m_TotalWaitTime{};
+		clock_t::duration m_TotalHoldTime{};
+		histogram_t m_WaitTimes{}; // Only contended acquisitions
+		histogram_t m_HoldTimes{};
+		std::vector<site> m_ContendedSites; // Longest total wait first
+	};
+
+	// Everything recorded so far, longest total wait first. Empty unless MH_MUTEX_DEBUG_PROFILING is enabled.
+	MH_STUFF_API std::vector<mutex_profile> get_mutex_profiles();
+	MH_STUFF_API void reset_mutex_profiles();
+
+	// Human readable summary of get_mutex_profiles()
+	MH_STUFF_API void write_mutex_profile_report(std::ostream& os);
+
+	namespace detail::mutex_debug_hpp
+	{
+		using clock_t = mutex_profile::clock_t;
+
+		struct profile_data;
+
+		MH_STUFF_API profile_data& get_profile_data(const mh::source_location& constructedAt);
+		MH_STUFF_API void record_acquired(profile_data& profile) noexcept;
+		MH_STUFF_API void record_contended(profile_data& profile, const mh::source_location& site, clock_t::duration waitTime);
+		MH_STUFF_API void record_released(profile_data& profile, clock_t::duration holdTime) noexcept;
+	}
+
 	// Drop-in replacement for mutex types that records data about where and when it was locked/unlocked.
 	template<typename TMutex = std::mutex>
 	class mutex_debug
 	{
 	public:
+#if MH_MUTEX_DEBUG_PROFILING
+		// Contention is only attributed to the right place if lock() is called directly (or through
+		// make_lock()), anything locked through std::lock_guard and friends shows up as coming from them.
+		mutex_debug(MH_SOURCE_LOCATION_AUTO(location)) :
+			m_Profile(&detail::mutex_debug_hpp::get_profile_data(location))
+		{
+		}
+#else
+		mutex_debug() = default;
+#endif
+
 		~mutex_debug()
 		{
 			assert(m_OwningThreadID == std::thread::id{}); // Mutex being destructed while still owned
 		}
 
+#if MH_MUTEX_DEBUG_PROFILING
+		void lock(MH_SOURCE_LOCATION_AUTO(location))
+		{
+			if (!m_Mutex.try_lock())
+			{
+				const auto waitStart = detail::mutex_debug_hpp::clock_t::now();
+				m_Mutex.lock();
+				detail::mutex_debug_hpp::record_contended(*m_Profile, location, detail::mutex_debug_hpp::clock_t::now() - waitStart);
+			}
+
+			lock_acquired();
+		}
+
+		[[nodiscard]] std::unique_lock<mutex_debug> make_lock(MH_SOURCE_LOCATION_AUTO(location))
+		{
+			lock(location);
+			return std::unique_lock<mutex_debug>(*this, std::adopt_lock);
+		}
+#else
 		void lock()
 		{
 			m_Mutex.lock();
 			lock_acquired();
 		}
 
+		[[nodiscard]] std::unique_lock<mutex_debug> make_lock() { return std::unique_lock<mutex_debug>(*this); }
+#endif
+
 		bool try_lock()
 		{
 			const bool success = m_Mutex.try_lock();
@@ -50,14 +151,37 @@ namespace mh
 		{
 			assert(m_OwningThreadID == std::thread::id{});  // Attempted to lock while already locked
 			m_OwningThreadID = std::this_thread::get_id();
+
+#if MH_MUTEX_DEBUG_PROFILING
+			m_AcquiredAt = detail::mutex_debug_hpp::clock_t::now();
+			detail::mutex_debug_hpp::record_acquired(*m_Profile);
+#endif
 		}
 		void lock_releasing()
 		{
 			assert(m_OwningThreadID != std::thread::id{});  // Attempted to unlock while not already locked
 			m_OwningThreadID = {};
+
+#if MH_MUTEX_DEBUG_PROFILING
+			detail::mutex_debug_hpp::record_released(*m_Profile, detail::mutex_debug_hpp::clock_t::now() - m_AcquiredAt);
+#endif
 		}
 
 		TMutex m_Mutex;
 		std::thread::id m_OwningThreadID;
+
+#if MH_MUTEX_DEBUG_PROFILING
+		detail::mutex_debug_hpp::profile_data* m_Profile;
+		detail::mutex_debug_hpp::clock_t::time_point m_AcquiredAt; // Only touched while locked
+#endif
 	};
+
+	// For mutexes worth keeping an eye on: a mutex_debug when MH_MUTEX_DEBUG_PROFILING is enabled, otherwise
+	// just TMutex.
+	template<typename TMutex = std::mutex>
+	using profiled_mutex_t = std::conditional_t<MH_MUTEX_DEBUG_PROFILING, mutex_debug<TMutex>, TMutex>;
 }
+
+#ifndef MH_COMPILE_LIBRARY
+#include "mutex_debug.inl"
+#endif
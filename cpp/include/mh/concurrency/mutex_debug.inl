@@ -0,0 +1,199 @@
+#ifdef MH_COMPILE_LIBRARY
+#include "mutex_debug.hpp"
+#else
+#define MH_COMPILE_LIBRARY_INLINE inline
+#endif
+
+#include <algorithm>
+#include <bit>
+#include <memory>
+#include <ostream>
+#include <string_view>
+
+namespace mh
+{
+	namespace detail::mutex_debug_hpp
+	{
+		using histogram_data = std::array<std::atomic<std::uint64_t>, mutex_profile::HISTOGRAM_BUCKET_COUNT>;
+
+		struct site_data
+		{
+			mh::source_location m_Location;
+			std::uint64_t m_ContendedCount = 0;
+			clock_t::duration m_TotalWaitTime{};
+		};
+
+		struct profile_data
+		{
+			mh::source_location m_Location;
+
+			std::atomic<std::uint64_t> m_AcquireCount = 0;
+			std::atomic<std::uint64_t> m_ContendedCount = 0;
+			std::atomic<clock_t::rep> m_TotalWaitTime = 0;
+			std::atomic<clock_t::rep> m_TotalHoldTime = 0;
+			histogram_data m_WaitTimes{};
+			histogram_data m_HoldTimes{};
+
+			// Only touched on contention, which is already the slow path
+			std::mutex m_SitesMutex;
+			std::vector<site_data> m_Sites;
+		};
+
+		struct profile_registry
+		{
+			std::mutex m_Mutex;
+			std::vector<std::unique_ptr<profile_data>> m_Profiles;
+		};
+
+		MH_COMPILE_LIBRARY_INLINE profile_registry& get_profile_registry()
+		{
+			// Intentionally leaked, mutexes may still be locked and unlocked during static destruction
+			static profile_registry* s_Registry = new profile_registry();
+			return *s_Registry;
+		}
+
+		inline bool is_same_location(const mh::source_location& lhs, const mh::source_location& rhs) noexcept
+		{
+			return lhs.line() == rhs.line() && lhs.column() == rhs.column() &&
+				std::string_view(lhs.file_name()) == rhs.file_name() &&
+				std::string_view(lhs.function_name()) == rhs.function_name();
+		}
+
+		inline void add_to_histogram(histogram_data& histogram, clock_t::duration duration) noexcept
+		{
+			const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+			const std::size_t bucket = ns > 0 ? std::min<std::size_t>(std::bit_width(std::uint64_t(ns)) - 1, histogram.size() - 1) : 0;
+			histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+		}
+
+		MH_COMPILE_LIBRARY_INLINE profile_data& get_profile_data(const mh::source_location& constructedAt)
+		{
+			profile_registry& registry = get_profile_registry();
+			std::lock_guard lock(registry.m_Mutex);
+
+			for (const auto& profile : registry.m_Profiles)
+			{
+				if (is_same_location(profile->m_Location, constructedAt))
+					return *profile;
+			}
+
+			auto& profile = registry.m_Profiles.emplace_back(std::make_unique<profile_data>());
+			profile->m_Location = constructedAt;
+			return *profile;
+		}
+
+		MH_COMPILE_LIBRARY_INLINE void record_acquired(profile_data& profile) noexcept
+		{
+			profile.m_AcquireCount.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		MH_COMPILE_LIBRARY_INLINE void record_contended(profile_data& profile, const mh::source_location& site, clock_t::duration waitTime)
+		{
+			profile.m_ContendedCount.fetch_add(1, std::memory_order_relaxed);
+			profile.m_TotalWaitTime.fetch_add(waitTime.count(), std::memory_order_relaxed);
+			add_to_histogram(profile.m_WaitTimes, waitTime);
+
+			std::lock_guard lock(profile.m_SitesMutex);
+			auto found = std::find_if(profile.m_Sites.begin(), profile.m_Sites.end(),
+				[&](const site_data& data) { return is_same_location(data.m_Location, site); });
+
+			if (found == profile.m_Sites.end())
+				found = profile.m_Sites.insert(found, site_data{ site });
+
+			found->m_ContendedCount++;
+			found->m_TotalWaitTime += waitTime;
+		}
+
+		MH_COMPILE_LIBRARY_INLINE void record_released(profile_data& profile, clock_t::duration holdTime) noexcept
+		{
+			profile.m_TotalHoldTime.fetch_add(holdTime.count(), std::memory_order_relaxed);
+			add_to_histogram(profile.m_HoldTimes, holdTime);
+		}
+	}
+
+	MH_COMPILE_LIBRARY_INLINE std::vector<mutex_profile> get_mutex_profiles()
+	{
+		using namespace detail::mutex_debug_hpp;
+
+		std::vector<mutex_profile> profiles;
+
+		profile_registry& registry = get_profile_registry();
+		std::lock_guard lock(registry.m_Mutex);
+
+		for (const auto& data : registry.m_Profiles)
+		{
+			mutex_profile& profile = profiles.emplace_back();
+			profile.m_Location = data->m_Location;
+			profile.m_AcquireCount = data->m_AcquireCount.load(std::memory_order_relaxed);
+			profile.m_ContendedCount = data->m_ContendedCount.load(std::memory_order_relaxed);
+			profile.m_TotalWaitTime = clock_t::duration(data->m_TotalWaitTime.load(std::memory_order_relaxed));
+			profile.m_TotalHoldTime = clock_t::duration(data->m_TotalHoldTime.load(std::memory_order_relaxed));
+
+			for (std::size_t i = 0; i < mutex_profile::HISTOGRAM_BUCKET_COUNT; i++)
+			{
+				profile.m_WaitTimes[i] = data->m_WaitTimes[i].load(std::memory_order_relaxed);
+				profile.m_HoldTimes[i] = data->m_HoldTimes[i].load(std::memory_order_relaxed);
+			}
+
+			{
+				std::lock_guard sitesLock(data->m_SitesMutex);
+				for (const site_data& site : data->m_Sites)
+					profile.m_ContendedSites.push_back({ site.m_Location, site.m_ContendedCount, site.m_TotalWaitTime });
+			}
+
+			std::sort(profile.m_ContendedSites.begin(), profile.m_ContendedSites.end(),
+				[](const mutex_profile::site& lhs, const mutex_profile::site& rhs) { return lhs.m_TotalWaitTime > rhs.m_TotalWaitTime; });
+		}
+
+		std::sort(profiles.begin(), profiles.end(),
+			[](const mutex_profile& lhs, const mutex_profile& rhs) { return lhs.m_TotalWaitTime > rhs.m_TotalWaitTime; });
+
+		return profiles;
+	}
+
+	MH_COMPILE_LIBRARY_INLINE void reset_mutex_profiles()
+	{
+		using namespace detail::mutex_debug_hpp;
+
+		// Mutexes hold on to their profile_data, so it's reset in place rather than removed
+		profile_registry& registry = get_profile_registry();
+		std::lock_guard lock(registry.m_Mutex);
+
+		for (const auto& data : registry.m_Profiles)
+		{
+			data->m_AcquireCount.store(0, std::memory_order_relaxed);
+			data->m_ContendedCount.store(0, std::memory_order_relaxed);
+			data->m_TotalWaitTime.store(0, std::memory_order_relaxed);
+			data->m_TotalHoldTime.store(0, std::memory_order_relaxed);
+
+			for (std::size_t i = 0; i < mutex_profile::HISTOGRAM_BUCKET_COUNT; i++)
+			{
+				data->m_WaitTimes[i].store(0, std::memory_order_relaxed);
+				data->m_HoldTimes[i].store(0, std::memory_order_relaxed);
+			}
+
+			std::lock_guard sitesLock(data->m_SitesMutex);
+			data->m_Sites.clear();
+		}
+	}
+
+	MH_COMPILE_LIBRARY_INLINE void write_mutex_profile_report(std::ostream& os)
+	{
+		using std::chrono::duration_cast;
+		using std::chrono::microseconds;
+
+		for (const mutex_profile& profile : get_mutex_profiles())
+		{
+			os << profile.m_Location << '\n'
+				<< "\tacquired " << profile.m_AcquireCount << " times, contended " << profile.m_ContendedCount << " times\n"
+				<< "\ttotal wait " << duration_cast<microseconds>(profile.m_TotalWaitTime).count() << "us, "
+				<< "total hold " << duration_cast<microseconds>(profile.m_TotalHoldTime).count() << "us\n";
+
+			for (const mutex_profile::site& site : profile.m_ContendedSites)
+			{
+				os << "\t\t" << site.m_Location << ": contended " << site.m_ContendedCount << " times, waited "
+					<< duration_cast<microseconds>(site.m_TotalWaitTime).count() << "us\n";
+			}
+		}
+	}
+}
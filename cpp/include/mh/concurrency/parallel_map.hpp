@@ -0,0 +1,95 @@
+#pragma once
+
+#if __has_include(<mh/coroutine/coroutine_include.hpp>)
+#include <mh/coroutine/coroutine_include.hpp>
+#endif
+
+#ifdef MH_COROUTINES_SUPPORTED
+
+#include <mh/coroutine/generator.hpp>
+#include "thread_pool.hpp"
+
+#include <deque>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+namespace mh
+{
+	namespace detail::parallel_map_hpp
+	{
+		template<typename TRange>
+		using range_value_t = std::remove_cvref_t<decltype(*std::begin(std::declval<TRange&>()))>;
+
+		// Everything still running on the pool refers to the func in our frame, so we can't let the
+		// frame go away (when the consumer stops early, or an exception comes through) until it's done.
+		// Nobody wants the results by then, so anything still queued on the pool is cancelled (see
+		// thread_pool::co_add_task()) instead of calling func for nothing.
+		template<typename TResult>
+		struct in_flight_tasks
+		{
+			~in_flight_tasks()
+			{
+				for (const mh::task<TResult>& task : m_Tasks)
+					task.request_cancel();
+
+				for (const mh::task<TResult>& task : m_Tasks)
+					task.wait();
+			}
+
+			std::deque<mh::task<TResult>> m_Tasks;
+		};
+
+		template<typename TRange, typename TFunc, typename TResult>
+		generator<TResult> parallel_map(TRange input, thread_pool& pool, TFunc func, size_t maxInFlight)
+		{
+			in_flight_tasks<TResult> inFlight;
+
+			for (auto&& value : input)
+			{
+				if (inFlight.m_Tasks.size() >= maxInFlight)
+				{
+					co_yield inFlight.m_Tasks.front().get();
+					inFlight.m_Tasks.pop_front();
+				}
+
+				inFlight.m_Tasks.push_back(pool.add_task([&func](range_value_t<TRange> arg) -> TResult
+					{
+						return func(std::move(arg));
+					}, range_value_t<TRange>(std::forward<decltype(value)>(value))));
+			}
+
+			while (!inFlight.m_Tasks.empty())
+			{
+				co_yield inFlight.m_Tasks.front().get();
+				inFlight.m_Tasks.pop_front();
+			}
+		}
+	}
+
+	// Calls func on every element of input (usually a generator) on the thread pool, and yields the
+	// results in the same order as the input. At most maxInFlight elements are being worked on (or
+	// waiting to be consumed) at once, so input is only pulled as fast as the results are consumed.
+	// func is called from several threads at once. Waiting for the next result blocks the consumer.
+	template<typename TRange, typename TFunc,
+		typename TResult = std::invoke_result_t<TFunc&, detail::parallel_map_hpp::range_value_t<TRange>&&>>
+	generator<TResult> parallel_map(TRange input, thread_pool& pool, TFunc func, size_t maxInFlight)
+	{
+		static_assert(!std::is_void_v<TResult>, "func must return something to yield");
+
+		if (maxInFlight < 1)
+			throw std::invalid_argument("maxInFlight must be >= 1");
+
+		return detail::parallel_map_hpp::parallel_map<TRange, TFunc, TResult>(
+			std::move(input), pool, std::move(func), maxInFlight);
+	}
+
+	template<typename TRange, typename TFunc>
+	auto parallel_map(TRange input, thread_pool& pool, TFunc func)
+	{
+		return parallel_map(std::move(input), pool, std::move(func), pool.thread_count() * 2);
+	}
+}
+
+#endif
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+
+#ifndef MH_STUFF_API
+#define MH_STUFF_API
+#endif
+
+namespace mh
+{
+	namespace detail::rcu_value_hpp
+	{
+		// Epoch based reclamation. There is only one epoch domain for the whole process, shared by every
+		// rcu_value. Each thread that reads has a record with the global epoch it saw when it started
+		// reading. Replaced values are retired with the epoch they were replaced in, and deleted once no
+		// reader could have started before that.
+		struct thread_record
+		{
+			static constexpr std::uint64_t INACTIVE = UINT64_MAX;
+
+			std::atomic<std::uint64_t> m_Epoch = INACTIVE;
+			std::uint32_t m_ReadDepth = 0; // Only touched by the owning thread
+			std::atomic_bool m_IsInUse = false;
+			thread_record* m_Next = nullptr;
+		};
+
+		using deleter_t = void (*)(const void* ptr) noexcept;
+
+		MH_STUFF_API thread_record& enter_read(); // The first read on a thread allocates its record
+		MH_STUFF_API void exit_read(thread_record& record) noexcept;
+
+		// Deletes ptr once every reader that could still be looking at it is done. Must only be called
+		// after ptr is no longer reachable by new readers.
+		MH_STUFF_API void retire(const void* ptr, deleter_t deleter);
+	}
+
+	// Holds a large, read-mostly T that is never modified in place. Readers get a snapshot of the
+	// current value without copying or blocking anyone, and only the first read on each thread
+	// allocates. Writers publish a whole new T, and the old one is deleted once the last snapshot that
+	// could be looking at it is gone.
+	//
+	// Every rcu_value shares one epoch domain, so a snapshot of any of them holds back the deletion of
+	// every value retired while it exists, in all of them. Snapshots are meant to be short-lived.
+	template<typename T>
+	class rcu_value final
+	{
+		using thread_record = detail::rcu_value_hpp::thread_record;
+
+	public:
+		using value_type = T;
+
+		// A read-only view of the value at the time it was taken. It keeps that version alive, and it
+		// also delays deletion of old versions of every other rcu_value, so don't hold on to it for
+		// longer than needed. Must be destroyed on the thread that created it.
+		class snapshot final
+		{
+		public:
+			snapshot(snapshot&& other) noexcept :
+				m_Value(std::exchange(other.m_Value, nullptr)),
+				m_Record(std::exchange(other.m_Record, nullptr))
+			{
+			}
+			snapshot& operator=(snapshot&& other) noexcept
+			{
+				assert(std::addressof(other) != this);
+				release();
+				m_Value = std::exchange(other.m_Value, nullptr);
+				m_Record = std::exchange(other.m_Record, nullptr);
+				return *this;
+			}
+			~snapshot() { release(); }
+
+			const T& get() const noexcept { return *m_Value; }
+			const T& operator*() const noexcept { return *m_Value; }
+			const T* operator->() const noexcept { return m_Value; }
+
+		private:
+			friend class rcu_value;
+
+			snapshot(const T* value, thread_record& record) noexcept : m_Value(value), m_Record(&record) {}
+
+			void release() noexcept
+			{
+				if (m_Record)
+					detail::rcu_value_hpp::exit_read(*std::exchange(m_Record, nullptr));
+			}
+
+			const T* m_Value;
+			thread_record* m_Record;
+		};
+
+		rcu_value() requires std::is_default_constructible_v<T> : m_Value(new T()) {}
+		rcu_value(const T& initialVal) : m_Value(new T(initialVal)) {}
+		rcu_value(T&& initialVal) : m_Value(new T(std::move(initialVal))) {}
+		~rcu_value() { retire(m_Value.load(std::memory_order_relaxed)); }
+
+		rcu_value(const rcu_value&) = delete;
+		rcu_value& operator=(const rcu_value&) = delete;
+
+		[[nodiscard]] snapshot get() const
+		{
+			thread_record& record = detail::rcu_value_hpp::enter_read();
+			return snapshot(m_Value.load(std::memory_order_seq_cst), record);
+		}
+
+		void set(T value)
+		{
+			const T* newValue = new T(std::move(value));
+
+			std::lock_guard lock(m_WriteMutex);
+			retire(m_Value.exchange(newValue, std::memory_order_seq_cst));
+		}
+
+		// Calls func(T&) with a copy of the current value, and publishes whatever it leaves behind. No other
+		// writes can happen in between.
+		template<typename TFunc>
+		void update(TFunc&& func)
+		{
+			std::lock_guard lock(m_WriteMutex);
+
+			auto newValue = std::make_unique<T>(*m_Value.load(std::memory_order_relaxed));
+			func(*newValue);
+			retire(m_Value.exchange(newValue.release(), std::memory_order_seq_cst));
+		}
+
+	private:
+		static void retire(const T* value)
+		{
+			detail::rcu_value_hpp::retire(value, [](const void* ptr) noexcept { delete static_cast<const T*>(ptr); });
+		}
+
+		std::atomic<const T*> m_Value;
+		std::mutex m_WriteMutex;
+	};
+}
+
+#ifndef MH_COMPILE_LIBRARY
+#include "rcu_value.inl"
+#endif
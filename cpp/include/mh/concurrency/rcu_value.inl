@@ -0,0 +1,138 @@
+#ifdef MH_COMPILE_LIBRARY
+#include "rcu_value.hpp"
+#else
+#define MH_COMPILE_LIBRARY_INLINE inline
+#endif
+
+#include <algorithm>
+#include <vector>
+
+namespace mh::detail::rcu_value_hpp
+{
+	class epoch_domain final
+	{
+	public:
+		static epoch_domain& get()
+		{
+			// Intentionally leaked, snapshots may still be released during static destruction
+			static epoch_domain* s_Instance = new epoch_domain();
+			return *s_Instance;
+		}
+
+		std::uint64_t current_epoch() const noexcept { return m_GlobalEpoch.load(std::memory_order_seq_cst); }
+
+		// Records are never freed, only handed on to new threads when the old ones exit
+		thread_record& acquire_record()
+		{
+			for (thread_record* record = m_Records.load(std::memory_order_acquire); record; record = record->m_Next)
+			{
+				bool expected = false;
+				if (!record->m_IsInUse.load(std::memory_order_relaxed) &&
+					record->m_IsInUse.compare_exchange_strong(expected, true, std::memory_order_acquire))
+				{
+					// The last owner should have left it clean, but if it didn't it must not keep holding
+					// back reclamation (or leave the new owner's read depth off by some amount)
+					assert(record->m_ReadDepth == 0);
+					assert(record->m_Epoch.load(std::memory_order_relaxed) == thread_record::INACTIVE);
+					record->m_ReadDepth = 0;
+					record->m_Epoch.store(thread_record::INACTIVE, std::memory_order_seq_cst);
+					return *record;
+				}
+			}
+
+			auto record = new thread_record();
+			record->m_IsInUse.store(true, std::memory_order_relaxed);
+			record->m_Next = m_Records.load(std::memory_order_relaxed);
+			while (!m_Records.compare_exchange_weak(record->m_Next, record, std::memory_order_release, std::memory_order_relaxed))
+				;
+
+			return *record;
+		}
+
+		void retire(const void* ptr, deleter_t deleter)
+		{
+			std::vector<retired_object> reclaimable;
+
+			{
+				std::lock_guard lock(m_RetiredMutex);
+
+				// Anyone that reads the epoch after this also sees the new value, not ptr
+				const std::uint64_t epoch = m_GlobalEpoch.fetch_add(1, std::memory_order_seq_cst);
+				m_Retired.push_back({ ptr, deleter, epoch });
+
+				const std::uint64_t oldestReader = get_oldest_reader_epoch();
+				auto firstReclaimable = std::partition(m_Retired.begin(), m_Retired.end(),
+					[&](const retired_object& obj) { return obj.m_Epoch >= oldestReader; });
+
+				reclaimable.assign(firstReclaimable, m_Retired.end());
+				m_Retired.erase(firstReclaimable, m_Retired.end());
+			}
+
+			for (const retired_object& obj : reclaimable)
+				obj.m_Deleter(obj.m_Ptr);
+		}
+
+	private:
+		struct retired_object
+		{
+			const void* m_Ptr;
+			deleter_t m_Deleter;
+			std::uint64_t m_Epoch;
+		};
+
+		std::uint64_t get_oldest_reader_epoch() const noexcept
+		{
+			std::uint64_t oldest = thread_record::INACTIVE;
+			for (thread_record* record = m_Records.load(std::memory_order_acquire); record; record = record->m_Next)
+				oldest = std::min(oldest, record->m_Epoch.load(std::memory_order_seq_cst));
+
+			return oldest;
+		}
+
+		std::atomic<std::uint64_t> m_GlobalEpoch = 0;
+		std::atomic<thread_record*> m_Records = nullptr;
+
+		std::mutex m_RetiredMutex;
+		std::vector<retired_object> m_Retired;
+	};
+
+	inline thread_record& get_thread_record()
+	{
+		struct holder
+		{
+			holder() : m_Record(epoch_domain::get().acquire_record()) {}
+			~holder()
+			{
+				assert(m_Record.m_ReadDepth == 0); // Thread exited while still holding a snapshot
+				m_Record.m_IsInUse.store(false, std::memory_order_release);
+			}
+
+			thread_record& m_Record;
+		};
+
+		static thread_local holder s_Holder;
+		return s_Holder.m_Record;
+	}
+
+	MH_COMPILE_LIBRARY_INLINE thread_record& enter_read()
+	{
+		thread_record& record = get_thread_record();
+		if (record.m_ReadDepth++ == 0)
+			record.m_Epoch.store(epoch_domain::get().current_epoch(), std::memory_order_seq_cst);
+
+		return record;
+	}
+
+	MH_COMPILE_LIBRARY_INLINE void exit_read(thread_record& record) noexcept
+	{
+		assert(&record == &get_thread_record()); // Snapshot released on a different thread than it was taken on
+		assert(record.m_ReadDepth > 0);
+		if (--record.m_ReadDepth == 0)
+			record.m_Epoch.store(thread_record::INACTIVE, std::memory_order_release);
+	}
+
+	MH_COMPILE_LIBRARY_INLINE void retire(const void* ptr, deleter_t deleter)
+	{
+		epoch_domain::get().retire(ptr, deleter);
+	}
+}
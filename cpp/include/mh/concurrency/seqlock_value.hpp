@@ -0,0 +1,131 @@
+#pragma once
+
+#include "futex.hpp"
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <type_traits>
+
+namespace mh
+{
+	// Like locked_value, but for small trivially copyable values that are read far more often than they
+	// are written. Readers never write to shared memory: they copy the value out and try again if a
+	// writer got in the way, so any number of them can read at once without slowing each other down.
+	// Writers are serialized by TMutex.
+	template<typename T, typename TMutex = std::mutex>
+	class seqlock_value final
+	{
+		static_assert(std::is_trivially_copyable_v<T>, "T must be trivially copyable");
+
+		// The value is stored as atomic words, so that a reader racing a writer is a retry and not a data race
+		using word_type = std::uintptr_t;
+		static constexpr std::size_t WORD_COUNT = (sizeof(T) + sizeof(word_type) - 1) / sizeof(word_type);
+		using words_type = std::array<word_type, WORD_COUNT>;
+
+	public:
+		using value_type = T;
+		using mutex_type = TMutex;
+
+		seqlock_value() requires std::is_default_constructible_v<T> : seqlock_value(T{}) {}
+		seqlock_value(const T& initialVal) { store_words(to_words(initialVal)); }
+
+		seqlock_value(const seqlock_value&) = delete;
+		seqlock_value& operator=(const seqlock_value&) = delete;
+
+		operator T() const { return get(); }
+		seqlock_value& operator=(const T& value)
+		{
+			set(value);
+			return *this;
+		}
+
+		T get() const noexcept
+		{
+			words_type words;
+
+			while (true)
+			{
+				const std::uint32_t sequence = m_Sequence.load(std::memory_order_acquire);
+				if (sequence & 1)
+				{
+					mh::cpu_relax(); // Someone's in the middle of writing
+					continue;
+				}
+
+				// Acquire, so that the sequence can't be checked again before we're done reading. If we read
+				// anything a writer stored, we'll also see the sequence number it changed before storing it.
+				for (std::size_t i = 0; i < WORD_COUNT; i++)
+					words[i] = m_Words[i].load(std::memory_order_acquire);
+
+				if (m_Sequence.load(std::memory_order_relaxed) == sequence)
+					break;
+			}
+
+			return from_words(words);
+		}
+
+		void set(const T& value)
+		{
+			const words_type words = to_words(value);
+
+			std::lock_guard lock(m_WriteMutex);
+			store_words(words);
+		}
+
+		// Calls func(T&) with the current value, and stores whatever it leaves behind. No other writes can
+		// happen in between.
+		template<typename TFunc>
+		void update(TFunc&& func)
+		{
+			std::lock_guard lock(m_WriteMutex);
+
+			T value = from_words(load_words_locked());
+			func(value);
+			store_words(to_words(value));
+		}
+
+	private:
+		static words_type to_words(const T& value) noexcept
+		{
+			words_type words{};
+			std::memcpy(words.data(), &value, sizeof(T));
+			return words;
+		}
+		static T from_words(const words_type& words) noexcept
+		{
+			std::array<std::byte, sizeof(T)> bytes;
+			std::memcpy(bytes.data(), words.data(), sizeof(T));
+			return std::bit_cast<T>(bytes);
+		}
+
+		// Only for writers, nobody else can be changing anything
+		words_type load_words_locked() const noexcept
+		{
+			words_type words;
+			for (std::size_t i = 0; i < WORD_COUNT; i++)
+				words[i] = m_Words[i].load(std::memory_order_relaxed);
+
+			return words;
+		}
+
+		void store_words(const words_type& words) noexcept
+		{
+			const std::uint32_t sequence = m_Sequence.load(std::memory_order_relaxed);
+			m_Sequence.store(sequence + 1, std::memory_order_relaxed);
+
+			for (std::size_t i = 0; i < WORD_COUNT; i++)
+				m_Words[i].store(words[i], std::memory_order_release);
+
+			m_Sequence.store(sequence + 2, std::memory_order_release);
+		}
+
+		std::atomic<std::uint32_t> m_Sequence = 0; // Odd while a write is in progress
+		std::array<std::atomic<word_type>, WORD_COUNT> m_Words{};
+		mutex_type m_WriteMutex;
+	};
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#if __has_include(<mh/coroutine/coroutine_include.hpp>)
+#include <mh/coroutine/coroutine_include.hpp>
+#endif
+
+#ifdef MH_COROUTINES_SUPPORTED
+
+#include <mh/coroutine/task_registry.hpp>
+#include "dispatcher.hpp"
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifndef MH_STUFF_API
+#define MH_STUFF_API
+#endif
+
+namespace mh
+{
+	// Keeps an eye on the task registry from a background thread, and reports coroutines that have been
+	// running for longer than a threshold since they were last resumed. Those are the ones blocking
+	// whatever thread they are on, usually by doing blocking work (or waiting) without co_await.
+	// Each stall is reported once. Never reports anything unless MH_COROUTINE_TASK_REGISTRY is enabled.
+	class task_watchdog final
+	{
+	public:
+		using clock_t = task_info::clock_t;
+		using report_func_t = std::function<void(const task_info& task, clock_t::duration runningFor)>;
+
+		// Only watches coroutines resumed by the dispatcher (from inside its run()/run_one())
+		MH_STUFF_API task_watchdog(const dispatcher& dispatcher, clock_t::duration threshold, report_func_t reportFunc);
+		// Watches every registered task
+		MH_STUFF_API task_watchdog(clock_t::duration threshold, report_func_t reportFunc);
+		MH_STUFF_API ~task_watchdog();
+
+		task_watchdog(const task_watchdog&) = delete;
+		task_watchdog& operator=(const task_watchdog&) = delete;
+
+		// Checks right now on the calling thread, instead of waiting for the background thread to get to
+		// it. Returns the number of newly reported tasks.
+		MH_STUFF_API size_t check();
+
+	private:
+		MH_STUFF_API task_watchdog(const void* executor, clock_t::duration threshold, report_func_t reportFunc);
+
+		void ThreadFunc();
+
+		const void* m_Executor = nullptr;
+		clock_t::duration m_Threshold;
+		report_func_t m_ReportFunc;
+
+		std::mutex m_CheckMutex;
+		std::vector<std::pair<const void*, clock_t::time_point>> m_Reported; // Address and m_RunningSince
+
+		std::mutex m_StopMutex;
+		std::condition_variable m_StopCV;
+		bool m_IsStopping = false;
+
+		std::thread m_Thread;
+	};
+}
+
+#ifndef MH_COMPILE_LIBRARY
+#include "task_watchdog.inl"
+#endif
+
+#endif
@@ -0,0 +1,100 @@
+#ifdef MH_COMPILE_LIBRARY
+#include "task_watchdog.hpp"
+#endif
+
+#ifndef MH_COMPILE_LIBRARY_INLINE
+#define MH_COMPILE_LIBRARY_INLINE inline
+#endif
+
+#ifdef MH_COROUTINES_SUPPORTED
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+namespace mh
+{
+	MH_COMPILE_LIBRARY_INLINE task_watchdog::task_watchdog(const dispatcher& dispatcher, clock_t::duration threshold, report_func_t reportFunc) :
+		task_watchdog(dispatcher.m_ThreadData.get(), threshold, std::move(reportFunc))
+	{
+	}
+
+	MH_COMPILE_LIBRARY_INLINE task_watchdog::task_watchdog(clock_t::duration threshold, report_func_t reportFunc) :
+		task_watchdog(nullptr, threshold, std::move(reportFunc))
+	{
+	}
+
+	MH_COMPILE_LIBRARY_INLINE task_watchdog::task_watchdog(const void* executor, clock_t::duration threshold, report_func_t reportFunc) :
+		m_Executor(executor),
+		m_Threshold(threshold),
+		m_ReportFunc(std::move(reportFunc))
+	{
+		if (threshold <= clock_t::duration::zero())
+			throw std::invalid_argument("threshold must be > 0");
+
+#if MH_COROUTINE_TASK_REGISTRY
+		m_Thread = std::thread(&task_watchdog::ThreadFunc, this);
+#endif
+	}
+
+	MH_COMPILE_LIBRARY_INLINE task_watchdog::~task_watchdog()
+	{
+		{
+			std::lock_guard lock(m_StopMutex);
+			m_IsStopping = true;
+		}
+
+		m_StopCV.notify_all();
+
+		if (m_Thread.joinable())
+			m_Thread.join();
+	}
+
+	MH_COMPILE_LIBRARY_INLINE void task_watchdog::ThreadFunc()
+	{
+		// Often enough that nothing runs for much longer than the threshold before being reported
+		const auto interval = std::max<clock_t::duration>(m_Threshold / 4, std::chrono::milliseconds(1));
+
+		std::unique_lock lock(m_StopMutex);
+		while (!m_StopCV.wait_for(lock, interval, [&] { return m_IsStopping; }))
+		{
+			lock.unlock();
+			check();
+			lock.lock();
+		}
+	}
+
+	MH_COMPILE_LIBRARY_INLINE size_t task_watchdog::check()
+	{
+		std::lock_guard lock(m_CheckMutex);
+
+		const auto now = clock_t::now();
+		size_t reportedCount = 0;
+		std::vector<std::pair<const void*, clock_t::time_point>> stillRunning;
+
+		for (const task_info& task : get_registered_tasks())
+		{
+			if (!task.m_IsRunning || (m_Executor && task.m_Executor != m_Executor))
+				continue;
+
+			const auto runningFor = now - task.m_RunningSince;
+			if (runningFor < m_Threshold)
+				continue;
+
+			const std::pair<const void*, clock_t::time_point> key(task.m_Address, task.m_RunningSince);
+			if (std::find(m_Reported.begin(), m_Reported.end(), key) == m_Reported.end())
+			{
+				m_ReportFunc(task, runningFor);
+				reportedCount++;
+			}
+
+			stillRunning.push_back(key);
+		}
+
+		// Forget about anything that has since been suspended, so the list doesn't grow forever
+		m_Reported = std::move(stillRunning);
+		return reportedCount;
+	}
+}
+
+#endif
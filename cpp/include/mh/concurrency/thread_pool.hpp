@@ -10,6 +10,7 @@
 
 #include "dispatcher.hpp"
 
+#include <cassert>
 #include <memory>
 #include <optional>
 
@@ -28,6 +29,14 @@ namespace mh
 			MH_STUFF_API void await_resume() const;
 			MH_STUFF_API bool await_suspend(coro::coroutine_handle<> parent);
 
+			// Lets the dispatcher see the awaiting task, so cancelled tasks don't get queued
+			template<typename TPromise>
+			bool await_suspend(coro::coroutine_handle<TPromise> parent)
+			{
+				assert(!await_ready());
+				return m_DispatchTask.value().await_suspend(parent);
+			}
+
 		private:
 			std::optional<mh::dispatcher::dispatch_task_t> m_DispatchTask;
 		};
@@ -49,6 +58,9 @@ namespace mh
 		MH_STUFF_API mh::dispatcher::delay_task_t co_delay_until(clock_t::time_point timePoint);
 		MH_STUFF_API mh::dispatcher::delay_task_t co_delay_for(clock_t::duration duration);
 
+		// Calls func(userData) on one of the pool's threads, without needing a coroutine to do it
+		MH_STUFF_API void post(void (*func)(void* userData), void* userData);
+
 		template<typename TFunc, typename... TArgs>
 		mh::task<std::invoke_result_t<TFunc, TArgs...>> add_task(TFunc func, TArgs... args)
 		{
@@ -65,6 +77,10 @@ namespace mh
 
 		static void ThreadFunc(std::shared_ptr<thread_data> data);
 	};
+
+	// A process-wide pool (with one thread per core) for anything that just needs somewhere to run,
+	// created the first time it is asked for.
+	MH_STUFF_API thread_pool& default_thread_pool();
 }
 
 #ifndef MH_COMPILE_LIBRARY
@@ -87,6 +87,18 @@ namespace mh
 		return detail::thread_pool_hpp::dispatcher_task_wrapper(m_ThreadData->m_Dispatcher.co_dispatch());
 	}
 
+	MH_COMPILE_LIBRARY_INLINE void thread_pool::post(void (*func)(void* userData), void* userData)
+	{
+		m_ThreadData->m_Dispatcher.post(func, userData);
+	}
+
+	MH_COMPILE_LIBRARY_INLINE thread_pool& default_thread_pool()
+	{
+		// Intentionally leaked, work may still be queued up on it during static destruction
+		static thread_pool* s_Pool = new thread_pool();
+		return *s_Pool;
+	}
+
 	MH_COMPILE_LIBRARY_INLINE mh::dispatcher::delay_task_t thread_pool::co_delay_until(clock_t::time_point timePoint)
 	{
 		return m_ThreadData->m_Dispatcher.co_delay_until(timePoint);
@@ -0,0 +1,189 @@
+#pragma once
+
+#include "lazy_task.hpp"
+
+#ifdef MH_COROUTINES_SUPPORTED
+
+#include <cassert>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+namespace mh
+{
+	template<typename T> class async_generator;
+
+	namespace detail::async_generator_hpp
+	{
+		template<typename T> class promise;
+
+		// Hands control straight back to the coroutine waiting on next(), for both co_yield and co_return
+		struct yield_awaiter
+		{
+			constexpr bool await_ready() const noexcept { return false; }
+
+			template<typename TPromise>
+			coro::coroutine_handle<> await_suspend(coro::coroutine_handle<TPromise> handle) const noexcept
+			{
+				if (coro::coroutine_handle<> consumer = std::exchange(handle.promise().m_Consumer, nullptr))
+					return consumer;
+
+				return coro::noop_coroutine();
+			}
+
+			constexpr void await_resume() const noexcept {}
+		};
+
+		// Like lazy_task, nothing here needs to be atomic: the consumer is always suspended while we run,
+		// and we are always suspended while the consumer runs. Cancelling the consumer while it waits on
+		// next() cancels the generator, which stays cancelled from then on.
+		template<typename T>
+		class promise final : public frame_allocator_hpp::recycled_frame, public cancellation_hpp::cancellation_state
+		{
+		public:
+			using value_type = std::remove_cvref_t<T>;
+			using io_type = std::conditional_t<std::is_rvalue_reference_v<T>, T, const value_type&>;
+			using storage_type = std::conditional_t<std::is_rvalue_reference_v<T>, value_type*, const value_type*>;
+
+			async_generator<T> get_return_object() noexcept;
+
+			constexpr coro::suspend_always initial_suspend() const noexcept { return {}; }
+			yield_awaiter final_suspend() noexcept
+			{
+				m_Current = nullptr;
+				return {};
+			}
+
+			yield_awaiter yield_value(io_type value) noexcept
+			{
+				m_Current = std::addressof(value);
+				return {};
+			}
+
+			void return_void() noexcept {}
+
+			void unhandled_exception() noexcept
+			{
+				m_Exception = std::current_exception();
+			}
+
+			std::optional<value_type> get_current()
+			{
+				if (m_Exception)
+					std::rethrow_exception(std::exchange(m_Exception, nullptr));
+
+				if (!m_Current)
+					return std::nullopt;
+
+				return std::optional<value_type>(static_cast<io_type>(*m_Current));
+			}
+
+			coro::coroutine_handle<> m_Consumer;
+
+		private:
+			storage_type m_Current = nullptr;
+			std::exception_ptr m_Exception;
+		};
+
+		template<typename T>
+		class next_awaiter final
+		{
+		public:
+			explicit next_awaiter(coro::coroutine_handle<promise<T>> handle) noexcept : m_Handle(handle) {}
+
+			bool await_ready() const noexcept { return !m_Handle || m_Handle.done(); }
+
+			template<typename TConsumerPromise>
+			coro::coroutine_handle<> await_suspend(coro::coroutine_handle<TConsumerPromise> consumer) noexcept
+			{
+				m_CancelForwarder.start(consumer, m_Handle.promise());
+
+				// Run the generator up to its next co_yield, it transfers straight back to us afterwards
+				m_Handle.promise().m_Consumer = consumer;
+				return m_Handle;
+			}
+			std::optional<typename promise<T>::value_type> await_resume()
+			{
+				m_CancelForwarder.stop();
+
+				if (!m_Handle)
+					return std::nullopt;
+
+				return m_Handle.promise().get_current();
+			}
+
+		private:
+			coro::coroutine_handle<promise<T>> m_Handle;
+			cancellation_hpp::cancel_forwarder<cancellation_hpp::cancellation_state> m_CancelForwarder;
+		};
+	}
+
+	// A generator that can co_await anything it likes (tasks, dispatcher delays, channels) between
+	// co_yields. Nothing runs until the first next(), and it only ever runs up to the next co_yield,
+	// so values are produced as they are consumed without anything piling up in between.
+	//
+	// Like lazy_task, the generator runs on whatever thread calls next(), and the consumer is resumed
+	// on whatever thread the generator was on when it co_yielded.
+	template<typename T>
+	class [[nodiscard]] async_generator final
+	{
+	public:
+		using promise_type = detail::async_generator_hpp::promise<T>;
+		using coroutine_type = detail::coro::coroutine_handle<promise_type>;
+		using value_type = typename promise_type::value_type;
+
+		async_generator() noexcept = default;
+		explicit async_generator(coroutine_type handle) noexcept : m_Handle(handle) {}
+
+		async_generator(async_generator&& other) noexcept : m_Handle(std::exchange(other.m_Handle, nullptr)) {}
+		async_generator& operator=(async_generator&& other) noexcept
+		{
+			assert(std::addressof(other) != this);
+			if (m_Handle)
+				m_Handle.destroy();
+
+			m_Handle = std::exchange(other.m_Handle, nullptr);
+			return *this;
+		}
+
+		~async_generator()
+		{
+			if (m_Handle)
+				m_Handle.destroy();
+		}
+
+		[[nodiscard]] bool valid() const noexcept { return !!m_Handle; }
+		[[nodiscard]] bool is_done() const noexcept { return !m_Handle || m_Handle.done(); }
+
+		// Resumes with the next value, or std::nullopt once the generator has finished. Rethrows anything
+		// the generator threw. Only one next() may be in flight at a time.
+		[[nodiscard]] auto next() noexcept { return detail::async_generator_hpp::next_awaiter<T>(m_Handle); }
+
+		// Calls func with every remaining value, in place of a for co_await loop. If func returns
+		// something awaitable, it is co_awaited before moving on to the next value.
+		template<typename TFunc>
+		lazy_task<> co_for_each(TFunc func)
+		{
+			while (std::optional<value_type> value = co_await next())
+			{
+				if constexpr (std::is_void_v<std::invoke_result_t<TFunc&, value_type&&>>)
+					func(std::move(*value));
+				else
+					co_await func(std::move(*value));
+			}
+		}
+
+	private:
+		coroutine_type m_Handle;
+	};
+
+	template<typename T>
+	inline async_generator<T> detail::async_generator_hpp::promise<T>::get_return_object() noexcept
+	{
+		return async_generator<T>(coro::coroutine_handle<promise<T>>::from_promise(*this));
+	}
+}
+
+#endif
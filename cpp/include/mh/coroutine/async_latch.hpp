@@ -0,0 +1,48 @@
+#pragma once
+
+#include "async_manual_reset_event.hpp"
+
+#ifdef MH_COROUTINES_SUPPORTED
+
+#include <atomic>
+#include <cstddef>
+
+namespace mh
+{
+	// Like std::latch, but co_await co_wait() suspends the coroutine instead of blocking the thread
+	class async_latch final
+	{
+	public:
+		explicit async_latch(std::ptrdiff_t expected) noexcept :
+			m_Count(expected),
+			m_Event(expected <= 0)
+		{
+		}
+
+		async_latch(const async_latch&) = delete;
+		async_latch& operator=(const async_latch&) = delete;
+
+		// Whoever brings the count to zero resumes everyone waiting
+		void count_down(std::ptrdiff_t n = 1)
+		{
+			const std::ptrdiff_t prevCount = m_Count.fetch_sub(n, std::memory_order_acq_rel);
+			if (prevCount > 0 && prevCount <= n)
+				m_Event.set();
+		}
+
+		bool try_wait() const noexcept { return m_Event.is_set(); }
+
+		auto co_wait() const noexcept { return m_Event.co_wait(); }
+		auto co_arrive_and_wait(std::ptrdiff_t n = 1)
+		{
+			count_down(n);
+			return co_wait();
+		}
+
+	private:
+		std::atomic<std::ptrdiff_t> m_Count;
+		async_manual_reset_event m_Event;
+	};
+}
+
+#endif
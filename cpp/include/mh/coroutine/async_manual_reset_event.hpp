@@ -0,0 +1,80 @@
+#pragma once
+
+#include "coroutine_include.hpp"
+
+#ifdef MH_COROUTINES_SUPPORTED
+
+#include <atomic>
+#include <cstdint>
+
+#ifndef MH_STUFF_API
+#define MH_STUFF_API
+#endif
+
+namespace mh
+{
+	class async_manual_reset_event;
+
+	namespace detail::async_manual_reset_event_hpp
+	{
+		class [[nodiscard]] wait_awaiter final
+		{
+		public:
+			explicit wait_awaiter(const async_manual_reset_event& event) noexcept : m_Event(event) {}
+
+			bool await_ready() const noexcept;
+			MH_STUFF_API bool await_suspend(coro::coroutine_handle<> parent) noexcept;
+			constexpr void await_resume() const noexcept {}
+
+		private:
+			friend class mh::async_manual_reset_event;
+
+			const async_manual_reset_event& m_Event;
+			wait_awaiter* m_Next = nullptr;
+			coro::coroutine_handle<> m_Handle;
+		};
+	}
+
+	// co_await co_wait() suspends until the event is set. Stays set (letting everyone straight through)
+	// until reset() is called.
+	class async_manual_reset_event final
+	{
+	public:
+		explicit async_manual_reset_event(bool initiallySet = false) noexcept : m_State(initiallySet ? SET : NOT_SET) {}
+
+		async_manual_reset_event(const async_manual_reset_event&) = delete;
+		async_manual_reset_event& operator=(const async_manual_reset_event&) = delete;
+
+		bool is_set() const noexcept { return m_State.load(std::memory_order_acquire) == SET; }
+
+		// Everyone waiting is resumed (or scheduled on the current executor, if there is one) before this returns
+		MH_STUFF_API void set();
+		// Does nothing if the event isn't set
+		MH_STUFF_API void reset() noexcept;
+
+		detail::async_manual_reset_event_hpp::wait_awaiter co_wait() const noexcept
+		{
+			return detail::async_manual_reset_event_hpp::wait_awaiter(*this);
+		}
+
+	private:
+		friend class detail::async_manual_reset_event_hpp::wait_awaiter;
+
+		static constexpr std::uintptr_t NOT_SET = 0;
+		static constexpr std::uintptr_t SET = 1;
+
+		// NOT_SET, SET, or the most recent wait_awaiter to start waiting on us
+		mutable std::atomic<std::uintptr_t> m_State;
+	};
+
+	inline bool detail::async_manual_reset_event_hpp::wait_awaiter::await_ready() const noexcept
+	{
+		return m_Event.is_set();
+	}
+}
+
+#ifndef MH_COMPILE_LIBRARY
+#include "async_manual_reset_event.inl"
+#endif
+
+#endif
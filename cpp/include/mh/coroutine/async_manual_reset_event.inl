@@ -0,0 +1,66 @@
+#ifdef MH_COMPILE_LIBRARY
+#include "async_manual_reset_event.hpp"
+#endif
+
+#ifndef MH_COMPILE_LIBRARY_INLINE
+#define MH_COMPILE_LIBRARY_INLINE inline
+#endif
+
+#ifdef MH_COROUTINES_SUPPORTED
+
+#include "current_executor.hpp"
+
+namespace mh
+{
+	MH_COMPILE_LIBRARY_INLINE void async_manual_reset_event::set()
+	{
+		const std::uintptr_t prevState = m_State.exchange(SET, std::memory_order_acq_rel);
+		if (prevState == SET || prevState == NOT_SET)
+			return;
+
+		// Waiters are pushed onto the front, so reverse them to wake them up in the order they arrived
+		auto waiter = reinterpret_cast<detail::async_manual_reset_event_hpp::wait_awaiter*>(prevState);
+		detail::async_manual_reset_event_hpp::wait_awaiter* ordered = nullptr;
+		while (waiter)
+		{
+			auto next = waiter->m_Next;
+			waiter->m_Next = ordered;
+			ordered = waiter;
+			waiter = next;
+		}
+
+		while (ordered)
+		{
+			// Once resumed, the awaiter may be gone
+			auto next = ordered->m_Next;
+			detail::current_executor_hpp::schedule_or_resume(ordered->m_Handle);
+			ordered = next;
+		}
+	}
+
+	MH_COMPILE_LIBRARY_INLINE void async_manual_reset_event::reset() noexcept
+	{
+		std::uintptr_t expected = SET;
+		m_State.compare_exchange_strong(expected, NOT_SET, std::memory_order_relaxed);
+	}
+
+	MH_COMPILE_LIBRARY_INLINE bool detail::async_manual_reset_event_hpp::wait_awaiter::await_suspend(coro::coroutine_handle<> parent) noexcept
+	{
+		m_Handle = parent;
+
+		std::uintptr_t state = m_Event.m_State.load(std::memory_order_acquire);
+		do
+		{
+			if (state == async_manual_reset_event::SET)
+				return false;
+
+			m_Next = reinterpret_cast<wait_awaiter*>(state);
+
+		} while (!m_Event.m_State.compare_exchange_weak(state, reinterpret_cast<std::uintptr_t>(this),
+			std::memory_order_release, std::memory_order_acquire));
+
+		return true;
+	}
+}
+
+#endif
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "coroutine_include.hpp"
+
+#ifdef MH_COROUTINES_SUPPORTED
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+
+#ifndef MH_STUFF_API
+#define MH_STUFF_API
+#endif
+
+namespace mh
+{
+	class async_mutex;
+	class async_mutex_lock;
+
+	namespace detail::async_mutex_hpp
+	{
+		class [[nodiscard]] lock_awaiter final
+		{
+		public:
+			explicit lock_awaiter(async_mutex& mutex) noexcept : m_Mutex(mutex) {}
+
+			bool await_ready() noexcept;
+			MH_STUFF_API bool await_suspend(coro::coroutine_handle<> parent) noexcept;
+			async_mutex_lock await_resume() noexcept;
+
+		private:
+			friend class mh::async_mutex;
+
+			async_mutex& m_Mutex;
+			lock_awaiter* m_Next = nullptr;
+			coro::coroutine_handle<> m_Handle;
+		};
+	}
+
+	// A mutex for coroutines. Instead of blocking the thread, co_await co_lock() suspends the coroutine
+	// until the mutex is free, so thread_pool workers can get on with other tasks in the meantime.
+	// Waiters queue up in FIFO order (the queue lives inside the awaiters, so nothing is allocated), and
+	// unlock() hands ownership straight to the next one in line. Not recursive.
+	class async_mutex final
+	{
+	public:
+		async_mutex() noexcept = default;
+		~async_mutex()
+		{
+			assert(m_State.load(std::memory_order_relaxed) == NOT_LOCKED || m_State.load(std::memory_order_relaxed) == LOCKED_NO_WAITERS);
+			assert(!m_Waiters);
+		}
+
+		async_mutex(const async_mutex&) = delete;
+		async_mutex& operator=(const async_mutex&) = delete;
+
+		[[nodiscard]] MH_STUFF_API bool try_lock() noexcept;
+
+		// co_await this to get an mh::async_mutex_lock, which unlocks the mutex when it goes out of scope
+		detail::async_mutex_hpp::lock_awaiter co_lock() noexcept { return detail::async_mutex_hpp::lock_awaiter(*this); }
+
+		// If anyone is waiting, the next one in line now owns the mutex, and is resumed (or scheduled
+		// on the current executor, if there is one)
+		MH_STUFF_API void unlock();
+
+	private:
+		friend class detail::async_mutex_hpp::lock_awaiter;
+
+		static constexpr std::uintptr_t LOCKED_NO_WAITERS = 0;
+		static constexpr std::uintptr_t NOT_LOCKED = 1;
+
+		// NOT_LOCKED, LOCKED_NO_WAITERS, or the most recent lock_awaiter to start waiting on us
+		std::atomic<std::uintptr_t> m_State = NOT_LOCKED;
+
+		// Waiters that have been moved out of m_State, oldest first. Only touched by whoever holds the lock.
+		detail::async_mutex_hpp::lock_awaiter* m_Waiters = nullptr;
+	};
+
+	// Owns a locked mh::async_mutex, like std::unique_lock
+	class [[nodiscard]] async_mutex_lock final
+	{
+	public:
+		async_mutex_lock() noexcept = default;
+		async_mutex_lock(async_mutex& mutex, std::adopt_lock_t) noexcept : m_Mutex(&mutex) {}
+		async_mutex_lock(async_mutex_lock&& other) noexcept : m_Mutex(std::exchange(other.m_Mutex, nullptr)) {}
+		async_mutex_lock& operator=(async_mutex_lock&& other)
+		{
+			if (std::addressof(other) != this)
+			{
+				unlock();
+				m_Mutex = std::exchange(other.m_Mutex, nullptr);
+			}
+
+			return *this;
+		}
+		~async_mutex_lock() { unlock(); }
+
+		bool owns_lock() const noexcept { return !!m_Mutex; }
+		explicit operator bool() const noexcept { return owns_lock(); }
+		async_mutex* mutex() const noexcept { return m_Mutex; }
+
+		void unlock()
+		{
+			if (m_Mutex)
+				std::exchange(m_Mutex, nullptr)->unlock();
+		}
+
+	private:
+		async_mutex* m_Mutex = nullptr;
+	};
+
+	inline bool detail::async_mutex_hpp::lock_awaiter::await_ready() noexcept
+	{
+		return m_Mutex.try_lock();
+	}
+	inline async_mutex_lock detail::async_mutex_hpp::lock_awaiter::await_resume() noexcept
+	{
+		return async_mutex_lock(m_Mutex, std::adopt_lock);
+	}
+}
+
+#ifndef MH_COMPILE_LIBRARY
+#include "async_mutex.inl"
+#endif
+
+#endif
@@ -0,0 +1,82 @@
+#ifdef MH_COMPILE_LIBRARY
+#include "async_mutex.hpp"
+#endif
+
+#ifndef MH_COMPILE_LIBRARY_INLINE
+#define MH_COMPILE_LIBRARY_INLINE inline
+#endif
+
+#ifdef MH_COROUTINES_SUPPORTED
+
+#include "current_executor.hpp"
+
+namespace mh
+{
+	MH_COMPILE_LIBRARY_INLINE bool async_mutex::try_lock() noexcept
+	{
+		std::uintptr_t expected = NOT_LOCKED;
+		return m_State.compare_exchange_strong(expected, LOCKED_NO_WAITERS,
+			std::memory_order_acquire, std::memory_order_relaxed);
+	}
+
+	MH_COMPILE_LIBRARY_INLINE void async_mutex::unlock()
+	{
+		assert(m_State.load(std::memory_order_relaxed) != NOT_LOCKED);
+
+		detail::async_mutex_hpp::lock_awaiter* next = m_Waiters;
+		if (!next)
+		{
+			std::uintptr_t expected = LOCKED_NO_WAITERS;
+			if (m_State.compare_exchange_strong(expected, NOT_LOCKED, std::memory_order_release, std::memory_order_relaxed))
+				return;
+
+			// Someone started waiting since we last looked. Take all of them, they were pushed onto
+			// the front so reverse them to get them in the order they arrived.
+			expected = m_State.exchange(LOCKED_NO_WAITERS, std::memory_order_acquire);
+			auto waiter = reinterpret_cast<detail::async_mutex_hpp::lock_awaiter*>(expected);
+			while (waiter)
+			{
+				auto newer = waiter->m_Next;
+				waiter->m_Next = next;
+				next = waiter;
+				waiter = newer;
+			}
+		}
+
+		assert(next);
+		m_Waiters = next->m_Next;
+
+		// They own the lock now
+		detail::current_executor_hpp::schedule_or_resume(next->m_Handle);
+	}
+
+	MH_COMPILE_LIBRARY_INLINE bool detail::async_mutex_hpp::lock_awaiter::await_suspend(coro::coroutine_handle<> parent) noexcept
+	{
+		m_Handle = parent;
+
+		std::uintptr_t state = m_Mutex.m_State.load(std::memory_order_relaxed);
+		while (true)
+		{
+			if (state == async_mutex::NOT_LOCKED)
+			{
+				// Unlocked while we were getting ready to wait
+				if (m_Mutex.m_State.compare_exchange_weak(state, async_mutex::LOCKED_NO_WAITERS,
+					std::memory_order_acquire, std::memory_order_relaxed))
+				{
+					return false;
+				}
+			}
+			else
+			{
+				m_Next = reinterpret_cast<lock_awaiter*>(state);
+				if (m_Mutex.m_State.compare_exchange_weak(state, reinterpret_cast<std::uintptr_t>(this),
+					std::memory_order_release, std::memory_order_relaxed))
+				{
+					return true;
+				}
+			}
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "coroutine_include.hpp"
+
+#ifdef MH_COROUTINES_SUPPORTED
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+
+#ifndef MH_STUFF_API
+#define MH_STUFF_API
+#endif
+
+namespace mh
+{
+	class async_semaphore;
+
+	namespace detail::async_semaphore_hpp
+	{
+		class [[nodiscard]] acquire_awaiter final
+		{
+		public:
+			explicit acquire_awaiter(async_semaphore& semaphore) noexcept : m_Semaphore(semaphore) {}
+
+			bool await_ready() noexcept;
+			MH_STUFF_API bool await_suspend(coro::coroutine_handle<> parent);
+			constexpr void await_resume() const noexcept {}
+
+		private:
+			friend class mh::async_semaphore;
+
+			async_semaphore& m_Semaphore;
+			acquire_awaiter* m_Next = nullptr;
+			coro::coroutine_handle<> m_Handle;
+		};
+	}
+
+	// A counting semaphore for coroutines, co_await co_acquire() suspends until a permit is available
+	// instead of blocking the thread. Acquiring and releasing are a single atomic operation as long as
+	// nobody has to wait. Waiters are woken up in FIFO order.
+	class async_semaphore final
+	{
+	public:
+		explicit async_semaphore(std::ptrdiff_t initialCount = 0) noexcept : m_Count(initialCount) {}
+
+		async_semaphore(const async_semaphore&) = delete;
+		async_semaphore& operator=(const async_semaphore&) = delete;
+
+		[[nodiscard]] MH_STUFF_API bool try_acquire() noexcept;
+		detail::async_semaphore_hpp::acquire_awaiter co_acquire() noexcept { return detail::async_semaphore_hpp::acquire_awaiter(*this); }
+
+		// Waiters are resumed (or scheduled on the current executor, if there is one) before this returns
+		MH_STUFF_API void release(std::ptrdiff_t count = 1);
+
+		std::ptrdiff_t available() const noexcept { return (std::max)(m_Count.load(std::memory_order_relaxed), std::ptrdiff_t(0)); }
+
+	private:
+		friend class detail::async_semaphore_hpp::acquire_awaiter;
+
+		// Permits available or, when negative, the number of coroutines that missed out on one
+		std::atomic<std::ptrdiff_t> m_Count;
+
+		// Only needed once someone has to wait
+		std::mutex m_WaitersMutex;
+		detail::async_semaphore_hpp::acquire_awaiter* m_WaitersHead = nullptr;
+		detail::async_semaphore_hpp::acquire_awaiter* m_WaitersTail = nullptr;
+
+		// Permits released for coroutines that missed out on the fast path, but haven't made it into
+		// the queue yet. They take one of these instead of suspending.
+		std::ptrdiff_t m_UnclaimedCount = 0;
+	};
+
+	// Missing out here means we are committed to waiting, await_suspend() takes care of the rest
+	inline bool detail::async_semaphore_hpp::acquire_awaiter::await_ready() noexcept
+	{
+		return m_Semaphore.m_Count.fetch_sub(1, std::memory_order_acquire) > 0;
+	}
+}
+
+#ifndef MH_COMPILE_LIBRARY
+#include "async_semaphore.inl"
+#endif
+
+#endif
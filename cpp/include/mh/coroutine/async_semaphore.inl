@@ -0,0 +1,90 @@
+#ifdef MH_COMPILE_LIBRARY
+#include "async_semaphore.hpp"
+#endif
+
+#ifndef MH_COMPILE_LIBRARY_INLINE
+#define MH_COMPILE_LIBRARY_INLINE inline
+#endif
+
+#ifdef MH_COROUTINES_SUPPORTED
+
+#include "current_executor.hpp"
+
+namespace mh
+{
+	MH_COMPILE_LIBRARY_INLINE bool async_semaphore::try_acquire() noexcept
+	{
+		std::ptrdiff_t count = m_Count.load(std::memory_order_relaxed);
+		while (count > 0)
+		{
+			if (m_Count.compare_exchange_weak(count, count - 1, std::memory_order_acquire, std::memory_order_relaxed))
+				return true;
+		}
+
+		return false;
+	}
+
+	MH_COMPILE_LIBRARY_INLINE void async_semaphore::release(std::ptrdiff_t count)
+	{
+		if (count < 1)
+			return;
+
+		const std::ptrdiff_t prevCount = m_Count.fetch_add(count, std::memory_order_release);
+		if (prevCount >= 0)
+			return; // Nobody waiting
+
+		std::ptrdiff_t wakeCount = (std::min)(count, -prevCount);
+		detail::async_semaphore_hpp::acquire_awaiter* wake = nullptr;
+
+		{
+			std::lock_guard lock(m_WaitersMutex);
+			if (m_WaitersHead)
+			{
+				wake = m_WaitersHead;
+
+				detail::async_semaphore_hpp::acquire_awaiter* last = wake;
+				for (--wakeCount; wakeCount > 0 && last->m_Next; --wakeCount)
+					last = last->m_Next;
+
+				m_WaitersHead = last->m_Next;
+				if (!m_WaitersHead)
+					m_WaitersTail = nullptr;
+
+				last->m_Next = nullptr;
+			}
+
+			m_UnclaimedCount += wakeCount;
+		}
+
+		while (wake)
+		{
+			// Once resumed, the awaiter may be gone
+			auto next = wake->m_Next;
+			detail::current_executor_hpp::schedule_or_resume(wake->m_Handle);
+			wake = next;
+		}
+	}
+
+	MH_COMPILE_LIBRARY_INLINE bool detail::async_semaphore_hpp::acquire_awaiter::await_suspend(coro::coroutine_handle<> parent)
+	{
+		m_Handle = parent;
+
+		std::lock_guard lock(m_Semaphore.m_WaitersMutex);
+		if (m_Semaphore.m_UnclaimedCount > 0)
+		{
+			// Released while we were on our way here
+			m_Semaphore.m_UnclaimedCount--;
+			return false;
+		}
+
+		if (m_Semaphore.m_WaitersTail)
+			m_Semaphore.m_WaitersTail->m_Next = this;
+		else
+			m_Semaphore.m_WaitersHead = this;
+
+		m_Semaphore.m_WaitersTail = this;
+		return true;
+	}
+}
+
+#endif
@@ -0,0 +1,275 @@
+#pragma once
+
+#include "coroutine_include.hpp"
+
+#ifdef MH_COROUTINES_SUPPORTED
+
+#include "../concurrency/futex.hpp"
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <exception>
+#include <type_traits>
+#include <utility>
+
+namespace mh
+{
+	// Thrown by cancellation-aware awaitables (dispatcher delays, thread pool submissions, ...) when
+	// the task awaiting them has been cancelled, see mh::task::request_cancel()
+	class task_cancelled : public std::exception
+	{
+	public:
+		const char* what() const noexcept override { return "mh::task was cancelled"; }
+	};
+
+	namespace detail::cancellation_hpp
+	{
+		// Registered by whatever a cancellable coroutine is currently suspended on, so that cancelling the
+		// coroutine can cut the wait short. Like task_hpp::waiter_node, it lives inside the awaiter.
+		struct cancel_callback
+		{
+			// Called at most once, on whichever thread requested cancellation. It may resume the awaiting
+			// coroutine inline, but mustn't touch the callback again after doing so.
+			void (*m_OnCancel)(cancel_callback& callback) noexcept = nullptr;
+
+			std::atomic_bool m_IsFinished = false; // Owned by cancellation_state
+		};
+
+		// The callbacks currently being called by request_cancel() on this thread (innermost first), so a
+		// coroutine resumed from inside its own callback doesn't wait for that callback to finish
+		struct running_callback
+		{
+			cancel_callback* m_Callback = nullptr;
+			running_callback* m_Prev = nullptr;
+			bool m_IsUnregistered = false;
+		};
+		inline thread_local running_callback* s_RunningCallbacks = nullptr;
+
+		// The std::stop_source-style part of a promise. Cancellation is cooperative: requesting it just
+		// sets a flag, and notifies whatever the coroutine is currently suspended on (if that happens to
+		// be something that cares).
+		class cancellation_state
+		{
+		public:
+			bool is_cancel_requested() const noexcept
+			{
+				return m_CancelState.load(std::memory_order_acquire) == CANCEL_REQUESTED;
+			}
+
+			// Returns false if cancellation had already been requested
+			bool request_cancel() const noexcept
+			{
+				const std::uintptr_t prev = m_CancelState.exchange(CANCEL_REQUESTED, std::memory_order_acq_rel);
+				if (prev == CANCEL_REQUESTED)
+					return false;
+
+				if (prev != CANCEL_NONE)
+				{
+					auto callback = reinterpret_cast<cancel_callback*>(prev);
+					running_callback running{ callback, s_RunningCallbacks };
+					s_RunningCallbacks = &running;
+					callback->m_OnCancel(*callback);
+					s_RunningCallbacks = running.m_Prev;
+
+					// Otherwise, it was unregistered from inside the callback and may well be gone
+					if (!running.m_IsUnregistered)
+						callback->m_IsFinished.store(true, std::memory_order_release);
+				}
+
+				return true;
+			}
+
+			// Returns false (without registering the callback) if cancellation has already been requested.
+			// Either way, unregister_callback() must be called before the callback is destroyed.
+			bool try_register_callback(cancel_callback& callback) const noexcept
+			{
+				assert(callback.m_OnCancel);
+
+				std::uintptr_t expected = CANCEL_NONE;
+				if (m_CancelState.compare_exchange_strong(expected, reinterpret_cast<std::uintptr_t>(&callback),
+					std::memory_order_acq_rel, std::memory_order_acquire))
+				{
+					return true;
+				}
+
+				// A coroutine can only be suspended on one thing at a time
+				assert(expected == CANCEL_REQUESTED);
+				callback.m_IsFinished.store(true, std::memory_order_relaxed); // Never going to be called
+				return false;
+			}
+
+			// Once this returns, the callback is not running and never will be
+			void unregister_callback(cancel_callback& callback) const noexcept
+			{
+				std::uintptr_t expected = reinterpret_cast<std::uintptr_t>(&callback);
+				if (m_CancelState.compare_exchange_strong(expected, CANCEL_NONE, std::memory_order_acq_rel, std::memory_order_acquire))
+					return;
+
+				// Resumed from inside our own callback
+				for (running_callback* running = s_RunningCallbacks; running; running = running->m_Prev)
+				{
+					if (running->m_Callback == &callback)
+					{
+						running->m_IsUnregistered = true;
+						return;
+					}
+				}
+
+				// Cancellation got to it first, it won't be long
+				while (!callback.m_IsFinished.load(std::memory_order_acquire))
+					mh::cpu_relax();
+			}
+
+		private:
+			static constexpr std::uintptr_t CANCEL_NONE = 0;
+			static constexpr std::uintptr_t CANCEL_REQUESTED = 1;
+
+			// CANCEL_NONE, CANCEL_REQUESTED, or the cancel_callback of whatever we are suspended on
+			mutable std::atomic<std::uintptr_t> m_CancelState = CANCEL_NONE;
+		};
+
+		template<typename TPromise>
+		inline constexpr bool is_cancellable_v = std::is_base_of_v<cancellation_state, TPromise>;
+
+		// Wraps another awaitable, calling a function if the awaiting coroutine is cancelled while it is
+		// suspended on it. For things like when_all() that need to pass cancellation on to their children.
+		template<typename TAwaitable, typename TFunc>
+		class forward_cancel_awaiter final : cancel_callback
+		{
+		public:
+			forward_cancel_awaiter(TAwaitable& awaitable, TFunc func) :
+				m_Awaitable(awaitable), m_Func(std::move(func))
+			{
+				m_OnCancel = &on_cancel;
+			}
+
+			bool await_ready() { return m_Awaitable.await_ready(); }
+
+			template<typename TPromise>
+			bool await_suspend(coro::coroutine_handle<TPromise> parent)
+			{
+				if constexpr (is_cancellable_v<TPromise>)
+				{
+					m_CancelState = &parent.promise();
+					if (!m_CancelState->try_register_callback(*this))
+						m_Func();
+				}
+
+				if (m_Awaitable.await_suspend(parent))
+					return true;
+
+				unregister();
+				return false;
+			}
+
+			decltype(auto) await_resume()
+			{
+				unregister();
+				return m_Awaitable.await_resume();
+			}
+
+		private:
+			void unregister() noexcept
+			{
+				if (m_CancelState)
+					std::exchange(m_CancelState, nullptr)->unregister_callback(*this);
+			}
+
+			static void on_cancel(cancel_callback& callback) noexcept
+			{
+				static_cast<forward_cancel_awaiter&>(callback).m_Func();
+			}
+
+			TAwaitable& m_Awaitable;
+			TFunc m_Func;
+			const cancellation_state* m_CancelState = nullptr;
+		};
+
+		template<typename TAwaitable, typename TFunc>
+		forward_cancel_awaiter<TAwaitable, TFunc> forward_cancel(TAwaitable& awaitable, TFunc func)
+		{
+			return forward_cancel_awaiter<TAwaitable, TFunc>(awaitable, std::move(func));
+		}
+
+		// For awaiters that start or wait on something cancellable of their own (a child coroutine's
+		// promise, a task): while registered, cancelling the awaiting coroutine cancels the target too.
+		// TTarget is anything with a request_cancel() const noexcept.
+		template<typename TTarget>
+		class cancel_forwarder final : cancel_callback
+		{
+		public:
+			cancel_forwarder() noexcept { m_OnCancel = &on_cancel; }
+			cancel_forwarder(const cancel_forwarder&) = delete;
+			cancel_forwarder& operator=(const cancel_forwarder&) = delete;
+			~cancel_forwarder() { assert(!m_ParentCancelState); } // Still registered
+
+			// Does nothing if the awaiting coroutine isn't cancellable
+			template<typename TPromise>
+			void start(coro::coroutine_handle<TPromise> parent, const TTarget& target) noexcept
+			{
+				if constexpr (is_cancellable_v<TPromise>)
+				{
+					m_Target = &target;
+					m_ParentCancelState = &parent.promise();
+					if (!m_ParentCancelState->try_register_callback(*this))
+						target.request_cancel();
+				}
+			}
+
+			// Must be called before the awaiting coroutine carries on (in await_resume(), or when not
+			// suspending after all)
+			void stop() noexcept
+			{
+				if (m_ParentCancelState)
+					std::exchange(m_ParentCancelState, nullptr)->unregister_callback(*this);
+			}
+
+		private:
+			static void on_cancel(cancel_callback& callback) noexcept
+			{
+				static_cast<cancel_forwarder&>(callback).m_Target->request_cancel();
+			}
+
+			const TTarget* m_Target = nullptr;
+			const cancellation_state* m_ParentCancelState = nullptr;
+		};
+
+		// Never actually suspends, just peeks at the awaiting coroutine's promise
+		template<bool THROW>
+		struct check_cancel_awaiter final
+		{
+			constexpr bool await_ready() const noexcept { return false; }
+
+			template<typename TPromise>
+			bool await_suspend(coro::coroutine_handle<TPromise> parent) noexcept
+			{
+				static_assert(is_cancellable_v<TPromise>, "Only mh::task coroutines can be cancelled");
+				m_IsCancelRequested = parent.promise().is_cancel_requested();
+				return false;
+			}
+
+			auto await_resume() const
+			{
+				if constexpr (THROW)
+				{
+					if (m_IsCancelRequested)
+						throw task_cancelled();
+				}
+				else
+				{
+					return m_IsCancelRequested;
+				}
+			}
+
+			bool m_IsCancelRequested = false;
+		};
+	}
+
+	// co_await these from inside an mh::task coroutine to check if it has been cancelled, for long
+	// stretches of work that don't otherwise await anything cancellation-aware
+	inline detail::cancellation_hpp::check_cancel_awaiter<false> co_is_cancel_requested() noexcept { return {}; }
+	inline detail::cancellation_hpp::check_cancel_awaiter<true> co_throw_if_cancelled() noexcept { return {}; }
+}
+
+#endif
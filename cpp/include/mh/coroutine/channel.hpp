@@ -0,0 +1,579 @@
+#pragma once
+
+#include "coroutine_include.hpp"
+
+#ifdef MH_COROUTINES_SUPPORTED
+
+#include "cancellation.hpp"
+#include "current_executor.hpp"
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+namespace mh
+{
+	template<typename T> class channel;
+
+	namespace detail::channel_hpp
+	{
+		// Bounded lock-free MPMC queue (Vyukov's). Each cell's sequence number says whose turn it is: even
+		// values are waiting for a push at position seq / 2, odd values for a pop at position seq / 2.
+		template<typename T>
+		class ring_buffer final
+		{
+		public:
+			explicit ring_buffer(std::size_t capacity) :
+				m_Capacity(capacity),
+				m_Cells(std::make_unique<cell[]>(capacity))
+			{
+				for (std::size_t i = 0; i < capacity; i++)
+					m_Cells[i].m_Sequence.store(i * 2, std::memory_order_relaxed);
+			}
+			~ring_buffer()
+			{
+				std::optional<T> discard;
+				while (try_pop(discard))
+					discard.reset();
+			}
+
+			ring_buffer(const ring_buffer&) = delete;
+			ring_buffer& operator=(const ring_buffer&) = delete;
+
+			std::size_t capacity() const noexcept { return m_Capacity; }
+
+			// Value is only moved from on success
+			template<typename TValue>
+			bool try_push(TValue&& value)
+			{
+				std::size_t pos = m_PushPos.load(std::memory_order_relaxed);
+				cell* c;
+				while (true)
+				{
+					c = &m_Cells[pos % m_Capacity];
+					const auto diff = std::intptr_t(c->m_Sequence.load(std::memory_order_acquire)) - std::intptr_t(pos * 2);
+					if (diff == 0)
+					{
+						if (m_PushPos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+							break;
+					}
+					else if (diff < 0)
+					{
+						return false; // Full
+					}
+					else
+					{
+						pos = m_PushPos.load(std::memory_order_relaxed);
+					}
+				}
+
+				::new (c->m_Storage) T(std::forward<TValue>(value));
+				c->m_Sequence.store(pos * 2 + 1, std::memory_order_release);
+				return true;
+			}
+
+			bool try_pop(std::optional<T>& value)
+			{
+				std::size_t pos = m_PopPos.load(std::memory_order_relaxed);
+				cell* c;
+				while (true)
+				{
+					c = &m_Cells[pos % m_Capacity];
+					const auto diff = std::intptr_t(c->m_Sequence.load(std::memory_order_acquire)) - std::intptr_t(pos * 2 + 1);
+					if (diff == 0)
+					{
+						if (m_PopPos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+							break;
+					}
+					else if (diff < 0)
+					{
+						return false; // Empty
+					}
+					else
+					{
+						pos = m_PopPos.load(std::memory_order_relaxed);
+					}
+				}
+
+				T* stored = std::launder(reinterpret_cast<T*>(c->m_Storage));
+				value.emplace(std::move(*stored));
+				std::destroy_at(stored);
+				c->m_Sequence.store((pos + m_Capacity) * 2, std::memory_order_release);
+				return true;
+			}
+
+		private:
+			struct cell
+			{
+				std::atomic_size_t m_Sequence;
+				alignas(T) std::byte m_Storage[sizeof(T)];
+			};
+
+			const std::size_t m_Capacity;
+			std::unique_ptr<cell[]> m_Cells;
+
+			// Kept apart so producers and consumers aren't fighting over the same cache line
+			alignas(64) std::atomic_size_t m_PushPos = 0;
+			alignas(64) std::atomic_size_t m_PopPos = 0;
+		};
+
+		enum class wait_result : std::uint8_t
+		{
+			waiting,
+			done,
+			closed,
+			cancelled,
+		};
+
+		// Intrusive, doubly linked so cancelled waiters can leave from the middle of the queue
+		struct waiter : cancellation_hpp::cancel_callback
+		{
+			waiter* m_Prev = nullptr;
+			waiter* m_Next = nullptr;
+			coro::coroutine_handle<> m_Handle;
+			wait_result m_Result = wait_result::waiting;
+			bool m_IsQueued = false;
+			const cancellation_hpp::cancellation_state* m_CancelState = nullptr;
+
+			void unregister_cancel_callback() noexcept
+			{
+				if (m_CancelState)
+					std::exchange(m_CancelState, nullptr)->unregister_callback(*this);
+			}
+		};
+
+		class waiter_list final
+		{
+		public:
+			bool empty() const noexcept { return !m_Head; }
+			waiter& front() const noexcept { return *m_Head; }
+
+			void push_back(waiter& w) noexcept
+			{
+				w.m_Prev = m_Tail;
+				w.m_Next = nullptr;
+				(m_Tail ? m_Tail->m_Next : m_Head) = &w;
+				m_Tail = &w;
+				w.m_IsQueued = true;
+			}
+			void remove(waiter& w) noexcept
+			{
+				(w.m_Prev ? w.m_Prev->m_Next : m_Head) = w.m_Next;
+				(w.m_Next ? w.m_Next->m_Prev : m_Tail) = w.m_Prev;
+				w.m_Prev = w.m_Next = nullptr;
+				w.m_IsQueued = false;
+			}
+
+		private:
+			waiter* m_Head = nullptr;
+			waiter* m_Tail = nullptr;
+		};
+
+		template<typename T>
+		class [[nodiscard]] send_awaiter final : waiter
+		{
+		public:
+			send_awaiter(channel<T>& ch, T value) : m_Channel(ch), m_Value(std::move(value))
+			{
+				m_OnCancel = &on_cancelled;
+			}
+
+			bool await_ready()
+			{
+				m_Result = m_Channel.try_push_open(std::move(m_Value));
+				return m_Result != wait_result::waiting;
+			}
+			bool await_suspend(coro::coroutine_handle<> parent) { return m_Channel.wait_send(*this, parent); }
+			template<typename TPromise>
+			bool await_suspend(coro::coroutine_handle<TPromise> parent)
+			{
+				if constexpr (cancellation_hpp::is_cancellable_v<TPromise>)
+				{
+					m_CancelState = &parent.promise();
+					if (!m_CancelState->try_register_callback(*this))
+					{
+						m_Result = wait_result::cancelled;
+						return false;
+					}
+				}
+
+				return await_suspend(coro::coroutine_handle<>(parent));
+			}
+
+			// Returns false if the channel was closed
+			bool await_resume()
+			{
+				unregister_cancel_callback();
+				if (m_Result == wait_result::cancelled)
+					throw task_cancelled();
+
+				return m_Result == wait_result::done;
+			}
+
+		private:
+			friend class channel<T>;
+
+			static void on_cancelled(cancellation_hpp::cancel_callback& callback) noexcept
+			{
+				auto& self = static_cast<send_awaiter&>(callback);
+				if (self.m_Channel.cancel_wait(self, self.m_Channel.m_Senders))
+					current_executor_hpp::schedule_or_resume(self.m_Handle);
+			}
+
+			channel<T>& m_Channel;
+			T m_Value;
+		};
+
+		template<typename T>
+		class [[nodiscard]] receive_awaiter final : waiter
+		{
+		public:
+			explicit receive_awaiter(channel<T>& ch) noexcept : m_Channel(ch)
+			{
+				m_OnCancel = &on_cancelled;
+			}
+
+			bool await_ready()
+			{
+				if (!m_Channel.m_Buffer.try_pop(m_Value))
+					return false;
+
+				m_Channel.on_popped();
+				m_Result = wait_result::done;
+				return true;
+			}
+			bool await_suspend(coro::coroutine_handle<> parent) { return m_Channel.wait_receive(*this, parent); }
+			template<typename TPromise>
+			bool await_suspend(coro::coroutine_handle<TPromise> parent)
+			{
+				if constexpr (cancellation_hpp::is_cancellable_v<TPromise>)
+				{
+					m_CancelState = &parent.promise();
+					if (!m_CancelState->try_register_callback(*this))
+					{
+						m_Result = wait_result::cancelled;
+						return false;
+					}
+				}
+
+				return await_suspend(coro::coroutine_handle<>(parent));
+			}
+
+			// Empty once the channel has been closed, and everything sent before that has been received
+			std::optional<T> await_resume()
+			{
+				unregister_cancel_callback();
+				if (m_Result == wait_result::cancelled)
+					throw task_cancelled();
+
+				return std::move(m_Value);
+			}
+
+		private:
+			friend class channel<T>;
+
+			static void on_cancelled(cancellation_hpp::cancel_callback& callback) noexcept
+			{
+				auto& self = static_cast<receive_awaiter&>(callback);
+				if (self.m_Channel.cancel_wait(self, self.m_Channel.m_Receivers))
+					current_executor_hpp::schedule_or_resume(self.m_Handle);
+			}
+
+			channel<T>& m_Channel;
+			std::optional<T> m_Value;
+		};
+	}
+
+	// A bounded multi-producer, multi-consumer queue for passing values between coroutines.
+	// co_await co_send() suspends while the channel is full, and co_await co_receive() suspends
+	// while it is empty. Sending and receiving are lock-free unless someone has to wait.
+	//
+	// Waiting senders and receivers are woken up in FIFO order, resumed (or scheduled on the current
+	// executor, if there is one) by whoever made room or sent a value. Waiting is cancellation-aware,
+	// see mh::task::request_cancel().
+	template<typename T>
+	class channel final
+	{
+	public:
+		explicit channel(std::size_t capacity) :
+			m_Buffer(capacity > 0 ? capacity : throw std::invalid_argument("channel capacity must be >= 1"))
+		{
+		}
+		~channel()
+		{
+			assert(m_Senders.empty());
+			assert(m_Receivers.empty());
+		}
+
+		channel(const channel&) = delete;
+		channel& operator=(const channel&) = delete;
+
+		std::size_t capacity() const noexcept { return m_Buffer.capacity(); }
+
+		// co_await to send a value, resumes with false if the channel is (or gets) closed before there is room
+		detail::channel_hpp::send_awaiter<T> co_send(T value) { return detail::channel_hpp::send_awaiter<T>(*this, std::move(value)); }
+		// co_await to receive a value, resumes with std::nullopt once the channel is closed and empty
+		detail::channel_hpp::receive_awaiter<T> co_receive() noexcept { return detail::channel_hpp::receive_awaiter<T>(*this); }
+
+		// Never waits. The value is only moved from if it was sent.
+		template<typename TValue, typename = std::enable_if_t<std::is_constructible_v<T, TValue&&>>>
+		[[nodiscard]] bool try_send(TValue&& value)
+		{
+			return try_push_open(std::forward<TValue>(value)) == detail::channel_hpp::wait_result::done;
+		}
+		[[nodiscard]] std::optional<T> try_receive()
+		{
+			std::optional<T> value;
+			if (m_Buffer.try_pop(value))
+				on_popped();
+
+			return value;
+		}
+
+		// Anything already sent can still be received. Everyone waiting to send gets false, and receivers
+		// get std::nullopt once there is nothing left.
+		void close()
+		{
+			detail::channel_hpp::waiter* wake = nullptr;
+
+			{
+				std::lock_guard lock(m_WaitersMutex);
+				if (m_SendGate.fetch_or(SEND_GATE_CLOSED, std::memory_order_acq_rel) & SEND_GATE_CLOSED)
+					return;
+
+				// Lock-free sends that got in before us are allowed to finish, so their values are in the
+				// buffer before any receiver is told the channel is closed
+				while (m_SendGate.load(std::memory_order_acquire) != SEND_GATE_CLOSED)
+					std::this_thread::yield();
+
+				m_IsClosed.store(true, std::memory_order_release);
+				pump(wake);
+
+				while (!m_Senders.empty())
+					finish_waiter(m_Senders, m_WaitingSenders, m_Senders.front(), detail::channel_hpp::wait_result::closed, wake);
+				while (!m_Receivers.empty())
+					finish_waiter(m_Receivers, m_WaitingReceivers, m_Receivers.front(), detail::channel_hpp::wait_result::closed, wake);
+			}
+
+			resume_all(wake);
+		}
+		bool is_closed() const noexcept { return m_IsClosed.load(std::memory_order_acquire); }
+
+	private:
+		friend class detail::channel_hpp::send_awaiter<T>;
+		friend class detail::channel_hpp::receive_awaiter<T>;
+		using waiter = detail::channel_hpp::waiter;
+		using wait_result = detail::channel_hpp::wait_result;
+
+		static constexpr std::size_t SEND_GATE_CLOSED = 1;
+		static constexpr std::size_t SEND_GATE_SENDER = 2;
+
+		// Pushes without taking the lock, unless close() has started. Returns waiting if the buffer is full.
+		template<typename TValue>
+		wait_result try_push_open(TValue&& value)
+		{
+			if (m_SendGate.fetch_add(SEND_GATE_SENDER, std::memory_order_acq_rel) & SEND_GATE_CLOSED)
+			{
+				m_SendGate.fetch_sub(SEND_GATE_SENDER, std::memory_order_release);
+				return wait_result::closed;
+			}
+
+			bool pushed;
+			try
+			{
+				pushed = m_Buffer.try_push(std::forward<TValue>(value));
+			}
+			catch (...)
+			{
+				m_SendGate.fetch_sub(SEND_GATE_SENDER, std::memory_order_release);
+				throw;
+			}
+
+			m_SendGate.fetch_sub(SEND_GATE_SENDER, std::memory_order_release);
+			if (!pushed)
+				return wait_result::waiting;
+
+			on_pushed();
+			return wait_result::done;
+		}
+
+		// Someone waiting on the other side either counted themselves before checking the buffer
+		// one last time (and saw our change), or we see them here
+		void on_pushed()
+		{
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (m_WaitingReceivers.load(std::memory_order_relaxed) > 0)
+				wake_waiters();
+		}
+		void on_popped()
+		{
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (m_WaitingSenders.load(std::memory_order_relaxed) > 0)
+				wake_waiters();
+		}
+
+		void wake_waiters()
+		{
+			waiter* wake = nullptr;
+
+			{
+				std::lock_guard lock(m_WaitersMutex);
+				pump(wake);
+			}
+
+			resume_all(wake);
+		}
+
+		// Moves values between the buffer and whoever is waiting for as long as it can. Waiters that
+		// are done are added to wake, for resuming once the lock has been released.
+		void pump(waiter*& wake)
+		{
+			bool progress = true;
+			while (progress)
+			{
+				progress = false;
+
+				while (!m_Receivers.empty())
+				{
+					auto& receiver = static_cast<detail::channel_hpp::receive_awaiter<T>&>(m_Receivers.front());
+					if (!m_Buffer.try_pop(receiver.m_Value))
+						break;
+
+					finish_waiter(m_Receivers, m_WaitingReceivers, receiver, wait_result::done, wake);
+					progress = true;
+				}
+
+				while (!m_Senders.empty())
+				{
+					auto& sender = static_cast<detail::channel_hpp::send_awaiter<T>&>(m_Senders.front());
+					if (!m_Buffer.try_push(std::move(sender.m_Value)))
+						break;
+
+					finish_waiter(m_Senders, m_WaitingSenders, sender, wait_result::done, wake);
+					progress = true;
+				}
+			}
+		}
+
+		void finish_waiter(detail::channel_hpp::waiter_list& list, std::atomic_size_t& waitingCount,
+			waiter& w, wait_result result, waiter*& wake)
+		{
+			list.remove(w);
+			waitingCount.fetch_sub(1, std::memory_order_relaxed);
+			w.m_Result = result;
+			w.m_Next = wake;
+			wake = &w;
+		}
+
+		static void resume_all(waiter* wake)
+		{
+			// The list is newest first, so flip it around to resume them in the order they were queued
+			waiter* ordered = nullptr;
+			while (wake)
+			{
+				waiter* next = wake->m_Next;
+				wake->m_Next = ordered;
+				ordered = wake;
+				wake = next;
+			}
+
+			while (ordered)
+			{
+				// Once resumed, the waiter may be gone
+				waiter* next = ordered->m_Next;
+				detail::current_executor_hpp::schedule_or_resume(ordered->m_Handle);
+				ordered = next;
+			}
+		}
+
+		// Returns false if we got what we were waiting for after all
+		template<typename TTryFunc>
+		bool wait(waiter& w, detail::coro::coroutine_handle<> parent, detail::channel_hpp::waiter_list& list,
+			std::atomic_size_t& waitingCount, TTryFunc&& tryFunc)
+		{
+			w.m_Handle = parent;
+
+			std::lock_guard lock(m_WaitersMutex);
+			waitingCount.fetch_add(1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+
+			if (tryFunc())
+				w.m_Result = wait_result::done;
+			else if (is_closed())
+				w.m_Result = wait_result::closed;
+			else if (w.m_CancelState && w.m_CancelState->is_cancel_requested())
+				w.m_Result = wait_result::cancelled; // Checked under the lock so cancel_wait() can't miss us
+			else
+			{
+				list.push_back(w);
+				return true;
+			}
+
+			waitingCount.fetch_sub(1, std::memory_order_relaxed);
+			return false;
+		}
+
+		bool wait_send(detail::channel_hpp::send_awaiter<T>& sender, detail::coro::coroutine_handle<> parent)
+		{
+			// Holding the lock keeps close() out, so there's no need to go through the send gate here
+			const auto tryFunc = [&] { return !is_closed() && m_Buffer.try_push(std::move(sender.m_Value)); };
+			if (wait(sender, parent, m_Senders, m_WaitingSenders, tryFunc))
+				return true;
+
+			if (sender.m_Result == wait_result::done)
+				on_pushed();
+
+			return false;
+		}
+		bool wait_receive(detail::channel_hpp::receive_awaiter<T>& receiver, detail::coro::coroutine_handle<> parent)
+		{
+			if (wait(receiver, parent, m_Receivers, m_WaitingReceivers, [&] { return m_Buffer.try_pop(receiver.m_Value); }))
+				return true;
+
+			if (receiver.m_Result == wait_result::done)
+				on_popped();
+
+			return false;
+		}
+
+		// Returns true if the waiter was removed, and should be resumed. If it hasn't been queued yet,
+		// wait() will notice the cancellation itself.
+		bool cancel_wait(waiter& w, detail::channel_hpp::waiter_list& list)
+		{
+			std::lock_guard lock(m_WaitersMutex);
+			if (!w.m_IsQueued)
+				return false;
+
+			list.remove(w);
+			(&list == &m_Senders ? m_WaitingSenders : m_WaitingReceivers).fetch_sub(1, std::memory_order_relaxed);
+			w.m_Result = wait_result::cancelled;
+			return true;
+		}
+
+		detail::channel_hpp::ring_buffer<T> m_Buffer;
+
+		// SEND_GATE_CLOSED once close() has started, plus SEND_GATE_SENDER for every lock-free push in progress.
+		// m_IsClosed is only set once those pushes have finished.
+		std::atomic_size_t m_SendGate = 0;
+		std::atomic_bool m_IsClosed = false;
+
+		// Waiters, plus anyone about to become one
+		std::atomic_size_t m_WaitingSenders = 0;
+		std::atomic_size_t m_WaitingReceivers = 0;
+
+		std::mutex m_WaitersMutex;
+		detail::channel_hpp::waiter_list m_Senders;
+		detail::channel_hpp::waiter_list m_Receivers;
+	};
+}
+
+#endif
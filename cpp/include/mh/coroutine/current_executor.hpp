@@ -0,0 +1,70 @@
+#pragma once
+
+#include "coroutine_include.hpp"
+
+#ifdef MH_COROUTINES_SUPPORTED
+
+namespace mh::detail::current_executor_hpp
+{
+	// Whatever is currently running coroutines on this thread (for example, mh::dispatcher::run_one()).
+	// Lets code that has more than one coroutine to resume hand the extras back to the executor,
+	// rather than resuming them recursively on top of the current stack.
+	struct current_executor
+	{
+		void* m_Executor = nullptr;
+		void (*m_Schedule)(void* executor, coro::coroutine_handle<> handle) = nullptr;
+	};
+
+	inline thread_local current_executor s_CurrentExecutor;
+
+	class current_executor_scope final
+	{
+	public:
+		current_executor_scope(void* executor, void (*scheduleFunc)(void*, coro::coroutine_handle<>)) noexcept :
+			m_Previous(s_CurrentExecutor)
+		{
+			s_CurrentExecutor = { executor, scheduleFunc };
+		}
+		~current_executor_scope()
+		{
+			s_CurrentExecutor = m_Previous;
+		}
+
+		current_executor_scope(const current_executor_scope&) = delete;
+		current_executor_scope& operator=(const current_executor_scope&) = delete;
+
+	private:
+		current_executor m_Previous;
+	};
+
+	// Returns false if there is no executor on this thread, or it couldn't take the coroutine (queueing
+	// it can throw std::bad_alloc). Called while finishing a coroutine, where there is nowhere to throw
+	// to, so the caller is left to resume it on the current thread instead.
+	inline bool try_schedule(coro::coroutine_handle<> handle) noexcept
+	{
+		const current_executor& executor = s_CurrentExecutor;
+		if (!executor.m_Schedule)
+			return false;
+
+		try
+		{
+			executor.m_Schedule(executor.m_Executor, handle);
+		}
+		catch (...)
+		{
+			return false;
+		}
+
+		return true;
+	}
+
+	// For waking up coroutines from code that isn't about to finish running one (unlocking a mutex,
+	// setting an event...), so they don't pile up on top of the current stack if we can help it
+	inline void schedule_or_resume(coro::coroutine_handle<> handle)
+	{
+		if (!try_schedule(handle))
+			handle.resume();
+	}
+}
+
+#endif
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+
+#ifndef MH_STUFF_API
+#define MH_STUFF_API
+#endif
+
+// Set to 0 to have mh::task/mh::generator coroutine frames use global operator new/delete directly
+#ifndef MH_COROUTINE_FRAME_ALLOCATOR
+#define MH_COROUTINE_FRAME_ALLOCATOR 1
+#endif
+
+namespace mh
+{
+	namespace detail::frame_allocator_hpp
+	{
+		// Frames are recycled through per-thread free lists, one per size class. Frames are usually
+		// freed on whatever thread finished them, so when a thread's list for a size class gets too
+		// long, a batch of it is moved to a shared list that other threads can refill from.
+		inline constexpr std::size_t SIZE_CLASS_GRANULARITY = 64;
+		inline constexpr std::size_t SIZE_CLASS_COUNT = 32; // Anything bigger than 2KB goes straight to operator new
+		inline constexpr std::size_t BATCH_SIZE = 32;
+
+		MH_STUFF_API void* allocate(std::size_t size);
+		MH_STUFF_API void deallocate(void* ptr, std::size_t size) noexcept;
+
+		// Inherit from this in a promise_type to have its coroutine frames use the frame allocator
+		struct recycled_frame
+		{
+#if MH_COROUTINE_FRAME_ALLOCATOR
+			static void* operator new(std::size_t size) { return allocate(size); }
+			static void operator delete(void* ptr, std::size_t size) noexcept { deallocate(ptr, size); }
+#endif
+		};
+
+		// Frames from allocator_frame are laid out as [frame][allocator], so that operator delete (which
+		// only gets the pointer and size) can find its way back to the allocator.
+		constexpr std::size_t align_up(std::size_t value, std::size_t alignment) noexcept
+		{
+			return (value + alignment - 1) / alignment * alignment;
+		}
+
+		// Allocators are always rebound to std::max_align_t, so frames are suitably aligned for anything
+		template<typename TAlloc>
+		using frame_unit_allocator_t = typename std::allocator_traits<std::remove_cvref_t<TAlloc>>::template rebind_alloc<std::max_align_t>;
+
+		template<typename TUnitAlloc>
+		struct frame_layout
+		{
+			static_assert(alignof(TUnitAlloc) <= alignof(std::max_align_t), "over-aligned allocators are not supported");
+
+			static constexpr std::size_t allocator_offset(std::size_t frameSize) noexcept
+			{
+				return align_up(frameSize, alignof(TUnitAlloc));
+			}
+			static constexpr std::size_t unit_count(std::size_t frameSize) noexcept
+			{
+				return align_up(allocator_offset(frameSize) + sizeof(TUnitAlloc), sizeof(std::max_align_t)) / sizeof(std::max_align_t);
+			}
+
+			static TUnitAlloc& get_allocator(void* frame, std::size_t frameSize) noexcept
+			{
+				return *std::launder(reinterpret_cast<TUnitAlloc*>(static_cast<std::byte*>(frame) + allocator_offset(frameSize)));
+			}
+		};
+
+		// The allocator comes right after std::allocator_arg, which is either the first parameter or
+		// (for member functions) the second
+		template<typename TFirst, typename TSecond, typename... TRest>
+		constexpr const auto& find_frame_allocator(const TFirst&, const TSecond& second, const TRest&... rest) noexcept
+		{
+			if constexpr (std::is_same_v<TFirst, std::allocator_arg_t>)
+				return second;
+			else
+				return find_frame_allocator(second, rest...);
+		}
+
+		// Inherit from this in a promise_type that coroutine_traits picks for coroutines taking
+		// std::allocator_arg, alloc as their first two parameters (after the object parameter, for
+		// member functions), with TParams being all of their parameter types. Their frames are
+		// allocated from alloc instead of the frame allocator.
+		//
+		// Everything here is keyed on the parameter types rather than being templated member functions,
+		// so that operator new and operator delete are a matching pair as far as GCC's
+		// -Wmismatched-new-delete is concerned.
+		template<typename TAlloc, typename... TParams>
+		struct allocator_frame
+		{
+			using unit_allocator_type = frame_unit_allocator_t<TAlloc>;
+			using layout = frame_layout<unit_allocator_type>;
+
+			static void* operator new(std::size_t size, const TParams&... params)
+			{
+				unit_allocator_type alloc(find_frame_allocator(params...));
+				void* frame = std::allocator_traits<unit_allocator_type>::allocate(alloc, layout::unit_count(size));
+
+				::new (static_cast<std::byte*>(frame) + layout::allocator_offset(size)) unit_allocator_type(std::move(alloc));
+				return frame;
+			}
+
+			static void operator delete(void* frame, std::size_t size) noexcept
+			{
+				unit_allocator_type& storedAlloc = layout::get_allocator(frame, size);
+				unit_allocator_type alloc(std::move(storedAlloc));
+				storedAlloc.~unit_allocator_type();
+
+				std::allocator_traits<unit_allocator_type>::deallocate(alloc, static_cast<std::max_align_t*>(frame), layout::unit_count(size));
+			}
+		};
+	}
+}
+
+#ifndef MH_COMPILE_LIBRARY
+#include "frame_allocator.inl"
+#endif
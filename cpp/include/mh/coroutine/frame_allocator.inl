@@ -0,0 +1,221 @@
+#ifdef MH_COMPILE_LIBRARY
+#include "frame_allocator.hpp"
+#endif
+
+#ifndef MH_COMPILE_LIBRARY_INLINE
+#define MH_COMPILE_LIBRARY_INLINE inline
+#endif
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace mh::detail::frame_allocator_hpp
+{
+	struct free_block
+	{
+		free_block* m_Next;
+	};
+
+	struct block_list
+	{
+		free_block* m_Head = nullptr;
+		std::size_t m_Count = 0;
+
+		void push(void* ptr) noexcept
+		{
+			auto block = static_cast<free_block*>(ptr);
+			block->m_Next = m_Head;
+			m_Head = block;
+			m_Count++;
+		}
+		void* pop() noexcept
+		{
+			assert(m_Head);
+			m_Count--;
+			return std::exchange(m_Head, m_Head->m_Next);
+		}
+
+		// Removes count blocks from the front of the list
+		block_list split(std::size_t count) noexcept
+		{
+			assert(count > 0 && count <= m_Count);
+
+			block_list retVal;
+			retVal.m_Head = m_Head;
+			retVal.m_Count = count;
+
+			free_block* last = m_Head;
+			for (std::size_t i = 1; i < count; i++)
+				last = last->m_Next;
+
+			m_Head = last->m_Next;
+			m_Count -= count;
+			last->m_Next = nullptr;
+
+			return retVal;
+		}
+
+		void free_all() noexcept
+		{
+			while (m_Head)
+				::operator delete(pop());
+		}
+	};
+
+	constexpr std::size_t get_size_class(std::size_t size) noexcept
+	{
+		return (size + SIZE_CLASS_GRANULARITY - 1) / SIZE_CLASS_GRANULARITY;
+	}
+	constexpr std::size_t get_size_class_bytes(std::size_t sizeClass) noexcept
+	{
+		return sizeClass * SIZE_CLASS_GRANULARITY;
+	}
+
+	// Batches of blocks returned by threads with too many cached, shared by everyone
+	class central_cache final
+	{
+		static constexpr std::size_t MAX_BATCHES = 64;
+
+	public:
+		static central_cache& get()
+		{
+			// Intentionally leaked, threads may still be freeing frames during static destruction
+			static central_cache* s_Instance = new central_cache();
+			return *s_Instance;
+		}
+
+		bool try_take_batch(std::size_t sizeClass, block_list& list)
+		{
+			size_class_data& data = m_SizeClasses[sizeClass];
+			std::lock_guard lock(data.m_Mutex);
+			if (data.m_Batches.empty())
+				return false;
+
+			list = data.m_Batches.back();
+			data.m_Batches.pop_back();
+			return true;
+		}
+
+		void give_batch(std::size_t sizeClass, block_list list) noexcept
+		{
+			{
+				size_class_data& data = m_SizeClasses[sizeClass];
+				std::lock_guard lock(data.m_Mutex);
+				if (data.m_Batches.size() < MAX_BATCHES)
+				{
+					data.m_Batches.push_back(list);
+					return;
+				}
+			}
+
+			// Nobody needs this many spare frames
+			list.free_all();
+		}
+
+	private:
+		struct size_class_data
+		{
+			std::mutex m_Mutex;
+			std::vector<block_list> m_Batches;
+		};
+
+		central_cache()
+		{
+			for (size_class_data& data : m_SizeClasses)
+				data.m_Batches.reserve(MAX_BATCHES);
+		}
+
+		size_class_data m_SizeClasses[SIZE_CLASS_COUNT + 1];
+	};
+
+	class thread_cache final
+	{
+		static constexpr std::size_t MAX_CACHED = BATCH_SIZE * 2;
+
+	public:
+		~thread_cache()
+		{
+			// Give everything to the central cache, some other thread can make use of it
+			for (std::size_t i = 0; i < std::size(m_SizeClasses); i++)
+			{
+				block_list& list = m_SizeClasses[i];
+				while (list.m_Count > 0)
+					central_cache::get().give_batch(i, list.split(std::min(list.m_Count, BATCH_SIZE)));
+			}
+		}
+
+		void* allocate(std::size_t sizeClass)
+		{
+			block_list& list = m_SizeClasses[sizeClass];
+			if (list.m_Count > 0 || central_cache::get().try_take_batch(sizeClass, list))
+				return list.pop();
+
+			return ::operator new(get_size_class_bytes(sizeClass));
+		}
+
+		void deallocate(void* ptr, std::size_t sizeClass) noexcept
+		{
+			block_list& list = m_SizeClasses[sizeClass];
+			list.push(ptr);
+
+			if (list.m_Count > MAX_CACHED)
+				central_cache::get().give_batch(sizeClass, list.split(BATCH_SIZE));
+		}
+
+		// Returns nullptr if this thread's cache has already been destroyed (during thread exit)
+		static thread_cache* get() noexcept
+		{
+			static thread_local thread_cache* s_Cache = nullptr;
+			static thread_local bool s_Initialized = false;
+			if (!s_Initialized)
+			{
+				struct holder
+				{
+					~holder() { s_Cache = nullptr; }
+					thread_cache m_Cache;
+				};
+
+				s_Initialized = true;
+				static thread_local holder s_Holder;
+				s_Cache = &s_Holder.m_Cache;
+			}
+
+			return s_Cache;
+		}
+
+	private:
+		block_list m_SizeClasses[SIZE_CLASS_COUNT + 1];
+	};
+
+	MH_COMPILE_LIBRARY_INLINE void* allocate(std::size_t size)
+	{
+		const auto sizeClass = get_size_class(size);
+		if (sizeClass > SIZE_CLASS_COUNT)
+			return ::operator new(size);
+
+		if (thread_cache* cache = thread_cache::get())
+			return cache->allocate(sizeClass);
+
+		return ::operator new(get_size_class_bytes(sizeClass));
+	}
+
+	MH_COMPILE_LIBRARY_INLINE void deallocate(void* ptr, std::size_t size) noexcept
+	{
+		if (!ptr)
+			return;
+
+		const auto sizeClass = get_size_class(size);
+		if (sizeClass <= SIZE_CLASS_COUNT)
+		{
+			if (thread_cache* cache = thread_cache::get())
+				return cache->deallocate(ptr, sizeClass);
+		}
+
+		::operator delete(ptr);
+	}
+}
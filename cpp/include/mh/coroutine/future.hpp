@@ -47,6 +47,9 @@ namespace mh
 
 		using super::valid;
 
+		// Whether anyone has called request_cancel() on one of our tasks, for producers that can give up early
+		using super::is_cancel_requested;
+
 		mh::future<T> get_future() const
 		{
 			return mh::future<T>(this->get_promise_for_copy());
@@ -58,11 +61,11 @@ namespace mh
 
 		void set_value(T value)
 		{
-			this->get_promise().set_state<detail::promise<T>::IDX_VALUE>(std::move(value));
+			this->get_promise().template set_state<detail::promise<T>::IDX_VALUE>(std::move(value));
 		}
 		void set_exception(std::exception_ptr p)
 		{
-			this->get_promise().set_state<detail::promise<T>::IDX_EXCEPTION>(p);
+			this->get_promise().template set_state<detail::promise<T>::IDX_EXCEPTION>(p);
 		}
 	};
 
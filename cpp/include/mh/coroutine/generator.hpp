@@ -4,20 +4,98 @@
 
 #ifdef MH_COROUTINES_SUPPORTED
 
+#include "frame_allocator.hpp"
+
 #include <cassert>
 #include <exception>
 #include <iterator>
+#include <memory>
 #include <stdexcept>
-#include <variant>
+#include <type_traits>
+#include <utility>
+
+#if __has_include(<span>)
+#include <span>
+#endif
 
 namespace mh
 {
 	template<typename T> class generator;
 
+	// co_yield mh::elements_of(range) from inside a generator to yield everything in the range. If the
+	// range is another generator of the same type, the outer generator hands control to it directly, so
+	// every element still only takes one resume() to get to the consumer no matter how deeply nested it is.
+	template<typename TRange>
+	struct elements_of
+	{
+		TRange m_Range;
+	};
+
+	template<typename TRange>
+	elements_of(TRange&&) -> elements_of<TRange&&>;
+
 	namespace detail::generator_hpp
 	{
+		template<typename T> struct promise;
+		template<typename T> struct iterator;
+
+		// Passes control back up to the generator that co_yielded elements_of() us
 		template<typename T>
-		struct promise
+		struct final_awaiter
+		{
+			constexpr bool await_ready() const noexcept { return false; }
+			template<typename TPromise> // promise<T>, or allocator_promise
+			coro::coroutine_handle<> await_suspend(coro::coroutine_handle<TPromise> handle) const noexcept
+			{
+				promise<T>& self = handle.promise();
+				if (!self.m_Parent)
+					return coro::noop_coroutine(); // The root is done, back to the consumer
+
+				self.m_Root->m_Leaf = self.m_Parent;
+				return self.m_Parent->m_Handle;
+			}
+			constexpr void await_resume() const noexcept {}
+		};
+
+		// Runs a nested generator in place of the one that co_yielded it. TGenerator is either a reference to
+		// a generator<T> owned by the caller, or a generator<T> we made from some other kind of range.
+		template<typename T, typename TGenerator>
+		struct nested_awaiter
+		{
+			bool await_ready() const noexcept { return !m_Generator.m_Handle || m_Generator.m_Handle.done(); }
+
+			template<typename TPromise>
+			coro::coroutine_handle<> await_suspend(coro::coroutine_handle<TPromise> parent) noexcept
+			{
+				promise<T>& parentPromise = parent.promise();
+				promise<T>& child = *m_Generator.m_Promise;
+				child.m_Parent = &parentPromise;
+				child.m_Root = parentPromise.m_Root;
+				child.m_Root->m_Leaf = &child;
+				return m_Generator.m_Handle;
+			}
+
+			void await_resume() const
+			{
+				if (m_Generator.m_Handle)
+					m_Generator.m_Promise->rethrow_if_exception();
+			}
+
+			TGenerator m_Generator;
+		};
+
+		// Yielding an empty span doesn't need to suspend, there's nothing for the consumer to look at
+		struct yield_span_awaiter
+		{
+			constexpr bool await_ready() const noexcept { return m_IsEmpty; }
+			constexpr void await_suspend(coro::coroutine_handle<>) const noexcept {}
+			constexpr void await_resume() const noexcept {}
+
+			bool m_IsEmpty;
+		};
+
+		template<typename T>
+		struct promise : frame_allocator_hpp::recycled_frame
 		{
 		public:
 			using value_type = std::remove_reference_t<T>;
@@ -28,23 +106,53 @@ namespace mh
 		private:
 			using io_type = std::conditional_t<std::is_rvalue_reference_v<T>, T, const T&>;
 			using storage_type = std::conditional_t<std::is_rvalue_reference_v<T>, value_type*, const value_type*>;
+#if __cpp_lib_span >= 202002L
+			using span_type = std::span<std::remove_pointer_t<storage_type>>;
+#endif
 
 		public:
 
 			constexpr detail::coro::suspend_always initial_suspend() const noexcept { return {}; }
-			constexpr detail::coro::suspend_always final_suspend() const noexcept { return {}; }
+			constexpr final_awaiter<T> final_suspend() const noexcept { return {}; }
 
 			constexpr generator<T> get_return_object();
 
 			constexpr detail::coro::suspend_always yield_value(io_type value)
 			{
-				m_State = std::addressof(value);
+				m_Current = std::addressof(value);
+				m_End = m_Current + 1;
 				return {};
 			}
 
+#if __cpp_lib_span >= 202002L
+			// Yields every element of the span, without having to resume the generator for each one. Fill
+			// a buffer and yield that for streams of small values, where the resume would dwarf the actual work.
+			template<typename TElement, std::size_t EXTENT>
+				requires std::is_convertible_v<std::span<TElement, EXTENT>, span_type>
+			constexpr yield_span_awaiter yield_value(std::span<TElement, EXTENT> values) noexcept
+			{
+				m_Current = values.data();
+				m_End = values.data() + values.size();
+				return { values.empty() };
+			}
+#endif
+
+			template<typename TRange>
+			auto yield_value(elements_of<TRange> elements)
+			{
+				if constexpr (std::is_same_v<std::remove_cvref_t<TRange>, generator<T>>)
+				{
+					return nested_awaiter<T, generator<T>&>{ elements.m_Range };
+				}
+				else
+				{
+					return nested_awaiter<T, generator<T>>{ yield_range<TRange>(std::forward<TRange>(elements.m_Range)) };
+				}
+			}
+
 			void unhandled_exception()
 			{
-				m_State = std::current_exception();
+				m_Exception = std::current_exception();
 			}
 
 			void return_void()
@@ -54,17 +162,11 @@ namespace mh
 
 			const_reference& value() const
 			{
-				switch (m_State.index())
-				{
-				case 0:
+				rethrow_if_exception();
+				if (!m_Current)
 					throw std::runtime_error("value() called on promise with no state");
-				case 1:
-					return *std::get<1>(m_State);
-				case 2:
-					std::rethrow_exception(std::get<2>(m_State));
-				default:
-					throw std::logic_error("invalid promise state");
-				}
+
+				return *m_Current;
 			}
 
 			io_type value()
@@ -74,12 +176,65 @@ namespace mh
 
 			void rethrow_if_exception() const
 			{
-				if (auto ptr = std::get_if<std::exception_ptr>(&m_State))
-					std::rethrow_exception(*ptr);
+				if (m_Exception)
+					std::rethrow_exception(m_Exception);
+			}
+
+			// Resumes whichever generator is currently producing values for this one (or this one, if none)
+			void resume_leaf() const
+			{
+				m_Leaf->m_Handle.resume();
 			}
+			promise<T>& leaf() const noexcept { return *m_Leaf; }
 
 		private:
-			std::variant<std::monostate, storage_type, std::exception_ptr> m_State;
+			friend struct final_awaiter<T>;
+			friend struct iterator<T>;
+			template<typename, typename> friend struct nested_awaiter;
+			template<typename, typename, typename...> friend struct allocator_promise;
+
+			template<typename TRange>
+			static generator<T> yield_range(TRange range)
+			{
+#if __cpp_lib_span >= 202002L
+				if constexpr (std::is_convertible_v<TRange&, span_type>)
+				{
+					co_yield span_type(range);
+				}
+				else
+#endif
+				{
+					for (auto&& element : range)
+						co_yield static_cast<io_type>(element);
+				}
+			}
+
+			// The values yielded by the last co_yield, one or more of them
+			storage_type m_Current = nullptr;
+			storage_type m_End = nullptr;
+			std::exception_ptr m_Exception;
+
+			// Generators that co_yield elements_of() another generator form a stack. m_Leaf (only used on
+			// the root) is the innermost one, which is the one that gets resumed for the next value.
+			promise<T>* m_Root = this;
+			promise<T>* m_Parent = nullptr;
+			promise<T>* m_Leaf = this;
+
+			// This coroutine, made from the real promise type by get_return_object(). The frame of an
+			// allocator_promise can't be reached through a coroutine_handle<promise<T>>.
+			coro::coroutine_handle<> m_Handle;
+		};
+
+		// The promise_type for generators taking std::allocator_arg, alloc (see the coroutine_traits
+		// specializations below). Everything else only ever sees the promise<T> part of it, along with
+		// a type-erased handle.
+		template<typename T, typename TAlloc, typename... TParams>
+		struct allocator_promise final : promise<T>, frame_allocator_hpp::allocator_frame<TAlloc, TParams...>
+		{
+			using frame_allocator_hpp::allocator_frame<TAlloc, TParams...>::operator new;
+			using frame_allocator_hpp::allocator_frame<TAlloc, TParams...>::operator delete;
+
+			generator<T> get_return_object();
 		};
 
 		struct iterator_end {};
@@ -94,18 +249,45 @@ namespace mh
 			using pointer = typename promise<T>::pointer;
 
 			using self_type = iterator<T>;
-			using handle_type = detail::coro::coroutine_handle<promise<T>>;
+			using handle_type = detail::coro::coroutine_handle<>;
+
+			iterator(handle_type handle, promise<T>* promise) : m_Handle(std::move(handle)), m_Promise(promise)
+			{
+				load_values();
+			}
 
-			iterator(handle_type handle) : m_Handle(std::move(handle)) {}
+			bool done() const { return !m_Handle || m_Handle.done(); }
 
-			constexpr bool done() const { return m_Handle.done(); }
+			// Only resumes the generator once we've been through everything it yielded last time
+			self_type& operator++()
+			{
+				if (++m_Current == m_End)
+				{
+					m_Promise->resume_leaf();
+					m_Promise->rethrow_if_exception();
+					load_values();
+				}
 
-			self_type& operator++() { m_Handle.resume(); return *this; }
+				return *this;
+			}
 
-			auto operator*() const -> decltype(auto) { return m_Handle.promise().value(); }
+			auto operator*() const -> decltype(auto) { return static_cast<typename promise<T>::io_type>(*m_Current); }
 
 		private:
+			void load_values()
+			{
+				if (done())
+					return;
+
+				const promise<T>& leaf = m_Promise->leaf();
+				m_Current = leaf.m_Current;
+				m_End = leaf.m_End;
+			}
+
 			handle_type m_Handle;
+			promise<T>* m_Promise = nullptr;
+			typename promise<T>::storage_type m_Current = nullptr;
+			typename promise<T>::storage_type m_End = nullptr;
 		};
 
 		template<typename T> constexpr bool operator==(const iterator<T>& it, const iterator_end&)
@@ -120,6 +302,8 @@ namespace mh
 		template<typename T> constexpr bool operator!=(const iterator_end& end, const iterator<T>& it) { return !(end == it); }
 	}
 
+	// Frames come from the frame allocator, unless the coroutine takes std::allocator_arg, alloc as its
+	// first parameters (after the object, for member functions), in which case they come from alloc.
 	template<typename T>
 	class [[nodiscard]] generator
 	{
@@ -127,9 +311,17 @@ namespace mh
 		using promise_type = detail::generator_hpp::promise<T>;
 		using coroutine_type = detail::coro::coroutine_handle<promise_type>;
 
-		generator(coroutine_type handle) : m_Handle(std::move(handle)) {}
+		generator(coroutine_type handle) : generator(handle, handle.promise()) {}
+		// For frames whose promise type only derives from promise_type (generators taking std::allocator_arg)
+		generator(detail::coro::coroutine_handle<> handle, promise_type& promise) noexcept :
+			m_Handle(std::move(handle)), m_Promise(&promise)
+		{
+		}
 
-		generator(generator&& other) noexcept : m_Handle(std::exchange(other.m_Handle, nullptr)) {}
+		generator(generator&& other) noexcept :
+			m_Handle(std::exchange(other.m_Handle, nullptr)), m_Promise(std::exchange(other.m_Promise, nullptr))
+		{
+		}
 		generator& operator=(generator&& other) noexcept
 		{
 			assert(std::addressof(other) != this);
@@ -137,6 +329,7 @@ namespace mh
 				m_Handle.destroy();
 
 			m_Handle = std::exchange(other.m_Handle, nullptr);
+			m_Promise = std::exchange(other.m_Promise, nullptr);
 			return *this;
 		}
 
@@ -150,30 +343,72 @@ namespace mh
 		{
 			if (m_Handle)
 			{
-				m_Handle.resume();
-				m_Handle.promise().rethrow_if_exception();
+				m_Promise->resume_leaf();
+				m_Promise->rethrow_if_exception();
 			}
 
-			return { m_Handle };
+			return { m_Handle, m_Promise };
 		}
 		detail::generator_hpp::iterator_end end() { return {}; }
 
 	private:
-		coroutine_type m_Handle;
+		template<typename, typename> friend struct detail::generator_hpp::nested_awaiter;
+
+		detail::coro::coroutine_handle<> m_Handle;
+		promise_type* m_Promise = nullptr;
 	};
 
 	template<typename T>
 	inline constexpr generator<T> detail::generator_hpp::promise<T>::get_return_object()
 	{
-		return { coro::coroutine_handle<typename generator<T>::promise_type>::from_promise(*this) };
+		const auto handle = coro::coroutine_handle<promise<T>>::from_promise(*this);
+		m_Handle = handle;
+		return { handle };
+	}
+
+	template<typename T, typename TAlloc, typename... TParams>
+	inline generator<T> detail::generator_hpp::allocator_promise<T, TAlloc, TParams...>::get_return_object()
+	{
+		this->m_Handle = coro::coroutine_handle<allocator_promise>::from_promise(*this);
+		return { this->m_Handle, static_cast<promise<T>&>(*this) };
+	}
+
+	namespace detail::generator_hpp
+	{
+		// TAllocArgs is either empty, or std::allocator_arg_t and the allocator for the frame
+		template<typename TIter, typename... TAllocArgs>
+		generator<typename std::iterator_traits<TIter>::value_type> make_generator_impl(TAllocArgs..., TIter begin, TIter end)
+		{
+			for (auto it = begin; it != end; ++it)
+				co_yield *it;
+		}
 	}
 
 	template<typename TIter>
 	static generator<typename std::iterator_traits<TIter>::value_type> make_generator(TIter begin, TIter end)
 	{
-		for (auto it = begin; it != end; ++it)
-			co_yield *it;
+		return detail::generator_hpp::make_generator_impl<TIter>(begin, end);
+	}
+
+	template<typename TAlloc, typename TIter>
+	static generator<typename std::iterator_traits<TIter>::value_type> make_generator(
+		std::allocator_arg_t, const TAlloc& alloc, TIter begin, TIter end)
+	{
+		return detail::generator_hpp::make_generator_impl<TIter, std::allocator_arg_t, const TAlloc&>(
+			std::allocator_arg, alloc, begin, end);
 	}
 }
 
+template<typename T, typename TAlloc, typename... TArgs>
+struct mh::detail::coro::coroutine_traits<mh::generator<T>, std::allocator_arg_t, TAlloc, TArgs...>
+{
+	using promise_type = mh::detail::generator_hpp::allocator_promise<T, TAlloc, std::allocator_arg_t, TAlloc, TArgs...>;
+};
+
+template<typename T, typename TThis, typename TAlloc, typename... TArgs>
+struct mh::detail::coro::coroutine_traits<mh::generator<T>, TThis, std::allocator_arg_t, TAlloc, TArgs...>
+{
+	using promise_type = mh::detail::generator_hpp::allocator_promise<T, TAlloc, TThis, std::allocator_arg_t, TAlloc, TArgs...>;
+};
+
 #endif
@@ -0,0 +1,218 @@
+#pragma once
+
+#include "task.hpp"
+
+#ifdef MH_COROUTINES_SUPPORTED
+
+#include <cassert>
+#include <exception>
+#include <future>
+#include <utility>
+#include <variant>
+
+namespace mh
+{
+	template<typename T = void> class lazy_task;
+
+	namespace detail::lazy_task_hpp
+	{
+		template<typename T> class promise;
+
+		struct final_awaiter
+		{
+			constexpr bool await_ready() const noexcept { return false; }
+
+			template<typename TPromise>
+			coro::coroutine_handle<> await_suspend(coro::coroutine_handle<TPromise> handle) const noexcept
+			{
+				// Hand control straight back to whoever awaited us
+				if (coro::coroutine_handle<> continuation = handle.promise().m_Continuation)
+					return continuation;
+
+				return coro::noop_coroutine();
+			}
+
+			constexpr void await_resume() const noexcept {}
+		};
+
+		// Unlike mh::task, nothing here needs to be atomic: the awaiting coroutine is always suspended
+		// before we start, and we are always finished before it is resumed. Cancellation is the exception,
+		// it is passed on from the awaiting coroutine while we run.
+		template<typename T>
+		class promise_base : public frame_allocator_hpp::recycled_frame, public cancellation_hpp::cancellation_state
+		{
+			using storage_type = typename task_hpp::co_promise_traits<T>::storage_type;
+
+		public:
+			static constexpr size_t IDX_RUNNING = 0;
+			static constexpr size_t IDX_VALUE = 1;
+			static constexpr size_t IDX_EXCEPTION = 2;
+
+			constexpr coro::suspend_always initial_suspend() const noexcept { return {}; }
+			constexpr final_awaiter final_suspend() const noexcept { return {}; }
+
+			void unhandled_exception() noexcept
+			{
+				m_Result.template emplace<IDX_EXCEPTION>(std::current_exception());
+			}
+
+			coro::coroutine_handle<> m_Continuation;
+
+		protected:
+			void rethrow_if_exception() const
+			{
+				if (auto ex = std::get_if<IDX_EXCEPTION>(&m_Result))
+					std::rethrow_exception(*ex);
+			}
+
+			std::variant<std::monostate, storage_type, std::exception_ptr> m_Result;
+		};
+
+		template<typename T>
+		class promise final : public promise_base<T>
+		{
+			using super = promise_base<T>;
+
+		public:
+			lazy_task<T> get_return_object() noexcept;
+
+			void return_value(T value)
+			{
+				this->m_Result.template emplace<super::IDX_VALUE>(std::move(value));
+			}
+
+			T& get_result() &
+			{
+				this->rethrow_if_exception();
+				return std::get<super::IDX_VALUE>(this->m_Result);
+			}
+			T get_result() &&
+			{
+				this->rethrow_if_exception();
+				return std::move(std::get<super::IDX_VALUE>(this->m_Result));
+			}
+		};
+
+		template<>
+		class promise<void> final : public promise_base<void>
+		{
+		public:
+			lazy_task<void> get_return_object() noexcept;
+
+			void return_void() noexcept
+			{
+				this->m_Result.template emplace<IDX_VALUE>();
+			}
+
+			void get_result() const
+			{
+				this->rethrow_if_exception();
+			}
+		};
+
+		template<typename T, bool IS_RVALUE>
+		class awaiter final
+		{
+		public:
+			explicit awaiter(coro::coroutine_handle<promise<T>> handle) noexcept : m_Handle(handle) {}
+
+			bool await_ready() const noexcept { return !m_Handle || m_Handle.done(); }
+
+			template<typename TParentPromise>
+			coro::coroutine_handle<> await_suspend(coro::coroutine_handle<TParentPromise> parent) noexcept
+			{
+				// We're the only thing it can be waiting on, so cancelling it cancels us too
+				m_CancelForwarder.start(parent, m_Handle.promise());
+
+				// Start the task by transferring control to it directly, it transfers back when it is done
+				m_Handle.promise().m_Continuation = parent;
+				return m_Handle;
+			}
+			decltype(auto) await_resume()
+			{
+				m_CancelForwarder.stop();
+
+				if (!m_Handle)
+					throw std::future_error(std::future_errc::no_state);
+
+				if constexpr (IS_RVALUE)
+					return std::move(m_Handle.promise()).get_result();
+				else
+					return m_Handle.promise().get_result();
+			}
+
+		private:
+			coro::coroutine_handle<promise<T>> m_Handle;
+			cancellation_hpp::cancel_forwarder<cancellation_hpp::cancellation_state> m_CancelForwarder;
+		};
+	}
+
+	// A task that doesn't start until it is awaited, and is only ever awaited by one coroutine.
+	// Because the awaiting coroutine owns it outright, its lifetime is strictly nested inside that
+	// coroutine's, which lets the compiler allocate it as part of the awaiting coroutine's frame
+	// when it can see both. It also always starts on whatever thread awaits it, so the awaiting
+	// coroutine decides which executor it runs on.
+	//
+	// Starting and finishing rely on symmetric transfer, which GCC only turns into a tail call at -O2.
+	// Below that, every co_await of a lazy_task that completes synchronously uses up some stack until
+	// the awaiting coroutine suspends or finishes, so awaiting millions of them in a loop can overflow
+	// the stack in debug builds.
+	template<typename T>
+	class [[nodiscard]] lazy_task final
+	{
+	public:
+		using promise_type = detail::lazy_task_hpp::promise<T>;
+		using coroutine_type = detail::coro::coroutine_handle<promise_type>;
+
+		lazy_task() noexcept = default;
+		explicit lazy_task(coroutine_type handle) noexcept : m_Handle(handle) {}
+
+		lazy_task(lazy_task&& other) noexcept : m_Handle(std::exchange(other.m_Handle, nullptr)) {}
+		lazy_task& operator=(lazy_task&& other) noexcept
+		{
+			assert(std::addressof(other) != this);
+			if (m_Handle)
+				m_Handle.destroy();
+
+			m_Handle = std::exchange(other.m_Handle, nullptr);
+			return *this;
+		}
+
+		~lazy_task()
+		{
+			if (m_Handle)
+				m_Handle.destroy();
+		}
+
+		[[nodiscard]] bool valid() const noexcept { return !!m_Handle; }
+		[[nodiscard]] bool is_ready() const noexcept { return m_Handle && m_Handle.done(); }
+
+		// Awaiting an lvalue gives a reference to the result, awaiting an rvalue moves it out
+		auto operator co_await() & noexcept { return detail::lazy_task_hpp::awaiter<T, false>(m_Handle); }
+		auto operator co_await() && noexcept { return detail::lazy_task_hpp::awaiter<T, true>(m_Handle); }
+
+		// Starts running the task on this thread, as an mh::task that can be waited on or shared
+		task<T> start() &&
+		{
+			return [](lazy_task self) -> task<T>
+			{
+				co_return co_await std::move(self);
+			}(std::move(*this));
+		}
+
+	private:
+		coroutine_type m_Handle;
+	};
+
+	template<typename T>
+	inline lazy_task<T> detail::lazy_task_hpp::promise<T>::get_return_object() noexcept
+	{
+		return lazy_task<T>(coro::coroutine_handle<promise<T>>::from_promise(*this));
+	}
+	inline lazy_task<void> detail::lazy_task_hpp::promise<void>::get_return_object() noexcept
+	{
+		return lazy_task<void>(coro::coroutine_handle<promise<void>>::from_promise(*this));
+	}
+}
+
+#endif
@@ -4,21 +4,35 @@
 
 #ifdef MH_COROUTINES_SUPPORTED
 
-#include "../concurrency/mutex_debug.hpp"
+#include "../concurrency/futex.hpp"
+#include "cancellation.hpp"
+#include "current_executor.hpp"
+#include "frame_allocator.hpp"
+#include "task_registry.hpp"
 #include "../data/variable_pusher.hpp"
 #include "../memory/stack_info.hpp"
 
 #include <atomic>
 #include <cassert>
-#include <condition_variable>
+#include <chrono>
+#include <cstdint>
+#include <functional>
 #include <future>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <utility>
 #include <variant>
-#include <vector>
 
 namespace mh
 {
 	template<typename T = void> class task;
 
+	namespace detail
+	{
+		template<typename T> class promise;
+	}
+
 	enum class task_state
 	{
 		empty, // no state, never initialized, or was moved from
@@ -56,29 +70,110 @@ namespace mh
 			using storage_type = std::reference_wrapper<std::remove_reference_t<T>>;
 		};
 
-		struct suspend_sometimes
+		// Ready values that are small and cheap to copy are stored directly inside the task, so
+		// make_ready_task() doesn't have to allocate a promise for them.
+		template<typename T, typename TStorage = typename co_promise_traits<T>::storage_type>
+		inline constexpr bool is_inline_value_v = !std::is_reference_v<T> &&
+			sizeof(TStorage) <= (sizeof(void*) * 2) &&
+			alignof(TStorage) <= alignof(void*) &&
+			std::is_nothrow_copy_constructible_v<TStorage> &&
+			std::is_nothrow_move_constructible_v<TStorage>;
+
+		struct inline_value_t
+		{
+			explicit inline_value_t() = default;
+		};
+		inline constexpr inline_value_t inline_value{};
+
+		// Intrusive list node for anything waiting on a promise. It lives inside the waiter itself
+		// (for co_await, that's the awaiter object in the awaiting coroutine's frame), so waiting
+		// never allocates.
+		struct waiter_node
 		{
-			constexpr suspend_sometimes(bool suspend) : m_Suspend(suspend) {}
+			waiter_node* m_Next = nullptr;
+			coro::coroutine_handle<> m_Handle;
 
-			[[nodiscard]] constexpr bool await_ready() const noexcept { return !m_Suspend; }
-			constexpr void await_suspend(coro::coroutine_handle<>) const noexcept {}
-			constexpr void await_resume() const noexcept {}
+			// If set, called instead of resuming m_Handle once the promise is ready, for waiters that
+			// aren't a single coroutine (see when_all()/when_any()). Returns the coroutine to resume,
+			// if any. The node may be freed by someone else as soon as this has been called.
+			coro::coroutine_handle<> (*m_OnReady)(waiter_node& node) noexcept = nullptr;
+
+			coro::coroutine_handle<> take_handle() noexcept
+			{
+				return m_OnReady ? m_OnReady(*this) : m_Handle;
+			}
+		};
+
+		// Resumes or schedules all but one of the waiters, and returns the remaining one so the caller can
+		// transfer control to it directly, instead of nesting another resume() on top of the current stack.
+		inline coro::coroutine_handle<> take_continuation(waiter_node* waiters) noexcept
+		{
+			coro::coroutine_handle<> continuation;
+			while (waiters)
+			{
+				// Once notified, the waiter may run (and free the node) on another thread
+				waiter_node* next = waiters->m_Next;
+				if (const coro::coroutine_handle<> handle = waiters->take_handle())
+				{
+					if (!continuation)
+					{
+						continuation = handle;
+					}
+					else if (!current_executor_hpp::try_schedule(handle))
+					{
+						// Nowhere to defer to, so resume everyone but the last waiter here
+						continuation.resume();
+						continuation = handle;
+					}
+				}
+
+				waiters = next;
+			}
+
+			return continuation ? continuation : coro::noop_coroutine();
+		}
+
+		template<typename TPromise>
+		struct final_awaiter
+		{
+			constexpr bool await_ready() const noexcept { return false; }
+			coro::coroutine_handle<> await_suspend(coro::coroutine_handle<TPromise> handle) const noexcept
+			{
+				TPromise& promise = handle.promise();
+#if MH_COROUTINE_TASK_REGISTRY
+				promise.on_suspend();
+#endif
+				waiter_node* waiters = promise.publish();
 
-			bool m_Suspend;
+				// The running coroutine holds its own reference, drop it now that we're suspended.
+				// If we were the last one (all referencing tasks have gone out of scope), we are in
+				// charge of our own destiny.
+				if (promise.remove_ref())
+					handle.destroy();
+
+				// Symmetric transfer, so long chains of awaiters don't recurse. GCC only makes this a real
+				// tail call at -O2 (sibling call optimization), unoptimized builds still use some stack per link.
+				return take_continuation(waiters);
+			}
+			constexpr void await_resume() const noexcept {}
 		};
 
 		template<typename T>
-		class promise_base
+		class promise_base : public frame_allocator_hpp::recycled_frame, public cancellation_hpp::cancellation_state
+#if MH_COROUTINE_TASK_REGISTRY
+			, public task_registry_hpp::registered_task
+#endif
 		{
 			using traits = co_promise_traits<T>;
 			using storage_type = typename traits::storage_type;
 
-			static constexpr int32_t REFCOUNT_UNSET = -1234;
-
 		public:
 			~promise_base()
 			{
 				assert(m_RefCount == 0);
+#if MH_COROUTINE_TASK_REGISTRY
+				task_registry_hpp::unregister_task(*this);
+#endif
 			}
 
 			promise_base() noexcept {}
@@ -87,40 +182,55 @@ namespace mh
 			promise_base<T>& operator=(const promise_base<T>&) = delete;
 			promise_base<T>& operator=(promise_base<T>&&) = delete;
 
-			static constexpr size_t IDX_WAITERS = 0;
+			static constexpr size_t IDX_RUNNING = 0;
 			static constexpr size_t IDX_INVALID = 1;
 			static constexpr size_t IDX_VALUE = 2;
 			static constexpr size_t IDX_EXCEPTION = 3;
 
+#if MH_COROUTINE_TASK_REGISTRY
+			task<T> get_return_object(MH_SOURCE_LOCATION_AUTO(location));
+
+			template<typename TAwaitable>
+			task_registry_hpp::tracking_awaiter<TAwaitable&&> await_transform(TAwaitable&& awaitable)
+			{
+				return { *this, std::forward<TAwaitable>(awaitable) };
+			}
+#else
 			constexpr task<T> get_return_object();
+#endif
 
 			bool is_ready() const noexcept
 			{
-				auto index = m_State.index();
-				return index == IDX_VALUE || index == IDX_EXCEPTION;
+				return m_State.load(std::memory_order_acquire) == ready_state();
 			}
 
 			bool valid() const noexcept
 			{
-				return m_State.index() != IDX_INVALID;
+				return !is_ready() || m_Result.index() != IDX_INVALID;
 			}
 
 			std::exception_ptr get_exception() const noexcept
 			{
-				auto result = std::get_if<IDX_EXCEPTION>(&m_State);
+				if (!is_ready())
+					return nullptr;
+
+				auto result = std::get_if<IDX_EXCEPTION>(&m_Result);
 				return result ? *result : nullptr;
 			}
 
 			task_state get_task_state() const
 			{
-				const auto state = m_State.index();
+				if (!is_ready())
+					return task_state::running;
+
+				const auto state = m_Result.index();
 				switch (state)
 				{
 				case IDX_INVALID:    return task_state::empty;
 				default:
 					assert(!"Invalid state in mh::detail::task_hpp::promise_base<T>::get_task_state()");
 					[[fallthrough]];
-				case IDX_WAITERS:    return task_state::running;
+				case IDX_RUNNING:    return task_state::running;
 				case IDX_VALUE:      return task_state::value;
 				case IDX_EXCEPTION:  return task_state::exception;
 				}
@@ -128,59 +238,52 @@ namespace mh
 
 			void wait() const
 			{
-				if (!valid())
-					throw std::future_error(std::future_errc::no_state);
-
-				if (!is_ready())
+				if (!is_ready() && !spin_until_ready())
 				{
-					std::unique_lock lock(m_Mutex);
-					m_ValueReadyCV.wait(lock, [&] { return is_ready(); });
+					std::uint32_t flags = m_WaitFlags.fetch_or(WAIT_FLAG_HAS_WAITERS, std::memory_order_acquire) | WAIT_FLAG_HAS_WAITERS;
+					while (!(flags & WAIT_FLAG_READY))
+					{
+						mh::futex_wait(m_WaitFlags, flags);
+						flags = m_WaitFlags.load(std::memory_order_acquire);
+					}
+
 					assert(is_ready());
 				}
+
+				if (!valid())
+					throw std::future_error(std::future_errc::no_state);
 			}
 			template<typename Rep, typename Period>
 			std::future_status wait_for(const std::chrono::duration<Rep, Period>& timeout_duration) const
 			{
-				if (!valid())
-					throw std::future_error(std::future_errc::no_state);
-
-				std::unique_lock lock(m_Mutex);
-				if (is_ready())
-					return std::future_status::ready;
-
-				if (!m_ValueReadyCV.wait_for(lock, timeout_duration, [&] { return is_ready(); }))
-					return std::future_status::timeout;
-
-				assert(is_ready());
-				return std::future_status::ready;
+				return wait_until(std::chrono::steady_clock::now() + timeout_duration);
 			}
 			template<typename Clock, typename Period>
 			std::future_status wait_until(const std::chrono::time_point<Clock, Period>& timeout_time) const
 			{
-				if (!valid())
-					throw std::future_error(std::future_errc::no_state);
+				if (!is_ready() && !spin_until_ready())
+				{
+					std::uint32_t flags = m_WaitFlags.fetch_or(WAIT_FLAG_HAS_WAITERS, std::memory_order_acquire) | WAIT_FLAG_HAS_WAITERS;
+					while (!(flags & WAIT_FLAG_READY))
+					{
+						if (!mh::futex_wait_until(m_WaitFlags, flags, timeout_time) && !is_ready())
+							return std::future_status::timeout;
 
-				std::unique_lock lock(m_Mutex);
-				if (is_ready())
-					return std::future_status::ready;
+						flags = m_WaitFlags.load(std::memory_order_acquire);
+					}
 
-				if (!m_ValueReadyCV.wait_until(lock, timeout_time, [&] { return is_ready(); }))
-					return std::future_status::timeout;
+					assert(is_ready());
+				}
+
+				if (!valid())
+					throw std::future_error(std::future_errc::no_state);
 
-				assert(is_ready());
 				return std::future_status::ready;
 			}
 
 			void rethrow_if_exception() const
 			{
-				std::exception_ptr ex;
-				{
-					std::lock_guard lock(m_Mutex);
-					if (auto e = std::get_if<IDX_EXCEPTION>(&m_State))
-						ex = *e;
-				}
-
-				if (ex)
+				if (auto ex = get_exception())
 					std::rethrow_exception(ex);
 			}
 
@@ -191,117 +294,151 @@ namespace mh
 
 				if constexpr (!std::is_void_v<T>)
 				{
-					auto value = std::move(std::get<IDX_VALUE>(m_State));
-					m_State.template emplace<IDX_INVALID>();
+					auto value = std::move(std::get<IDX_VALUE>(m_Result));
+					m_Result.template emplace<IDX_INVALID>();
 					return std::move(value);
 				}
 			}
 
 			void unhandled_exception()
 			{
-				set_state<IDX_EXCEPTION>(std::current_exception());
+				store_result<IDX_EXCEPTION>(std::current_exception());
 			}
 
 			constexpr coro::suspend_never initial_suspend() const noexcept { return {}; }
-			suspend_sometimes final_suspend() const noexcept
-			{
-				std::lock_guard lock(m_Mutex);
-				m_FinalSuspendHasRun = true;
-
-				// If m_RefCount == 0, we are in charge of our own destiny (all referencing tasks have gone out of
-				// scope, so just delete ourselves when we're done)
-				return m_RefCount != 0;
-			}
+			final_awaiter<promise<T>> final_suspend() const noexcept { return {}; }
 
 			bool await_ready() const { return is_ready(); }
-			bool await_suspend(coro::coroutine_handle<> parent)
+
+			// Returns false (without adding the node) if the promise is already ready
+			bool try_add_waiter(waiter_node& node) const noexcept
 			{
-				if (is_ready())
-				{
-					return false;
-				}
-				else
+				void* state = m_State.load(std::memory_order_acquire);
+				do
 				{
-					std::lock_guard lock(m_Mutex);
-					if (is_ready())
-					{
+					if (state == ready_state())
 						return false;
-					}
-					else
-					{
-						std::get<IDX_WAITERS>(m_State).push_back(parent);
-						return true; // suspend
-					}
-				}
+
+					node.m_Next = static_cast<waiter_node*>(state);
+
+				} while (!m_State.compare_exchange_weak(state, &node, std::memory_order_release, std::memory_order_acquire));
+
+				return true; // suspend
 			}
 
+			// Stores the result without making it visible to anyone yet, see publish()
 			template<size_t IDX, typename TValue>
-			void set_state(TValue&& value)
+			void store_result(TValue&& value)
 			{
-				std::vector<coro::coroutine_handle<>> waiters;
+				static_assert(IDX == IDX_VALUE || IDX == IDX_EXCEPTION);
 
-				{
-					std::lock_guard lock(m_Mutex);
+				if (m_IsSatisfied.test_and_set(std::memory_order_relaxed))
+					throw std::future_error(std::future_errc::promise_already_satisfied);
 
-					if (is_ready())
-						throw std::future_error(std::future_errc::promise_already_satisfied);
+				m_Result.template emplace<IDX>(std::forward<TValue>(value));
+			}
 
-					waiters = std::move(std::get<IDX_WAITERS>(m_State));
+			// Makes the stored result visible, and returns everyone that was waiting on it (in the order they
+			// arrived). The caller is responsible for resuming them.
+			[[nodiscard]] waiter_node* publish() noexcept
+			{
+				auto waiters = static_cast<waiter_node*>(m_State.exchange(ready_state(), std::memory_order_acq_rel));
 
-					static_assert(IDX == IDX_VALUE || IDX == IDX_EXCEPTION);
-					m_State.template emplace<IDX>(std::move(value));
+				// Only make the syscall if someone is actually blocked in wait()
+				if (m_WaitFlags.exchange(WAIT_FLAG_READY, std::memory_order_release) & WAIT_FLAG_HAS_WAITERS)
+					mh::futex_wake_all(m_WaitFlags);
 
-					m_ValueReadyCV.notify_all();
+				// Nodes are pushed onto the front of the list, so reverse it
+				waiter_node* ordered = nullptr;
+				while (waiters)
+				{
+					waiter_node* next = waiters->m_Next;
+					waiters->m_Next = ordered;
+					ordered = waiters;
+					waiters = next;
 				}
 
-				for (auto& waiter : waiters)
+				return ordered;
+			}
+
+			// For promises that aren't coroutines. Coroutines store their result when they return, but don't
+			// publish it until final_suspend(), where they can transfer control directly to the waiter.
+			template<size_t IDX, typename TValue>
+			void set_state(TValue&& value)
+			{
+				store_result<IDX>(std::forward<TValue>(value));
+
+				for (waiter_node* waiter = publish(); waiter; )
 				{
-					assert(m_RefCount > 0 || !final_suspend_has_run());
-					waiter.resume();
-					assert(m_RefCount > 0 || !final_suspend_has_run());
+					// Resuming the waiter may destroy the frame the node lives in
+					waiter_node* next = waiter->m_Next;
+					if (const coro::coroutine_handle<> handle = waiter->take_handle())
+						handle.resume();
+
+					waiter = next;
 				}
 			}
 
-			const storage_type* try_get_value() const { return std::get_if<IDX_VALUE>(&m_State); }
-			storage_type* try_get_value() { return std::get_if<IDX_VALUE>(&m_State); }
+			const storage_type* try_get_value() const { return is_ready() ? std::get_if<IDX_VALUE>(&m_Result) : nullptr; }
+			storage_type* try_get_value() { return is_ready() ? std::get_if<IDX_VALUE>(&m_Result) : nullptr; }
 
-			void add_ref()
+			void add_ref() noexcept
 			{
-				int32_t refCountUnset = REFCOUNT_UNSET;
-				if (!m_RefCount.compare_exchange_strong(refCountUnset, 1))
-				{
-					assert(m_RefCount >= 1);
-					++m_RefCount;
-				}
+				m_RefCount.fetch_add(1, std::memory_order_relaxed);
 			}
-			[[nodiscard]] bool remove_ref()
+			[[nodiscard]] bool remove_ref() noexcept
 			{
-				auto newVal = --m_RefCount;
+				auto newVal = m_RefCount.fetch_sub(1, std::memory_order_acq_rel) - 1;
 				assert(newVal >= 0);
 				return newVal <= 0;
 			}
 
-			bool final_suspend_has_run() const noexcept { return m_FinalSuspendHasRun; }
 			int32_t get_ref_count() const noexcept { return m_RefCount; }
 
 			template<typename TFreeFunc>
 			void release_promise_ref(TFreeFunc&& freeFunc)
 			{
-				std::unique_lock scopeLock(m_Mutex);
+				if (remove_ref())
+					freeFunc();
+			}
+
+		protected:
+#if MH_COROUTINE_TASK_REGISTRY
+			static task_state get_registered_state(const task_registry_hpp::registered_task& task) noexcept
+			{
+				return static_cast<const promise_base<T>&>(task).get_task_state();
+			}
+#endif
+
+			// Any unique address that can never be a waiter_node will do
+			void* ready_state() const noexcept { return const_cast<promise_base<T>*>(this); }
+
+			static constexpr std::uint32_t WAIT_FLAG_READY = (1 << 0);
+			static constexpr std::uint32_t WAIT_FLAG_HAS_WAITERS = (1 << 1);
 
-				if (remove_ref() && final_suspend_has_run())
+			// Tasks are frequently "almost done" when someone blocks on them, so give them a moment
+			// before going to sleep
+			bool spin_until_ready() const noexcept
+			{
+				for (int i = 0; i < 64; i++)
 				{
-					scopeLock.unlock();
-					freeFunc();
+					mh::cpu_relax();
+					if (is_ready())
+						return true;
 				}
+
+				return false;
 			}
 
-		protected:
-			mutable std::condition_variable_any m_ValueReadyCV;
-			mutable mh::mutex_debug<> m_Mutex;
-			std::variant<std::vector<coro::coroutine_handle<>>, std::monostate, storage_type, std::exception_ptr> m_State;
-			std::atomic_int32_t m_RefCount = REFCOUNT_UNSET;
-			mutable bool m_FinalSuspendHasRun = false;
+			// Either a pointer to the most recently added waiter_node (nullptr if there are none), or
+			// ready_state() once m_Result has been published.
+			mutable std::atomic<void*> m_State = nullptr;
+			std::atomic_int32_t m_RefCount = 0;
+			std::atomic_flag m_IsSatisfied = ATOMIC_FLAG_INIT;
+			std::variant<std::monostate, std::monostate, storage_type, std::exception_ptr> m_Result;
+
+			// Mirrors the ready state in a futex-sized word for the blocking wait functions
+			mutable mh::futex_word m_WaitFlags = 0;
 		};
 	}
 
@@ -318,21 +455,22 @@ namespace mh
 			{
 				this->wait();
 
-				this->rethrow_if_exception();
+				// Already known to be ready, don't bother re-checking
+				if (auto ex = std::get_if<super::IDX_EXCEPTION>(std::addressof(this->m_Result)))
+					std::rethrow_exception(*ex);
 
-				return std::get<super::IDX_VALUE>(this->m_State);
+				return std::get<super::IDX_VALUE>(this->m_Result);
 			}
 
 			T* try_get_value() noexcept { return const_cast<T*>(std::as_const(*this).try_get_value()); }
 			const T* try_get_value() const noexcept
 			{
-				std::lock_guard lock(this->m_Mutex);
-				return std::get_if<super::IDX_VALUE>(std::addressof(this->m_State));
+				return this->is_ready() ? std::get_if<super::IDX_VALUE>(std::addressof(this->m_Result)) : nullptr;
 			}
 
 			void return_value(T value)
 			{
-				this->template set_state<super::IDX_VALUE>(std::move(value));
+				this->template store_result<super::IDX_VALUE>(std::move(value));
 			}
 
 			T& await_resume() { return const_cast<T&>(std::as_const(*this).get_value()); }
@@ -351,10 +489,10 @@ namespace mh
 		public:
 			void return_void()
 			{
-				this->set_state<super::IDX_VALUE>(std::monostate{});
+				this->template store_result<super::IDX_VALUE>(std::monostate{});
 			}
 
-			void await_resume()
+			void await_resume() const
 			{
 				assert(this->is_ready());
 				this->rethrow_if_exception();
@@ -364,77 +502,144 @@ namespace mh
 
 	namespace detail::task_hpp
 	{
+		// Waits on either a promise, or a ready value stored inline in the task
+		template<typename TPromise, typename TValue>
+		struct awaiter final : waiter_node, private cancellation_hpp::cancel_callback
+		{
+			explicit awaiter(TPromise& promise) noexcept : m_Promise(&promise) {}
+			explicit awaiter(TValue& readyValue) noexcept : m_ReadyValue(&readyValue) {}
+
+			bool await_ready() const { return !m_Promise || m_Promise->await_ready(); }
+
+			template<typename TParentPromise>
+			bool await_suspend(coro::coroutine_handle<TParentPromise> parent)
+			{
+				m_Handle = parent;
+
+				// Cancelling the awaiting coroutine cancels whatever it is waiting on
+				if constexpr (cancellation_hpp::is_cancellable_v<TParentPromise>)
+				{
+					m_OnCancel = &on_parent_cancelled;
+					m_ParentCancelState = &parent.promise();
+					if (!m_ParentCancelState->try_register_callback(*this))
+						m_Promise->request_cancel();
+				}
+
+				if (m_Promise->try_add_waiter(*this))
+					return true;
+
+				unregister_cancel_callback();
+				return false;
+			}
+			decltype(auto) await_resume()
+			{
+				unregister_cancel_callback();
+
+				if (m_Promise)
+					return m_Promise->await_resume();
+				else
+					return static_cast<decltype(m_Promise->await_resume())>(*m_ReadyValue);
+			}
+
+		private:
+			void unregister_cancel_callback() noexcept
+			{
+				if (m_ParentCancelState)
+					std::exchange(m_ParentCancelState, nullptr)->unregister_callback(*this);
+			}
+
+			static void on_parent_cancelled(cancellation_hpp::cancel_callback& callback) noexcept
+			{
+				static_cast<awaiter&>(callback).m_Promise->request_cancel();
+			}
+
+			TPromise* m_Promise = nullptr;
+			TValue* m_ReadyValue = nullptr;
+			const cancellation_hpp::cancellation_state* m_ParentCancelState = nullptr;
+		};
+
+		template<typename T, typename TFunc>
+		struct then_result
+		{
+			using type = std::invoke_result_t<TFunc&, const T&>;
+		};
+		template<typename TFunc>
+		struct then_result<void, TFunc>
+		{
+			using type = std::invoke_result_t<TFunc&>;
+		};
+
+		template<typename T, typename TResult, typename TExecutor, typename TFunc> class then_continuation;
+
+		enum class task_storage : uint8_t
+		{
+			promise,
+			coroutine,
+			inline_value,
+		};
+
 		template<typename T>
 		class task_base
 		{
+			using storage_type = typename co_promise_traits<T>::storage_type;
+			static constexpr bool HAS_INLINE_VALUE = is_inline_value_v<T>;
+			using inline_storage_type = std::conditional_t<HAS_INLINE_VALUE, storage_type, std::monostate>;
+
 		public:
 			using promise_type = promise<T>;
 			using coroutine_type = coro::coroutine_handle<promise_type>;
 
 			constexpr task_base() noexcept : task_base(nullptr) {}
-			explicit constexpr task_base(std::nullptr_t) noexcept : m_HandleOpt(nullptr), m_IsCoroutine(false) {}
+			explicit constexpr task_base(std::nullptr_t) noexcept : m_PromiseOpt(nullptr), m_Storage(task_storage::promise) {}
 			explicit task_base(coroutine_type state) noexcept :
 				m_HandleOpt(std::move(state)),
-				m_IsCoroutine(true)
+				m_Storage(task_storage::coroutine)
 			{
 				if (promise_type* promise = try_get_promise())
 					promise->add_ref();
 			}
 			explicit task_base(promise_type* promise) noexcept :
 				m_PromiseOpt(promise),
-				m_IsCoroutine(false)
+				m_Storage(task_storage::promise)
 			{
 				if (promise_type* promise = try_get_promise())
 					promise->add_ref();
 			}
 
-			task_base(const task_base& other) noexcept :
-				m_IsCoroutine(other.m_IsCoroutine)
+			// An already completed task, see make_ready_task()
+			template<typename... TArgs>
+			explicit task_base(inline_value_t, TArgs&&... args) :
+				m_InlineValue(std::forward<TArgs>(args)...),
+				m_Storage(task_storage::inline_value)
 			{
-				if (m_IsCoroutine)
-					m_HandleOpt = other.m_HandleOpt;
-				else
-					m_PromiseOpt = other.m_PromiseOpt;
+				static_assert(HAS_INLINE_VALUE, "This type of value cannot be stored inline in a task");
+			}
 
-				if (promise_type* promise = try_get_promise())
-					promise->add_ref();
+			task_base(const task_base& other) noexcept : m_PromiseOpt(nullptr), m_Storage(task_storage::promise)
+			{
+				copy_from(other);
 			}
 			task_base& operator=(const task_base& other) noexcept
 			{
-				release();
-
-				m_IsCoroutine = other.m_IsCoroutine;
-				if (m_IsCoroutine)
-					m_HandleOpt = other.m_HandleOpt;
-				else
-					m_PromiseOpt = other.m_PromiseOpt;
-
-				if (promise_type* promise = try_get_promise())
-					promise->add_ref();
+				if (std::addressof(other) != this)
+				{
+					release();
+					copy_from(other);
+				}
 
 				return *this;
 			}
 
-			task_base(task_base&& other) noexcept :
-				m_IsCoroutine(other.m_IsCoroutine)
+			task_base(task_base&& other) noexcept : m_PromiseOpt(nullptr), m_Storage(task_storage::promise)
 			{
 				assert(std::addressof(other) != this);
-				if (m_IsCoroutine)
-					m_HandleOpt = std::exchange(other.m_HandleOpt, nullptr);
-				else
-					m_PromiseOpt = std::exchange(other.m_PromiseOpt, nullptr);
+				move_from(other);
 			}
 			task_base& operator=(task_base&& other) noexcept
 			{
 				assert(std::addressof(other) != this);
 				release();
-
-				m_IsCoroutine = other.m_IsCoroutine;
-				if (m_IsCoroutine)
-					m_HandleOpt = std::exchange(other.m_HandleOpt, nullptr);
-				else
-					m_PromiseOpt = std::exchange(other.m_PromiseOpt, nullptr);
-
+				move_from(other);
 				return *this;
 			}
 
@@ -445,6 +650,9 @@ namespace mh
 
 			task_state state() const
 			{
+				if (has_inline_value())
+					return task_state::value;
+
 				const promise_type* promise = try_get_promise();
 				return promise ? promise->get_task_state() : task_state::empty;
 			}
@@ -452,28 +660,43 @@ namespace mh
 			operator bool() const { return valid(); }
 			[[nodiscard]] bool valid() const
 			{
+				if (has_inline_value())
+					return true;
+
 				const promise_type* promise = try_get_promise();
 				return promise ? promise->valid() : false;
 			}
 			[[nodiscard]] bool is_ready() const
 			{
+				if (has_inline_value())
+					return true;
+
 				const promise_type* promise = try_get_promise();
 				return promise ? promise->is_ready() : false;
 			}
-			[[nodiscard]] bool empty() const { return !try_get_promise(); }
+			[[nodiscard]] bool empty() const { return !has_inline_value() && !try_get_promise(); }
 
 			void wait() const
 			{
+				if (has_inline_value())
+					return;
+
 				return get_promise().wait();
 			}
 			template<typename Rep, typename Period>
 			std::future_status wait_for(const std::chrono::duration<Rep, Period>& timeout_duration) const
 			{
+				if (has_inline_value())
+					return std::future_status::ready;
+
 				return get_promise().wait_for(timeout_duration);
 			}
 			template<typename Clock, typename Period>
 			std::future_status wait_until(const std::chrono::time_point<Clock, Period>& timeout_time) const
 			{
+				if (has_inline_value())
+					return std::future_status::ready;
+
 				return get_promise().wait_until(timeout_time);
 			}
 
@@ -483,24 +706,85 @@ namespace mh
 				return promise ? promise->get_exception() : nullptr;
 			}
 
-#if 0       // operator co_await makes intellisense very unhappy
-			promise_type& operator co_await() { return get_promise(); }
-			const promise_type& operator co_await() const { return get_promise(); }
-#else
-			bool await_ready() const { return get_promise().await_ready(); }
-			bool await_suspend(coro::coroutine_handle<> parent) { return get_promise().await_suspend(parent); }
-			decltype(auto) await_resume() { return get_promise().await_resume(); }
-			decltype(auto) await_resume() const { return get_promise().await_resume(); }
-#endif
+			// Asks the task to stop early. This is cooperative: the request is passed on to whatever the
+			// task is awaiting, and cancellation-aware awaitables throw mh::task_cancelled out of the
+			// coroutine, but anything else is left to run to completion. Every copy of the task shares the
+			// same state, so this cancels it for all of them. Returns false if it had already been requested
+			// (or there is nothing to cancel).
+			bool request_cancel() const noexcept
+			{
+				const promise_type* promise = try_get_promise();
+				return promise ? promise->request_cancel() : false;
+			}
+			[[nodiscard]] bool is_cancel_requested() const noexcept
+			{
+				const promise_type* promise = try_get_promise();
+				return promise ? promise->is_cancel_requested() : false;
+			}
+
+			// Low level, for building things like when_all(). Returns false (without adding the node) if
+			// the task is already complete, otherwise the node is notified once it completes.
+			bool add_waiter(waiter_node& node) const
+			{
+				if (has_inline_value())
+					return false;
+
+				return get_promise().try_add_waiter(node);
+			}
+
+			// Calls func with the value (or nothing, for task<void>) once the task completes, and returns a
+			// task for whatever func returns. func runs on executor (anything with a post(void(*)(void*), void*),
+			// like mh::dispatcher or mh::thread_pool, which has to outlive it), and is skipped if this task
+			// fails or the returned task is cancelled first. No coroutine frame is involved: the continuation
+			// waits in this task's waiter list and is posted to the executor as a plain function. If the
+			// executor's post() throws, then() rethrows it for an already complete task, otherwise the
+			// returned task fails with it.
+			template<typename TExecutor, typename TFunc>
+			auto then(TExecutor& executor, TFunc func) const
+			{
+				using result_type = typename then_result<T, TFunc>::type;
+				return then_continuation<T, result_type, TExecutor, TFunc>::start(
+					static_cast<const task<T>&>(*this), executor, std::move(func));
+			}
+
+			// The awaiter is where the waiter_node lives, so it has to be a separate object in the
+			// awaiting coroutine's frame rather than the (possibly shared) task itself.
+			awaiter<promise_type, storage_type> operator co_await()
+			{
+				if (storage_type* value = try_get_inline_value())
+					return awaiter<promise_type, storage_type>(*value);
+
+				return awaiter<promise_type, storage_type>(get_promise());
+			}
+			awaiter<const promise_type, const storage_type> operator co_await() const
+			{
+				if (const storage_type* value = try_get_inline_value())
+					return awaiter<const promise_type, const storage_type>(*value);
+
+				return awaiter<const promise_type, const storage_type>(get_promise());
+			}
 
 		protected:
+			bool has_inline_value() const noexcept { return m_Storage == task_storage::inline_value; }
+
+			storage_type* try_get_inline_value() noexcept { return const_cast<storage_type*>(std::as_const(*this).try_get_inline_value()); }
+			const storage_type* try_get_inline_value() const noexcept
+			{
+				if constexpr (HAS_INLINE_VALUE)
+					return has_inline_value() ? std::addressof(m_InlineValue) : nullptr;
+				else
+					return nullptr;
+			}
+
 			promise_type* try_get_promise() { return const_cast<promise_type*>(std::as_const(*this).try_get_promise()); }
 			const promise_type* try_get_promise() const
 			{
-				if (m_IsCoroutine)
+				if (m_Storage == task_storage::coroutine)
 					return m_HandleOpt ? &m_HandleOpt.promise() : nullptr;
-				else
+				else if (m_Storage == task_storage::promise)
 					return m_PromiseOpt;
+				else
+					return nullptr; // Ready value stored inline, there is no promise
 			}
 			promise_type& get_promise() { return const_cast<promise_type&>(std::as_const(*this).get_promise()); }
 			const promise_type& get_promise() const
@@ -515,14 +799,15 @@ namespace mh
 			promise_type* get_promise_for_copy() { return std::as_const(*this).get_promise_for_copy(); }
 			promise_type* get_promise_for_copy() const
 			{
-				assert(!m_IsCoroutine);
-				return m_IsCoroutine ? nullptr : m_PromiseOpt;
+				assert(m_Storage == task_storage::promise);
+				return m_Storage == task_storage::promise ? m_PromiseOpt : nullptr;
 			}
 
 			void release()
 			{
-				if (m_IsCoroutine)
+				switch (m_Storage)
 				{
+				case task_storage::coroutine:
 					if (m_HandleOpt)
 					{
 						m_HandleOpt.promise().release_promise_ref([&]
@@ -532,25 +817,76 @@ namespace mh
 
 						m_HandleOpt = nullptr;
 					}
-				}
-				else if (m_PromiseOpt)
-				{
-					m_PromiseOpt->release_promise_ref([&]
-						{
-							delete m_PromiseOpt;
-						});
+					break;
 
+				case task_storage::promise:
+					if (m_PromiseOpt)
+					{
+						m_PromiseOpt->release_promise_ref([&]
+							{
+								delete m_PromiseOpt;
+							});
+
+						m_PromiseOpt = nullptr;
+					}
+					break;
+
+				case task_storage::inline_value:
+					std::destroy_at(std::addressof(m_InlineValue));
 					m_PromiseOpt = nullptr;
+					m_Storage = task_storage::promise;
+					break;
 				}
 			}
 
 		private:
+			// Expects this task to be empty
+			void copy_from(const task_base& other) noexcept
+			{
+				m_Storage = other.m_Storage;
+				switch (m_Storage)
+				{
+				case task_storage::coroutine:
+					m_HandleOpt = other.m_HandleOpt;
+					break;
+				case task_storage::promise:
+					m_PromiseOpt = other.m_PromiseOpt;
+					break;
+				case task_storage::inline_value:
+					std::construct_at(std::addressof(m_InlineValue), other.m_InlineValue);
+					return;
+				}
+
+				if (promise_type* promise = try_get_promise())
+					promise->add_ref();
+			}
+
+			// Expects this task to be empty, and leaves other empty
+			void move_from(task_base& other) noexcept
+			{
+				m_Storage = other.m_Storage;
+				switch (m_Storage)
+				{
+				case task_storage::coroutine:
+					m_HandleOpt = std::exchange(other.m_HandleOpt, nullptr);
+					break;
+				case task_storage::promise:
+					m_PromiseOpt = std::exchange(other.m_PromiseOpt, nullptr);
+					break;
+				case task_storage::inline_value:
+					std::construct_at(std::addressof(m_InlineValue), std::move(other.m_InlineValue));
+					other.release();
+					break;
+				}
+			}
+
 			union
 			{
 				coroutine_type m_HandleOpt;
 				promise_type* m_PromiseOpt;
+				inline_storage_type m_InlineValue;
 			};
-			bool m_IsCoroutine;
+			task_storage m_Storage;
 		};
 	}
 
@@ -563,11 +899,20 @@ namespace mh
 		using super::super;
 		~task() {}
 
-		const T& get() const { return this->get_promise().get_value(); }
-		T& get() { return this->get_promise().get_value(); }
+		const T& get() const
+		{
+			if (const T* value = this->try_get_inline_value())
+				return *value;
+
+			return this->get_promise().get_value();
+		}
+		T& get() { return const_cast<T&>(std::as_const(*this).get()); }
 
 		const T* try_get() const
 		{
+			if (const T* value = this->try_get_inline_value())
+				return value;
+
 			const auto promise = this->try_get_promise();
 			return promise ? promise->try_get_value() : nullptr;
 		}
@@ -584,21 +929,153 @@ namespace mh
 		~task() {}
 	};
 
+#if MH_COROUTINE_TASK_REGISTRY
+	template<typename T>
+	inline task<T> detail::task_hpp::promise_base<T>::get_return_object(const mh::source_location& location)
+	{
+		add_ref(); // Reference held by the running coroutine itself, released in final_suspend()
+		const auto handle = coro::coroutine_handle<detail::promise<T>>::from_promise(*static_cast<promise<T>*>(this));
+
+		m_GetState = &get_registered_state;
+		task_registry_hpp::register_task(*this, handle.address(), location);
+
+		return task<T>(handle);
+	}
+#else
 	template<typename T>
 	inline constexpr task<T> detail::task_hpp::promise_base<T>::get_return_object()
 	{
+		add_ref(); // Reference held by the running coroutine itself, released in final_suspend()
 		return task<T>(coro::coroutine_handle<detail::promise<T>>::from_promise(*static_cast<promise<T>*>(this)));
 	}
+#endif
+
+	namespace detail::task_hpp
+	{
+		// See task_base::then()
+		template<typename T, typename TResult, typename TExecutor, typename TFunc>
+		class then_continuation final : waiter_node, public frame_allocator_hpp::recycled_frame
+		{
+		public:
+			static task<TResult> start(const task<T>& source, TExecutor& executor, TFunc func)
+			{
+				std::unique_ptr<then_continuation> self(new then_continuation(source, executor, std::move(func)));
+
+				// Once it's waiting, the continuation can run (and be freed) at any moment. Either way,
+				// it isn't ours to free any more, unless posting it here throws.
+				task<TResult> result = self->m_Result;
+				if (!self->m_Source.add_waiter(*self))
+					self->post();
+
+				self.release();
+				return result;
+			}
+
+		private:
+			then_continuation(const task<T>& source, TExecutor& executor, TFunc&& func) :
+				m_Source(source),
+				m_Executor(executor),
+				m_Func(std::move(func)),
+				m_Promise(new promise<TResult>()),
+				m_Result(m_Promise)
+			{
+				m_OnReady = &on_ready;
+			}
+
+			void post()
+			{
+				m_Executor.post(&run, this);
+			}
+
+			decltype(auto) invoke()
+			{
+				if constexpr (std::is_void_v<T>)
+				{
+					m_Source.wait();
+					if (auto ex = m_Source.get_exception())
+						std::rethrow_exception(ex);
+
+					return std::invoke(m_Func);
+				}
+				else
+				{
+					return std::invoke(m_Func, std::as_const(m_Source).get());
+				}
+			}
+
+			static void run(void* userData)
+			{
+				using storage_type = typename co_promise_traits<TResult>::storage_type;
+
+				std::unique_ptr<then_continuation> self(static_cast<then_continuation*>(userData));
+				promise<TResult>& resultPromise = *self->m_Promise;
+
+				std::optional<storage_type> value;
+				try
+				{
+					if (resultPromise.is_cancel_requested())
+						throw task_cancelled();
+
+					if constexpr (std::is_void_v<TResult>)
+					{
+						self->invoke();
+						value.emplace();
+					}
+					else
+					{
+						value.emplace(self->invoke());
+					}
+				}
+				catch (...)
+				{
+					resultPromise.template set_state<promise_base<TResult>::IDX_EXCEPTION>(std::current_exception());
+					return;
+				}
+
+				resultPromise.template set_state<promise_base<TResult>::IDX_VALUE>(std::move(*value));
+			}
+
+			static coro::coroutine_handle<> on_ready(waiter_node& node) noexcept
+			{
+				auto& self = static_cast<then_continuation&>(node);
+				try
+				{
+					self.post();
+				}
+				catch (...)
+				{
+					// Nowhere to throw to from here, whoever is waiting on the result gets it instead
+					std::unique_ptr<then_continuation> owner(&self);
+					owner->m_Promise->template set_state<promise_base<TResult>::IDX_EXCEPTION>(std::current_exception());
+				}
+
+				return nullptr; // Nothing to resume here
+			}
+
+			task<T> m_Source;
+			TExecutor& m_Executor;
+			TFunc m_Func;
+			promise<TResult>* m_Promise;
+			task<TResult> m_Result; // Keeps m_Promise alive
+		};
+	}
 
 	template<typename T, typename... TArgs>
 	inline task<T> make_ready_task(TArgs&&... args)
 	{
-		detail::promise<T>* promise = new detail::promise<T>();
-		task<T> retVal(promise);
+		if constexpr (detail::task_hpp::is_inline_value_v<T>)
+		{
+			return task<T>(detail::task_hpp::inline_value, std::forward<TArgs>(args)...);
+		}
+		else
+		{
+			detail::promise<T>* promise = new detail::promise<T>();
+			task<T> retVal(promise);
 
-		promise->set_state<detail::promise<T>::IDX_VALUE>(T(std::forward<TArgs>(args)...));
+			promise->template set_state<detail::promise<T>::IDX_VALUE>(T(std::forward<TArgs>(args)...));
 
-		return retVal;
+			return retVal;
+		}
 	}
 }
 
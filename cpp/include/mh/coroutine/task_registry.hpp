@@ -0,0 +1,181 @@
+#pragma once
+
+#include "coroutine_include.hpp"
+
+#ifdef MH_COROUTINES_SUPPORTED
+
+#include "current_executor.hpp"
+#include "../source_location.hpp"
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#ifndef MH_STUFF_API
+#define MH_STUFF_API
+#endif
+
+// Set to 1 to keep track of every live mh::task coroutine: where it was created, how many times it has
+// been resumed, and how long it has been running since it was last resumed (see mh::get_registered_tasks()
+// and mh::task_watchdog). When 0, none of the bookkeeping is compiled in.
+#ifndef MH_COROUTINE_TASK_REGISTRY
+#define MH_COROUTINE_TASK_REGISTRY 0
+#endif
+
+#if MH_COROUTINE_TASK_REGISTRY && !(__cpp_lib_source_location >= 201907 || _MSC_VER >= 1927)
+#error MH_COROUTINE_TASK_REGISTRY requires mh::source_location::current()
+#endif
+
+namespace mh
+{
+	enum class task_state;
+
+	// A snapshot of one registered task
+	struct task_info
+	{
+		using clock_t = std::chrono::steady_clock;
+
+		const void* m_Address = nullptr; // The coroutine frame
+		mh::source_location m_Location;  // The coroutine that was called to create the task
+		task_state m_State{};
+		clock_t::time_point m_CreationTime;
+		std::uint32_t m_ResumeCount = 0; // Not counting the initial call
+
+		// If it is running right now (not suspended), when it was last resumed and what was running it at the time
+		bool m_IsRunning = false;
+		clock_t::time_point m_RunningSince;
+		const void* m_Executor = nullptr;
+	};
+
+	namespace detail::task_registry_hpp
+	{
+		using clock_t = task_info::clock_t;
+
+		// Base class of every task promise while the registry is enabled. Registered by
+		// promise_base::get_return_object(), so only actual coroutines show up.
+		struct registered_task
+		{
+			registered_task* m_RegistryPrev = nullptr;
+			registered_task* m_RegistryNext = nullptr;
+			bool m_IsRegistered = false;
+
+			mh::source_location m_Location;
+			clock_t::time_point m_CreationTime;
+			const void* m_Address = nullptr;
+			task_state (*m_GetState)(const registered_task& task) noexcept = nullptr;
+
+			std::atomic_uint32_t m_ResumeCount = 0;
+			std::atomic<clock_t::rep> m_RunningSince = 0; // 0 while suspended
+			std::atomic<const void*> m_Executor = nullptr;
+
+			void on_resume() noexcept
+			{
+				m_Executor.store(current_executor_hpp::s_CurrentExecutor.m_Executor, std::memory_order_relaxed);
+				if (m_RunningSince.exchange(clock_t::now().time_since_epoch().count(), std::memory_order_relaxed) == 0)
+					m_ResumeCount.fetch_add(1, std::memory_order_relaxed);
+			}
+			// Returns when it had been running since, for cancel_suspend()
+			clock_t::rep on_suspend() noexcept
+			{
+				return m_RunningSince.exchange(0, std::memory_order_relaxed);
+			}
+			// The awaiter declined to suspend after all (or threw), so it never stopped running
+			void cancel_suspend(clock_t::rep runningSince) noexcept
+			{
+				m_RunningSince.store(runningSince, std::memory_order_relaxed);
+			}
+		};
+
+		MH_STUFF_API void register_task(registered_task& task, const void* address, const mh::source_location& location);
+		MH_STUFF_API void unregister_task(registered_task& task) noexcept;
+
+		template<typename TAwaitable>
+		decltype(auto) get_awaiter(TAwaitable&& awaitable)
+		{
+			if constexpr (requires { std::forward<TAwaitable>(awaitable).operator co_await(); })
+				return std::forward<TAwaitable>(awaitable).operator co_await();
+			else
+				return static_cast<TAwaitable&>(awaitable);
+		}
+
+		// Wraps everything a registered coroutine co_awaits (see promise_base::await_transform()), to
+		// notice when it suspends and resumes. The awaitable itself lives until the end of the full
+		// expression containing the co_await, so it's fine to hold on to a reference to it.
+		template<typename TAwaitable>
+		class tracking_awaiter final
+		{
+			using awaiter_type = decltype(get_awaiter(std::declval<TAwaitable>()));
+
+		public:
+			tracking_awaiter(registered_task& task, TAwaitable&& awaitable) :
+				m_Task(task), m_Awaiter(get_awaiter(std::forward<TAwaitable>(awaitable)))
+			{
+			}
+
+			bool await_ready() { return m_Awaiter.await_ready(); }
+
+			// Must be marked as suspended before handing ourselves to anyone that might resume us. Once the
+			// inner await_suspend() has returned true (or anything but bool), we may already have been
+			// resumed on another thread, so this object can only be touched on the paths where we didn't suspend.
+			template<typename TPromise>
+			decltype(auto) await_suspend(coro::coroutine_handle<TPromise> parent)
+			{
+				using result_type = decltype(m_Awaiter.await_suspend(parent));
+
+				const auto runningSince = m_Task.on_suspend();
+				m_Suspended = true;
+
+				try
+				{
+					if constexpr (std::is_same_v<result_type, bool>)
+					{
+						if (!m_Awaiter.await_suspend(parent))
+						{
+							m_Suspended = false;
+							m_Task.cancel_suspend(runningSince);
+							return false;
+						}
+
+						return true;
+					}
+					else
+					{
+						return m_Awaiter.await_suspend(parent);
+					}
+				}
+				catch (...)
+				{
+					m_Suspended = false;
+					m_Task.cancel_suspend(runningSince);
+					throw;
+				}
+			}
+
+			decltype(auto) await_resume()
+			{
+				if (m_Suspended)
+					m_Task.on_resume();
+
+				return m_Awaiter.await_resume();
+			}
+
+		private:
+			registered_task& m_Task;
+			awaiter_type m_Awaiter;
+			bool m_Suspended = false;
+		};
+	}
+
+	// All the tasks currently alive, oldest first. Empty unless MH_COROUTINE_TASK_REGISTRY is enabled.
+	MH_STUFF_API std::vector<task_info> get_registered_tasks();
+}
+
+#ifndef MH_COMPILE_LIBRARY
+#include "task_registry.inl"
+#endif
+
+#endif
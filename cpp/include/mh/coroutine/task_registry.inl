@@ -0,0 +1,95 @@
+#ifdef MH_COMPILE_LIBRARY
+#include "task_registry.hpp"
+#endif
+
+#ifndef MH_COMPILE_LIBRARY_INLINE
+#define MH_COMPILE_LIBRARY_INLINE inline
+#endif
+
+#ifdef MH_COROUTINES_SUPPORTED
+
+#include <mutex>
+
+namespace mh
+{
+	namespace detail::task_registry_hpp
+	{
+		struct registry
+		{
+			std::mutex m_Mutex;
+			registered_task* m_Head = nullptr;
+			registered_task* m_Tail = nullptr;
+		};
+
+		MH_COMPILE_LIBRARY_INLINE registry& get_registry()
+		{
+			static registry s_Registry;
+			return s_Registry;
+		}
+
+		MH_COMPILE_LIBRARY_INLINE void register_task(registered_task& task, const void* address, const mh::source_location& location)
+		{
+			assert(!task.m_IsRegistered);
+			assert(task.m_GetState);
+
+			task.m_Address = address;
+			task.m_Location = location;
+			task.m_CreationTime = clock_t::now();
+
+			// Running from the moment it's called
+			task.m_RunningSince.store(task.m_CreationTime.time_since_epoch().count(), std::memory_order_relaxed);
+			task.m_Executor.store(current_executor_hpp::s_CurrentExecutor.m_Executor, std::memory_order_relaxed);
+
+			registry& reg = get_registry();
+			std::lock_guard lock(reg.m_Mutex);
+			task.m_RegistryPrev = reg.m_Tail;
+			task.m_RegistryNext = nullptr;
+			(reg.m_Tail ? reg.m_Tail->m_RegistryNext : reg.m_Head) = &task;
+			reg.m_Tail = &task;
+			task.m_IsRegistered = true;
+		}
+
+		MH_COMPILE_LIBRARY_INLINE void unregister_task(registered_task& task) noexcept
+		{
+			if (!task.m_IsRegistered)
+				return;
+
+			registry& reg = get_registry();
+			std::lock_guard lock(reg.m_Mutex);
+			(task.m_RegistryPrev ? task.m_RegistryPrev->m_RegistryNext : reg.m_Head) = task.m_RegistryNext;
+			(task.m_RegistryNext ? task.m_RegistryNext->m_RegistryPrev : reg.m_Tail) = task.m_RegistryPrev;
+			task.m_IsRegistered = false;
+		}
+	}
+
+	MH_COMPILE_LIBRARY_INLINE std::vector<task_info> get_registered_tasks()
+	{
+		std::vector<task_info> tasks;
+
+#if MH_COROUTINE_TASK_REGISTRY
+		auto& reg = detail::task_registry_hpp::get_registry();
+		std::lock_guard lock(reg.m_Mutex);
+
+		for (auto task = reg.m_Head; task; task = task->m_RegistryNext)
+		{
+			task_info& info = tasks.emplace_back();
+			info.m_Address = task->m_Address;
+			info.m_Location = task->m_Location;
+			info.m_State = task->m_GetState(*task);
+			info.m_CreationTime = task->m_CreationTime;
+			info.m_ResumeCount = task->m_ResumeCount.load(std::memory_order_relaxed);
+
+			if (const auto runningSince = task->m_RunningSince.load(std::memory_order_relaxed))
+			{
+				info.m_IsRunning = true;
+				info.m_RunningSince = task_info::clock_t::time_point(task_info::clock_t::duration(runningSince));
+				info.m_Executor = task->m_Executor.load(std::memory_order_relaxed);
+			}
+		}
+#endif
+
+		return tasks;
+	}
+}
+
+#endif
@@ -45,7 +45,8 @@ namespace mh
 		};
 	}
 
-	// Moves execution to a new thread
+	// Moves execution to a new thread. Threads are reused once whatever was running on them is done,
+	// so hopping back and forth isn't creating a new thread every time.
 	MH_STUFF_API detail::coroutine::thread_hpp::task co_create_thread();
 
 	// Only moves execution to a new thread if we're currently on the main thread
@@ -29,17 +29,103 @@ namespace mh::detail::coroutine::thread_hpp
 #endif
 
 #include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
 #include <thread>
 
 namespace mh::detail::coroutine::thread_hpp
 {
+	// Threads that finish running whatever was resumed on them hang around for a while, in case
+	// someone else wants a new thread. Past MAX_CACHED_THREADS, new threads are one-offs again.
+	class thread_cache final
+	{
+		static constexpr std::chrono::seconds IDLE_TIMEOUT{ 10 };
+		static constexpr std::size_t MAX_CACHED_THREADS = 64;
+
+	public:
+		static thread_cache& get()
+		{
+			// Intentionally leaked, cached threads may still be waiting on it during static destruction
+			static thread_cache* s_Instance = new thread_cache();
+			return *s_Instance;
+		}
+
+		void resume_on_new_thread(coro::coroutine_handle<> handle)
+		{
+			// Only decide under the lock, creating threads takes a while
+			bool isOneOff = false;
+			{
+				std::lock_guard lock(m_Mutex);
+				if (m_IdleCount > m_Queue.size())
+				{
+					m_Queue.push_back(handle);
+					m_QueueCV.notify_one();
+					return;
+				}
+
+				if (m_ThreadCount >= MAX_CACHED_THREADS)
+					isOneOff = true;
+				else
+					m_ThreadCount++;
+			}
+
+			if (isOneOff)
+			{
+				std::thread([](coro::coroutine_handle<> handle) { handle.resume(); }, handle).detach();
+				return;
+			}
+
+			try
+			{
+				std::thread(&thread_cache::ThreadFunc, this, handle).detach();
+			}
+			catch (...)
+			{
+				std::lock_guard lock(m_Mutex);
+				m_ThreadCount--;
+				throw;
+			}
+		}
+
+	private:
+		void ThreadFunc(coro::coroutine_handle<> handle)
+		{
+			while (true)
+			{
+				handle.resume();
+
+				std::unique_lock lock(m_Mutex);
+				m_IdleCount++;
+				const bool hasWork = m_QueueCV.wait_for(lock, IDLE_TIMEOUT, [&] { return !m_Queue.empty(); });
+				m_IdleCount--;
+
+				if (!hasWork)
+				{
+					m_ThreadCount--;
+					return;
+				}
+
+				handle = m_Queue.front();
+				m_Queue.pop_front();
+			}
+		}
+
+		std::mutex m_Mutex;
+		std::condition_variable m_QueueCV;
+		std::deque<coro::coroutine_handle<>> m_Queue;
+		std::size_t m_IdleCount = 0;
+		std::size_t m_ThreadCount = 0;
+	};
+
 	MH_COMPILE_LIBRARY_INLINE bool task::await_suspend(coro::coroutine_handle<> waiter)
 	{
 		if (m_Flags == co_create_thread_flags::none ||
 			(m_Flags == co_create_thread_flags::off_main_thread && is_main_thread()))
 		{
-			std::thread t([](coro::coroutine_handle<> waiter) { waiter.resume(); }, waiter);
-			t.detach();
+			thread_cache::get().resume_on_new_thread(waiter);
 
 			// always suspend
 			return true;
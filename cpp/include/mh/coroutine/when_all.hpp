@@ -0,0 +1,168 @@
+#pragma once
+
+#include "task.hpp"
+
+#ifdef MH_COROUTINES_SUPPORTED
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <iterator>
+#include <tuple>
+#include <vector>
+
+namespace mh
+{
+	namespace detail::when_all_hpp
+	{
+		class latch;
+
+		struct latch_node final : task_hpp::waiter_node
+		{
+			latch* m_Latch = nullptr;
+		};
+
+		// Counts down once for every child task, and once more for the coroutine awaiting it (so children
+		// finishing while we are still adding the rest can't resume it early). Whoever brings it to zero
+		// resumes the awaiting coroutine, so it is only resumed once no matter how many children there are.
+		class latch final
+		{
+		public:
+			explicit latch(std::size_t count) noexcept : m_Count(count + 1) {}
+
+			latch(const latch&) = delete;
+			latch& operator=(const latch&) = delete;
+
+			template<typename T>
+			void add(const task<T>& t, latch_node& node)
+			{
+				node.m_Latch = this;
+				node.m_OnReady = &on_ready;
+				if (!t.add_waiter(node))
+					count_down(); // Already complete, can never be the last one
+			}
+
+			bool await_ready() const noexcept { return m_Count.load(std::memory_order_acquire) == 1; }
+			bool await_suspend(coro::coroutine_handle<> parent) noexcept
+			{
+				m_Parent = parent;
+				return !count_down();
+			}
+			constexpr void await_resume() const noexcept {}
+
+		private:
+			bool count_down() noexcept
+			{
+				return m_Count.fetch_sub(1, std::memory_order_acq_rel) == 1;
+			}
+
+			static coro::coroutine_handle<> on_ready(task_hpp::waiter_node& node) noexcept
+			{
+				latch& self = *static_cast<latch_node&>(node).m_Latch;
+				return self.count_down() ? self.m_Parent : nullptr;
+			}
+
+			std::atomic_size_t m_Count;
+			coro::coroutine_handle<> m_Parent;
+		};
+
+		template<typename T>
+		typename task_hpp::co_promise_traits<T>::storage_type get_result(const task<T>& t)
+		{
+			if constexpr (std::is_void_v<T>)
+				return {};
+			else
+				return t.get();
+		}
+
+		template<typename T>
+		void rethrow_if_exception(const task<T>& t)
+		{
+			if (auto ex = t.get_exception())
+				std::rethrow_exception(ex);
+		}
+
+		template<typename T>
+		T task_value_type(const task<T>&);
+
+		template<typename T> struct vector_result { using type = std::vector<T>; };
+		template<> struct vector_result<void> { using type = void; };
+
+		template<typename T>
+		task<typename vector_result<T>::type> when_all_vector(std::vector<task<T>> tasks)
+		{
+			for (const auto& t : tasks)
+			{
+				if (t.empty())
+					throw std::future_error(std::future_errc::no_state);
+			}
+
+			{
+				latch waitLatch(tasks.size());
+				std::vector<latch_node> nodes(tasks.size());
+				for (size_t i = 0; i < tasks.size(); i++)
+					waitLatch.add(tasks[i], nodes[i]);
+
+				co_await cancellation_hpp::forward_cancel(waitLatch, [&tasks]
+					{
+						for (const auto& t : tasks)
+							t.request_cancel();
+					});
+			}
+
+			// Report the first exception, in the order the tasks were given to us
+			for (const auto& t : tasks)
+				rethrow_if_exception(t);
+
+			if constexpr (!std::is_void_v<T>)
+			{
+				std::vector<T> results;
+				results.reserve(tasks.size());
+				for (const auto& t : tasks)
+					results.push_back(t.get());
+
+				co_return results;
+			}
+		}
+	}
+
+	// Completes once all of the given tasks have completed, with a tuple of their results
+	// (std::monostate for task<void>). If any of them failed, rethrows the exception from the
+	// first one (in argument order) that did. Cancelling it cancels all of them.
+	template<typename... T>
+	task<std::tuple<typename detail::task_hpp::co_promise_traits<T>::storage_type...>> when_all(task<T>... tasks)
+	{
+		if ((tasks.empty() || ...))
+			throw std::future_error(std::future_errc::no_state);
+
+		{
+			detail::when_all_hpp::latch waitLatch(sizeof...(T));
+			[[maybe_unused]] std::array<detail::when_all_hpp::latch_node, sizeof...(T)> nodes;
+			[[maybe_unused]] size_t i = 0;
+			(waitLatch.add(tasks, nodes[i++]), ...);
+
+			co_await detail::cancellation_hpp::forward_cancel(waitLatch, [&] { (tasks.request_cancel(), ...); });
+		}
+
+		(detail::when_all_hpp::rethrow_if_exception(tasks), ...);
+
+		co_return std::tuple<typename detail::task_hpp::co_promise_traits<T>::storage_type...>(
+			detail::when_all_hpp::get_result(tasks)...);
+	}
+
+	// Range versions, completing with a std::vector of the results in the same order as the
+	// tasks (or mh::task<void> for void tasks).
+	template<typename TIter, typename = typename std::iterator_traits<TIter>::iterator_category>
+	auto when_all(TIter begin, TIter end)
+	{
+		using value_type = decltype(detail::when_all_hpp::task_value_type(*begin));
+		return detail::when_all_hpp::when_all_vector(std::vector<task<value_type>>(begin, end));
+	}
+	template<typename TRange>
+	auto when_all(const TRange& range) -> decltype(when_all(std::begin(range), std::end(range)))
+	{
+		return when_all(std::begin(range), std::end(range));
+	}
+}
+
+#endif
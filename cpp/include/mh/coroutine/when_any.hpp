@@ -0,0 +1,296 @@
+#pragma once
+
+#include "task.hpp"
+
+#ifdef MH_COROUTINES_SUPPORTED
+
+#include <atomic>
+#include <cstddef>
+#include <iterator>
+#include <stdexcept>
+#include <tuple>
+#include <vector>
+
+#if __has_include(<stop_token>)
+#include <stop_token>
+#endif
+
+#if __cpp_lib_jthread >= 201911L
+#define MH_WHEN_ANY_STOP_SOURCE 1
+#endif
+
+namespace mh
+{
+	namespace detail::when_any_hpp
+	{
+		// Shared between the when_any() coroutine and the node registered with every child. The children
+		// that lose can finish long after when_any() itself has, so this lives on the heap and is freed
+		// by whoever lets go of it last.
+		class state final
+		{
+		public:
+#if MH_WHEN_ANY_STOP_SOURCE
+			state(std::size_t count, std::stop_source stopSource) :
+				m_StopSource(std::move(stopSource)),
+#else
+			explicit state(std::size_t count) :
+#endif
+				m_Nodes(count),
+				m_RefCount(count + 1)
+			{
+			}
+
+			state(const state&) = delete;
+			state& operator=(const state&) = delete;
+
+			// Returns false once there is a winner, there's no point adding any more children after that
+			template<typename T>
+			bool add(const task<T>& t, std::size_t index)
+			{
+				node& n = m_Nodes[index];
+				n.m_State = this;
+				n.m_Index = index;
+				n.m_OnReady = &on_ready;
+				if (!t.add_waiter(n))
+				{
+					// Already complete. Nobody is waiting on us yet, so there's nothing to resume.
+					try_win(index);
+					release(1);
+					return false;
+				}
+
+				return !has_winner();
+			}
+
+			void release(std::size_t count) noexcept
+			{
+				if (count > 0 && m_RefCount.fetch_sub(count, std::memory_order_acq_rel) == count)
+					delete this;
+			}
+
+			bool await_ready() const noexcept { return has_winner(); }
+			bool await_suspend(coro::coroutine_handle<> parent) noexcept
+			{
+				m_Parent = parent;
+				return !open_gate();
+			}
+			std::size_t await_resume() const noexcept { return m_Winner.load(std::memory_order_acquire); }
+
+		private:
+			static constexpr std::size_t NO_WINNER = std::size_t(-1);
+
+			struct node final : task_hpp::waiter_node
+			{
+				state* m_State = nullptr;
+				std::size_t m_Index = 0;
+			};
+
+			bool has_winner() const noexcept { return m_Winner.load(std::memory_order_acquire) != NO_WINNER; }
+
+			bool try_win(std::size_t index) noexcept
+			{
+				std::size_t expected = NO_WINNER;
+				if (!m_Winner.compare_exchange_strong(expected, index, std::memory_order_acq_rel))
+					return false;
+
+#if MH_WHEN_ANY_STOP_SOURCE
+				m_StopSource.request_stop();
+#endif
+				return true;
+			}
+
+			// The awaiting coroutine can't be resumed until both it has suspended and there is a
+			// winner. Whichever of those happens second does the resuming.
+			bool open_gate() noexcept
+			{
+				return m_ResumeGate.fetch_sub(1, std::memory_order_acq_rel) == 1;
+			}
+
+			static coro::coroutine_handle<> on_ready(task_hpp::waiter_node& baseNode) noexcept
+			{
+				node& n = static_cast<node&>(baseNode);
+				state& self = *n.m_State;
+
+				coro::coroutine_handle<> continuation;
+				if (self.try_win(n.m_Index) && self.open_gate())
+					continuation = self.m_Parent;
+
+				// The awaiting coroutine still holds a reference if we are about to resume it
+				self.release(1);
+				return continuation;
+			}
+
+#if MH_WHEN_ANY_STOP_SOURCE
+			std::stop_source m_StopSource;
+#endif
+			std::vector<node> m_Nodes;
+			std::atomic_size_t m_RefCount;
+			std::atomic_size_t m_Winner = NO_WINNER;
+			std::atomic_int m_ResumeGate = 2;
+			coro::coroutine_handle<> m_Parent;
+		};
+
+		template<typename T>
+		bool add_tasks(state& s, const std::vector<task<T>>& tasks, std::size_t& added)
+		{
+			for (const auto& t : tasks)
+			{
+				if (!s.add(t, added++))
+					return false;
+			}
+
+			return true;
+		}
+		template<typename... T>
+		bool add_tasks(state& s, const std::tuple<task<T>...>& tasks, std::size_t& added)
+		{
+			return std::apply([&](const auto&... t) { return (s.add(t, added++) && ...); }, tasks);
+		}
+
+		template<typename T>
+		void cancel_tasks(const std::vector<task<T>>& tasks)
+		{
+			for (const auto& t : tasks)
+				t.request_cancel();
+		}
+		template<typename... T>
+		void cancel_tasks(const std::tuple<task<T>...>& tasks)
+		{
+			std::apply([](const auto&... t) { (t.request_cancel(), ...); }, tasks);
+		}
+
+		// Once there's a winner, nobody cares about the rest any more
+		template<typename T>
+		void cancel_losers(const std::vector<task<T>>& tasks, std::size_t winner)
+		{
+			for (std::size_t i = 0; i < tasks.size(); i++)
+			{
+				if (i != winner)
+					tasks[i].request_cancel();
+			}
+		}
+		template<typename... T>
+		void cancel_losers(const std::tuple<task<T>...>& tasks, std::size_t winner)
+		{
+			std::apply([winner](const auto&... t)
+				{
+					std::size_t i = 0;
+					((i++ != winner ? (void)t.request_cancel() : (void)0), ...);
+				}, tasks);
+		}
+
+		template<typename T>
+		std::size_t task_count(const std::vector<task<T>>& tasks) { return tasks.size(); }
+		template<typename... T>
+		constexpr std::size_t task_count(const std::tuple<task<T>...>&) { return sizeof...(T); }
+
+		template<typename T>
+		bool any_empty(const std::vector<task<T>>& tasks)
+		{
+			for (const auto& t : tasks)
+			{
+				if (t.empty())
+					return true;
+			}
+
+			return false;
+		}
+		template<typename... T>
+		bool any_empty(const std::tuple<task<T>...>& tasks)
+		{
+			return std::apply([](const auto&... t) { return (t.empty() || ...); }, tasks);
+		}
+
+		// The tasks are held in this coroutine's frame so they stay alive until we're done with them
+#if MH_WHEN_ANY_STOP_SOURCE
+		template<typename TTasks>
+		task<std::size_t> when_any_impl(TTasks tasks, std::stop_source stopSource)
+#else
+		template<typename TTasks>
+		task<std::size_t> when_any_impl(TTasks tasks)
+#endif
+		{
+			const std::size_t count = task_count(tasks);
+			if (count < 1)
+				throw std::invalid_argument("when_any() requires at least one task");
+			if (any_empty(tasks))
+				throw std::future_error(std::future_errc::no_state);
+
+#if MH_WHEN_ANY_STOP_SOURCE
+			state* s = new state(count, std::move(stopSource));
+#else
+			state* s = new state(count);
+#endif
+
+			std::size_t added = 0;
+			add_tasks(*s, tasks, added);
+			s->release(count - added); // Never going to be notified by the ones we skipped
+
+			// If we are cancelled, so is everyone we're waiting on
+			const std::size_t winner = co_await cancellation_hpp::forward_cancel(*s, [&tasks] { cancel_tasks(tasks); });
+			s->release(1);
+			cancel_losers(tasks, winner);
+			co_return winner;
+		}
+
+		template<typename T>
+		T task_value_type(const task<T>&);
+	}
+
+	// Completes as soon as any of the given tasks has completed, with the index of that task.
+	// A task that failed still counts as complete, get() it to see the exception. The others
+	// are cancelled (see task::request_cancel()), and the std::stop_source overloads can tell
+	// anything that doesn't check for that to give up too. Cancelling the returned task before
+	// there is a winner cancels all of them. A small bit of state is shared with the losers until
+	// they complete, so it is leaked if one of them never does (like a promise that is never set).
+	template<typename... T>
+	task<std::size_t> when_any(task<T>... tasks)
+	{
+		static_assert(sizeof...(T) > 0, "when_any() requires at least one task");
+#if MH_WHEN_ANY_STOP_SOURCE
+		return detail::when_any_hpp::when_any_impl(std::tuple<task<T>...>(std::move(tasks)...), std::stop_source(std::nostopstate));
+#else
+		return detail::when_any_hpp::when_any_impl(std::tuple<task<T>...>(std::move(tasks)...));
+#endif
+	}
+
+	template<typename TIter, typename = typename std::iterator_traits<TIter>::iterator_category>
+	task<std::size_t> when_any(TIter begin, TIter end)
+	{
+		using value_type = decltype(detail::when_any_hpp::task_value_type(*begin));
+#if MH_WHEN_ANY_STOP_SOURCE
+		return detail::when_any_hpp::when_any_impl(std::vector<task<value_type>>(begin, end), std::stop_source(std::nostopstate));
+#else
+		return detail::when_any_hpp::when_any_impl(std::vector<task<value_type>>(begin, end));
+#endif
+	}
+	template<typename TRange>
+	auto when_any(const TRange& range) -> decltype(when_any(std::begin(range), std::end(range)))
+	{
+		return when_any(std::begin(range), std::end(range));
+	}
+
+#if MH_WHEN_ANY_STOP_SOURCE
+	// As above, but also calls request_stop() on stopSource as soon as there is a winner, so
+	// the losers (if they are watching the matching std::stop_token) can bail out early.
+	template<typename... T>
+	task<std::size_t> when_any(std::stop_source stopSource, task<T>... tasks)
+	{
+		static_assert(sizeof...(T) > 0, "when_any() requires at least one task");
+		return detail::when_any_hpp::when_any_impl(std::tuple<task<T>...>(std::move(tasks)...), std::move(stopSource));
+	}
+	template<typename TIter, typename = typename std::iterator_traits<TIter>::iterator_category>
+	task<std::size_t> when_any(std::stop_source stopSource, TIter begin, TIter end)
+	{
+		using value_type = decltype(detail::when_any_hpp::task_value_type(*begin));
+		return detail::when_any_hpp::when_any_impl(std::vector<task<value_type>>(begin, end), std::move(stopSource));
+	}
+	template<typename TRange>
+	auto when_any(std::stop_source stopSource, const TRange& range) -> decltype(when_any(std::move(stopSource), std::begin(range), std::end(range)))
+	{
+		return when_any(std::move(stopSource), std::begin(range), std::end(range));
+	}
+#endif
+}
+
+#endif
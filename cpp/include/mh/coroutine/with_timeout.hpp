@@ -0,0 +1,267 @@
+#pragma once
+
+#include "task.hpp"
+
+#ifdef MH_COROUTINES_SUPPORTED
+
+#include "../concurrency/dispatcher.hpp"
+#include "../error/expected.hpp"
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <compare>
+#include <future>
+#include <utility>
+
+namespace mh
+{
+	// Error returned by mh::with_timeout() when the task did not complete in time
+	struct timeout final
+	{
+		constexpr bool operator==(const timeout&) const noexcept = default;
+#if (__cpp_lib_three_way_comparison >= 201907) || (_MSC_VER >= 1928)
+		constexpr auto operator<=>(const timeout&) const noexcept = default;
+#endif
+	};
+
+	template<typename T>
+	using timeout_result_t = mh::expected<typename detail::task_hpp::co_promise_traits<T>::storage_type, timeout>;
+
+	namespace detail::with_timeout_hpp
+	{
+		// Shared by the awaiter, the node waiting on the task, and the dispatcher timer. Either of the last two can
+		// outlive the awaiter (whoever loses the race is still registered somewhere), so this lives on the heap and
+		// is freed by whoever lets go of it last.
+		template<typename T>
+		class state final
+		{
+			enum class outcome
+			{
+				pending,
+				completed,
+				timed_out,
+			};
+
+		public:
+			state(task<T> t, mh::dispatcher d, dispatcher::clock_t::time_point expireTime) :
+				m_Task(std::move(t)),
+				m_Dispatcher(std::move(d))
+			{
+				m_WaiterNode.m_State = this;
+				m_WaiterNode.m_OnReady = &on_task_ready;
+				m_TimerNode.m_State = this;
+				m_TimerNode.m_ExpireTime = expireTime;
+				m_TimerNode.m_OnExpired = &on_timer_expired;
+			}
+
+			state(const state&) = delete;
+			state& operator=(const state&) = delete;
+
+			bool is_task_ready() const { return m_Task.is_ready(); }
+			const task<T>& get_task() const noexcept { return m_Task; }
+
+			// Returns false if we shouldn't suspend after all
+			bool start(coro::coroutine_handle<> parent)
+			{
+				m_Parent = parent;
+
+				// One reference each for the timer and the waiter node, taken before handing each one out,
+				// since it may be released on another thread straight away
+				m_RefCount.fetch_add(1, std::memory_order_relaxed);
+				try
+				{
+					m_Dispatcher.add_timer(m_TimerNode);
+				}
+				catch (...)
+				{
+					release(); // Never registered, and the awaiter still holds its own reference
+					throw;
+				}
+
+				m_RefCount.fetch_add(1, std::memory_order_relaxed);
+				if (!m_Task.add_waiter(m_WaiterNode))
+				{
+					release(); // The waiter node was never registered
+
+					// Finished in the meantime, nobody else is going to resume us
+					if (try_finish(outcome::completed))
+					{
+						cancel_timer();
+						return false;
+					}
+
+					// ...unless the timer beat us to it
+				}
+
+				return !open_gate();
+			}
+
+			// Only called once, by the awaiter, so the value is moved out rather than copied
+			timeout_result_t<T> get_result()
+			{
+				if (m_Outcome.load(std::memory_order_acquire) == outcome::timed_out)
+					return timeout_result_t<T>(mh::unexpect, timeout{});
+
+				if constexpr (std::is_void_v<T>)
+				{
+					if (auto ex = m_Task.get_exception())
+						std::rethrow_exception(ex);
+
+					return timeout_result_t<T>(mh::expect, std::monostate{});
+				}
+				else
+				{
+					return timeout_result_t<T>(mh::expect, std::move(m_Task.get()));
+				}
+			}
+
+			void release() noexcept
+			{
+				if (m_RefCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+					delete this;
+			}
+
+		private:
+			struct waiter_node final : task_hpp::waiter_node
+			{
+				state* m_State = nullptr;
+			};
+			struct timer_node final : dispatcher::timer_node_t
+			{
+				state* m_State = nullptr;
+			};
+
+			bool try_finish(outcome result) noexcept
+			{
+				outcome pending = outcome::pending;
+				return m_Outcome.compare_exchange_strong(pending, result, std::memory_order_acq_rel);
+			}
+
+			// The awaiting coroutine can't be resumed until both it has suspended and we know the outcome.
+			// Whichever of those happens second does the resuming.
+			bool open_gate() noexcept
+			{
+				return m_ResumeGate.fetch_sub(1, std::memory_order_acq_rel) == 1;
+			}
+
+			void cancel_timer() noexcept
+			{
+				// If this fails, the timer has already fired and will drop its own reference
+				if (m_Dispatcher.remove_timer(m_TimerNode))
+					release();
+			}
+
+			static coro::coroutine_handle<> on_task_ready(task_hpp::waiter_node& node) noexcept
+			{
+				state& self = *static_cast<waiter_node&>(node).m_State;
+
+				coro::coroutine_handle<> continuation;
+				if (self.try_finish(outcome::completed))
+				{
+					self.cancel_timer();
+					if (self.open_gate())
+						continuation = self.m_Parent;
+				}
+
+				// The awaiter still holds a reference if we are about to resume it
+				self.release();
+				return continuation;
+			}
+
+			static coro::coroutine_handle<> on_timer_expired(dispatcher::timer_node_t& node) noexcept
+			{
+				state& self = *static_cast<timer_node&>(node).m_State;
+
+				// If we win, the waiter node stays registered with the task until it completes
+				coro::coroutine_handle<> continuation;
+				if (self.try_finish(outcome::timed_out) && self.open_gate())
+					continuation = self.m_Parent;
+
+				self.release();
+				return continuation;
+			}
+
+			task<T> m_Task;
+			mh::dispatcher m_Dispatcher;
+			waiter_node m_WaiterNode;
+			timer_node m_TimerNode;
+			coro::coroutine_handle<> m_Parent;
+			std::atomic<outcome> m_Outcome = outcome::pending;
+			std::atomic_int m_ResumeGate = 2;
+			std::atomic_int m_RefCount = 1; // The awaiter
+		};
+
+		template<typename T>
+		class [[nodiscard]] awaiter final
+		{
+		public:
+			awaiter(task<T> t, mh::dispatcher d, dispatcher::clock_t::time_point expireTime) :
+				m_State(new state<T>(std::move(t), std::move(d), expireTime))
+			{
+			}
+			awaiter(awaiter&& other) noexcept : m_State(std::exchange(other.m_State, nullptr)) {}
+			awaiter& operator=(awaiter&&) = delete;
+			~awaiter()
+			{
+				if (m_State)
+					m_State->release();
+			}
+
+			// Already complete tasks never touch the timer at all
+			bool await_ready() const { return m_State->is_task_ready(); }
+
+			template<typename TPromise>
+			bool await_suspend(coro::coroutine_handle<TPromise> parent)
+			{
+				// Cancelling the awaiting coroutine cancels the task, which then completes (probably with
+				// mh::task_cancelled) well before the timeout
+				m_CancelForwarder.start(parent, m_State->get_task());
+				try
+				{
+					if (m_State->start(parent))
+						return true;
+				}
+				catch (...)
+				{
+					m_CancelForwarder.stop();
+					throw;
+				}
+
+				m_CancelForwarder.stop();
+				return false;
+			}
+			timeout_result_t<T> await_resume()
+			{
+				m_CancelForwarder.stop();
+				return m_State->get_result();
+			}
+
+		private:
+			state<T>* m_State;
+			cancellation_hpp::cancel_forwarder<task<T>> m_CancelForwarder;
+		};
+	}
+
+	// co_await this to wait for t, but give up once timeoutDuration has passed. The result is either
+	// the task's value (exceptions from the task are rethrown), or mh::timeout. Giving up does not
+	// stop the task itself, but cancelling the awaiting coroutine cancels t. The value is moved out of
+	// t, so it works for move-only types, but anyone else holding a copy of t sees what's left behind.
+	//
+	// The timer is registered with the given dispatcher, which is also where the awaiting coroutine is
+	// resumed if it times out. If the task completes first, the timer is removed from the dispatcher
+	// straight away.
+	template<typename T, typename TRep, typename TPeriod>
+	detail::with_timeout_hpp::awaiter<T> with_timeout(task<T> t,
+		std::chrono::duration<TRep, TPeriod> timeoutDuration, mh::dispatcher& dispatcher)
+	{
+		if (t.empty())
+			throw std::future_error(std::future_errc::no_state);
+
+		using clock_t = mh::dispatcher::clock_t;
+		return detail::with_timeout_hpp::awaiter<T>(std::move(t), dispatcher,
+			clock_t::now() + std::chrono::duration_cast<clock_t::duration>(timeoutDuration));
+	}
+}
+
+#endif
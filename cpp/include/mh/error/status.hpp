@@ -1,13 +1,28 @@
 #pragma once
 
+#include <mh/concurrency/fast_mutex.hpp>
+
+#if __has_include(<mh/coroutine/coroutine_include.hpp>)
+#include <mh/coroutine/coroutine_include.hpp>
+#endif
+
+#ifdef MH_COROUTINES_SUPPORTED
+#include <mh/coroutine/cancellation.hpp>
+#include <mh/coroutine/current_executor.hpp>
+#endif
+
 #if __has_include(<compare>)
 #include <compare>
 #endif
 
+#include <atomic>
+#include <cstdint>
 #include <memory>
 #include <mutex>
 #include <string>
+#include <string_view>
 #include <type_traits>
+#include <utility>
 
 namespace mh
 {
@@ -16,6 +31,8 @@ namespace mh
 		template<typename TStatusObj>
 		class status_base
 		{
+			struct SharedData;
+
 		public:
 			using status_obj_type = TStatusObj;
 
@@ -32,56 +49,212 @@ namespace mh
 				std::string m_Message;
 			};
 
-			bool operator==(const status_base& other) const { return m_SharedData == other.m_SharedData; }
+			// Versions start at 0 (never set), and go up by one every time set() changes something
+			struct versioned_value_type : value_type
+			{
+				std::uint64_t m_Version = 0;
+			};
 
-		protected:
-			// Returns true if changed
-			bool set(status_obj_type status, const std::string_view& msg = "")
+			// A read-only view of the status at the time it was taken, without copying it. Keeps that
+			// version alive, and can be released (or handed to another thread) like any other shared_ptr.
+			using snapshot = std::shared_ptr<const versioned_value_type>;
+
+#ifdef MH_COROUTINES_SUPPORTED
+			// Cancellation-aware, see mh::task::request_cancel()
+			class [[nodiscard]] changed_awaiter final : detail::cancellation_hpp::cancel_callback
 			{
-				std::lock_guard lock(m_SharedData->m_Mutex);
+			public:
+				changed_awaiter(std::shared_ptr<SharedData> sharedData, std::uint64_t lastVersion) noexcept :
+					m_SharedData(std::move(sharedData)), m_LastVersion(lastVersion)
+				{
+					m_OnCancel = &on_cancelled;
+				}
 
-				value_type& value = m_SharedData->m_Value;
+				bool await_ready() const noexcept
+				{
+					return m_SharedData->load_value()->m_Version != m_LastVersion;
+				}
 
-				bool changed = false;
-				if (value.m_Status != status)
+				template<typename TPromise>
+				bool await_suspend(detail::coro::coroutine_handle<TPromise> parent)
 				{
-					changed = true;
-					value.m_Status = status;
+					if constexpr (detail::cancellation_hpp::is_cancellable_v<TPromise>)
+					{
+						m_CancelState = &parent.promise();
+						if (!m_CancelState->try_register_callback(*this))
+						{
+							m_IsCancelled = true;
+							return false;
+						}
+					}
+
+					m_Handle = parent;
+
+					// set() publishes and collects the waiters under the same lock, so we either see the
+					// new version here or get woken up by it
+					std::lock_guard lock(m_SharedData->m_Mutex);
+					if (m_SharedData->load_value()->m_Version != m_LastVersion)
+						return false;
+
+					// Checked under the lock too, so on_cancelled() can't miss us
+					if (m_CancelState && m_CancelState->is_cancel_requested())
+					{
+						m_IsCancelled = true;
+						return false;
+					}
+
+					changed_awaiter*& head = m_SharedData->m_Waiters;
+					m_Next = std::exchange(head, this);
+					if (m_Next)
+						m_Next->m_Prev = this;
+
+					m_IsQueued = true;
+					return true;
 				}
 
-				if (value.m_Message != msg)
+				void await_resume()
 				{
-					changed = true;
-					value.m_Message = msg;
+					if (m_CancelState)
+						std::exchange(m_CancelState, nullptr)->unregister_callback(*this);
+
+					if (m_IsCancelled)
+						throw mh::task_cancelled();
 				}
 
-				if (changed)
-					m_SharedData->m_HasValue = true;
+			private:
+				friend class status_base;
 
-				return changed;
-			}
+				static void on_cancelled(detail::cancellation_hpp::cancel_callback& callback) noexcept
+				{
+					auto& self = static_cast<changed_awaiter&>(callback);
+
+					{
+						// Once the version has moved on, set() has already taken the whole list and will
+						// resume us itself. If we aren't queued yet, await_suspend() will notice instead.
+						std::lock_guard lock(self.m_SharedData->m_Mutex);
+						if (!self.m_IsQueued || self.m_SharedData->load_value()->m_Version != self.m_LastVersion)
+							return;
+
+						(self.m_Prev ? self.m_Prev->m_Next : self.m_SharedData->m_Waiters) = self.m_Next;
+						if (self.m_Next)
+							self.m_Next->m_Prev = self.m_Prev;
+
+						self.m_IsCancelled = true;
+					}
+
+					detail::current_executor_hpp::schedule_or_resume(self.m_Handle);
+				}
+
+				std::shared_ptr<SharedData> m_SharedData;
+				std::uint64_t m_LastVersion;
+				changed_awaiter* m_Prev = nullptr;
+				changed_awaiter* m_Next = nullptr;
+				detail::coro::coroutine_handle<> m_Handle;
+				const detail::cancellation_hpp::cancellation_state* m_CancelState = nullptr;
+				bool m_IsQueued = false;
+				bool m_IsCancelled = false;
+			};
+#endif
+
+			bool operator==(const status_base& other) const { return m_SharedData == other.m_SharedData; }
 
-			bool has_value() const
+		protected:
+			// Returns true if changed
+			bool set(status_obj_type status, const std::string_view& msg = "")
 			{
-				std::lock_guard lock(m_SharedData->m_Mutex);
-				return m_SharedData->m_HasValue;
+				// Whoever lets go of the old value last frees it, which shouldn't be us while holding the lock
+				snapshot previous;
+#ifdef MH_COROUTINES_SUPPORTED
+				changed_awaiter* waiters = nullptr;
+#endif
+
+				{
+					std::lock_guard lock(m_SharedData->m_Mutex);
+
+					const snapshot current = m_SharedData->load_value();
+					if (current->m_Status == status && current->m_Message == msg)
+						return false;
+
+					const std::uint64_t newVersion = current->m_Version + 1;
+					previous = m_SharedData->exchange_value(std::make_shared<const versioned_value_type>(
+						versioned_value_type{ { std::move(status), std::string(msg) }, newVersion }));
+
+#ifdef MH_COROUTINES_SUPPORTED
+					waiters = std::exchange(m_SharedData->m_Waiters, nullptr);
+#endif
+				}
+
+#ifdef MH_COROUTINES_SUPPORTED
+				resume_waiters(waiters);
+#endif
+				return true;
 			}
 
-			value_type get() const
+			bool has_value() const { return version() != 0; }
+
+			value_type get() const { return *get_snapshot(); }
+
+			// Never waits for set(), even while someone is in the middle of one
+			snapshot get_snapshot() const { return m_SharedData->load_value(); }
+			std::uint64_t version() const { return get_snapshot()->m_Version; }
+
+#ifdef MH_COROUTINES_SUPPORTED
+			// co_await co_changed(lastVersion) suspends until the version is no longer lastVersion (not at all,
+			// if it already isn't). Resumed on the thread that called set(), or scheduled on its current
+			// executor if it has one. Throws mh::task_cancelled if the awaiting task is cancelled while
+			// it waits.
+			changed_awaiter co_changed(std::uint64_t lastVersion) const
 			{
-				std::lock_guard lock(m_SharedData->m_Mutex);
-				return m_SharedData->m_Value;
+				return changed_awaiter(m_SharedData, lastVersion);
 			}
+#endif
 
 		private:
 			struct SharedData
 			{
-				mutable std::mutex m_Mutex;
-				value_type m_Value;
-				bool m_HasValue = false;
+				mutable mh::fast_mutex m_Mutex; // Only for writers, and waiters about to go to sleep or leaving early
+
+#if __cpp_lib_atomic_shared_ptr >= 201711L
+				std::atomic<snapshot> m_Value{ std::make_shared<const versioned_value_type>() };
+
+				snapshot load_value() const noexcept { return m_Value.load(std::memory_order_acquire); }
+				snapshot exchange_value(snapshot value) noexcept { return m_Value.exchange(std::move(value), std::memory_order_acq_rel); }
+#else
+				snapshot m_Value = std::make_shared<const versioned_value_type>();
+
+				snapshot load_value() const noexcept { return std::atomic_load_explicit(&m_Value, std::memory_order_acquire); }
+				snapshot exchange_value(snapshot value) noexcept { return std::atomic_exchange_explicit(&m_Value, std::move(value), std::memory_order_acq_rel); }
+#endif
+
+#ifdef MH_COROUTINES_SUPPORTED
+				changed_awaiter* m_Waiters = nullptr; // Most recent first, doubly linked so cancelled ones can leave
+#endif
 			};
 			std::shared_ptr<SharedData> m_SharedData = std::make_shared<SharedData>();
 
+#ifdef MH_COROUTINES_SUPPORTED
+			static void resume_waiters(changed_awaiter* waiter)
+			{
+				// Reverse them to wake them up in the order they arrived
+				changed_awaiter* ordered = nullptr;
+				while (waiter)
+				{
+					auto next = waiter->m_Next;
+					waiter->m_Next = ordered;
+					ordered = waiter;
+					waiter = next;
+				}
+
+				while (ordered)
+				{
+					// Once resumed, the awaiter may be gone
+					auto next = ordered->m_Next;
+					detail::current_executor_hpp::schedule_or_resume(ordered->m_Handle);
+					ordered = next;
+				}
+			}
+#endif
+
 		protected:
 			status_base() = default;
 			explicit status_base(status_obj_type code, std::string msg = {})
@@ -123,6 +296,12 @@ namespace mh
 
 		using status_base::get;
 		using status_base::has_value;
+
+		using status_base::get_snapshot;
+		using status_base::version;
+#ifdef MH_COROUTINES_SUPPORTED
+		using status_base::co_changed;
+#endif
 	};
 
 	template<typename TStatusObj>
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <mh/concurrency/fast_mutex.hpp>
+
 #include <chrono>
 #include <mutex>
 
@@ -108,7 +110,7 @@ namespace mh
 		}
 
 	private:
-		mutable std::mutex m_Mutex;
+		mutable mh::fast_mutex m_Mutex;
 	};
 
 	template<bool threadSafe = true, typename TUpdateFunc = void, typename TClock = detail::cached_variable_hpp::default_clock, typename... TArgs>
@@ -2,6 +2,7 @@
 
 #include <initializer_list>
 #include <locale>
+#include <memory>
 #include <string>
 #include <string_view>
 #include <type_traits>
@@ -176,23 +177,53 @@ namespace mh
 #ifdef MH_COROUTINES_SUPPORTED
 namespace mh
 {
-	template<typename CharT, typename Traits>
-	[[nodiscard]] mh::generator<std::basic_string_view<CharT, Traits>> split_string(
-		const std::basic_string_view<CharT, Traits>& string, const std::basic_string_view<CharT, Traits>& splitChars)
+	namespace detail::stringops_hpp
 	{
-		size_t lastEnd = 0;
-		while (lastEnd != string.npos)
+		// The one copy of the loop. TAllocArgs is either empty, or std::allocator_arg_t and the allocator
+		// (given explicitly, since the pack comes first), which picks the generator's frame allocator.
+		template<typename CharT, typename Traits, typename... TAllocArgs>
+		mh::generator<std::basic_string_view<CharT, Traits>> split_string_impl(TAllocArgs...,
+			std::basic_string_view<CharT, Traits> string, std::basic_string_view<CharT, Traits> splitChars)
 		{
-			const size_t found = string.find_first_of(splitChars, lastEnd);
-			co_yield string.substr(lastEnd, found - lastEnd);
-			lastEnd = found;
+			size_t lastEnd = 0;
+			while (lastEnd != string.npos)
+			{
+				const size_t found = string.find_first_of(splitChars, lastEnd);
+				co_yield string.substr(lastEnd, found - lastEnd);
+				lastEnd = (found == string.npos) ? found : found + 1;
+			}
 		}
 	}
 
+	// The views are copied into the generator's frame, but the characters they refer to must outlive the generator
+	template<typename CharT, typename Traits>
+	[[nodiscard]] mh::generator<std::basic_string_view<CharT, Traits>> split_string(
+		std::basic_string_view<CharT, Traits> string, std::basic_string_view<CharT, Traits> splitChars)
+	{
+		return detail::stringops_hpp::split_string_impl<CharT, Traits>(string, splitChars);
+	}
+
+	// Same again, with the generator's frame allocated from alloc
+	template<typename TAlloc, typename CharT, typename Traits>
+	[[nodiscard]] mh::generator<std::basic_string_view<CharT, Traits>> split_string(std::allocator_arg_t, const TAlloc& alloc,
+		std::basic_string_view<CharT, Traits> string, std::basic_string_view<CharT, Traits> splitChars)
+	{
+		return detail::stringops_hpp::split_string_impl<CharT, Traits, std::allocator_arg_t, const TAlloc&>(
+			std::allocator_arg, alloc, string, splitChars);
+	}
+
+	template<typename TAlloc, typename TStr1, typename TStr2>
+	[[nodiscard]] auto split_string(std::allocator_arg_t, const TAlloc& alloc, const TStr1& string, const TStr2& splitChars)
+	{
+		using view_type = detail::stringops_hpp::string_view_type_t<TStr1>;
+		return split_string(std::allocator_arg, alloc, view_type(string), view_type(splitChars));
+	}
+
 	template<typename TStr1, typename TStr2>
 	[[nodiscard]] auto split_string(const TStr1& string, const TStr2& splitChars)
 	{
-		return split_string(std::basic_string_view(string), std::basic_string_view(splitChars));
+		using view_type = detail::stringops_hpp::string_view_type_t<TStr1>;
+		return split_string(view_type(string), view_type(splitChars));
 	}
 }
 #endif
@@ -0,0 +1,35 @@
+#include "mh/concurrency/async.hpp"
+
+#ifdef MH_COROUTINES_SUPPORTED
+
+#include <catch2/catch.hpp>
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST_CASE("async")
+{
+	// Goes to the default thread pool
+	auto onPool = mh::async([](int a, std::string b) { return std::to_string(a) + b; }, 5, "x");
+	REQUIRE(onPool.get() == "5x");
+
+	const auto mainThread = std::this_thread::get_id();
+	std::vector<mh::future<std::thread::id>> futures;
+	for (int i = 0; i < 100; i++)
+		futures.push_back(mh::async([] { return std::this_thread::get_id(); }));
+
+	for (auto& future : futures)
+		REQUIRE(future.get() != mainThread);
+
+	// Arguments are moved in, results moved out
+	auto moved = mh::async(mh::launch::thread, [](std::unique_ptr<int> ptr) { return ptr; }, std::make_unique<int>(6));
+	REQUIRE(*moved.get() == 6);
+
+	auto throws = mh::async([]() -> int { throw std::runtime_error("oops"); });
+	REQUIRE_THROWS_AS(throws.get(), std::runtime_error);
+}
+
+#endif
@@ -0,0 +1,51 @@
+#include "mh/concurrency/fast_mutex.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <mutex>
+#include <thread>
+#include <vector>
+
+TEST_CASE("fast_mutex")
+{
+	mh::fast_mutex mutex;
+
+	REQUIRE(mutex.try_lock());
+	REQUIRE(!mutex.try_lock());
+	mutex.unlock();
+
+	{
+		std::lock_guard lock(mutex);
+		REQUIRE(!mutex.try_lock());
+	}
+	REQUIRE(mutex.try_lock());
+	mutex.unlock();
+
+	// Enough contention to end up asleep in the kernel, and not just spinning
+	constexpr int THREAD_COUNT = 8;
+	constexpr int ITERATIONS = 100'000;
+	int counter = 0;
+
+	std::vector<std::thread> threads;
+	for (int i = 0; i < THREAD_COUNT; i++)
+	{
+		threads.emplace_back([&]
+			{
+				for (int j = 0; j < ITERATIONS; j++)
+				{
+					std::lock_guard lock(mutex);
+					counter++;
+
+					if ((j % 1000) == 0)
+						std::this_thread::yield(); // Hold it for a while every now and then
+				}
+			});
+	}
+
+	for (auto& thread : threads)
+		thread.join();
+
+	REQUIRE(counter == THREAD_COUNT * ITERATIONS);
+	REQUIRE(mutex.try_lock());
+	mutex.unlock();
+}
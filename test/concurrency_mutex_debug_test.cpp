@@ -0,0 +1,90 @@
+// Always test the profiling side of things, it's the only part with any real logic
+#ifndef MH_MUTEX_DEBUG_PROFILING
+#define MH_MUTEX_DEBUG_PROFILING 1
+#endif
+
+#include "mh/concurrency/mutex_debug.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <numeric>
+#include <sstream>
+#include <string_view>
+#include <thread>
+
+using namespace std::chrono_literals;
+
+namespace
+{
+	struct guarded_counter
+	{
+		mh::mutex_debug<> m_Mutex;
+		int m_Value = 0;
+	};
+
+	const mh::mutex_profile* find_profile(const std::vector<mh::mutex_profile>& profiles, std::string_view functionName)
+	{
+		auto found = std::find_if(profiles.begin(), profiles.end(), [&](const mh::mutex_profile& profile)
+			{
+				return std::string_view(profile.m_Location.function_name()).find(functionName) != std::string_view::npos;
+			});
+
+		return found != profiles.end() ? &*found : nullptr;
+	}
+}
+
+TEST_CASE("mutex_debug - profiling")
+{
+	mh::reset_mutex_profiles();
+
+	guarded_counter counter;
+	{
+		std::lock_guard lock(counter.m_Mutex);
+		counter.m_Value++;
+	}
+
+	// Held while someone else is waiting on it
+	std::thread other;
+	{
+		auto lock = counter.m_Mutex.make_lock();
+		other = std::thread([&]
+			{
+				counter.m_Mutex.lock();
+				counter.m_Value++;
+				counter.m_Mutex.unlock();
+			});
+
+		std::this_thread::sleep_for(50ms);
+	}
+
+	other.join();
+	REQUIRE(counter.m_Value == 2);
+
+	const auto profiles = mh::get_mutex_profiles();
+	const mh::mutex_profile* profile = find_profile(profiles, "guarded_counter");
+	REQUIRE(profile);
+	REQUIRE(profile->m_AcquireCount == 3);
+	REQUIRE(profile->m_ContendedCount == 1);
+	REQUIRE(profile->m_TotalWaitTime >= 25ms);
+	REQUIRE(profile->m_TotalHoldTime >= 25ms);
+	REQUIRE(std::accumulate(profile->m_WaitTimes.begin(), profile->m_WaitTimes.end(), std::uint64_t(0)) == 1);
+	REQUIRE(std::accumulate(profile->m_HoldTimes.begin(), profile->m_HoldTimes.end(), std::uint64_t(0)) == 3);
+
+	// Blamed on the thread that had to wait
+	REQUIRE(profile->m_ContendedSites.size() == 1);
+	REQUIRE(profile->m_ContendedSites[0].m_ContendedCount == 1);
+	REQUIRE(std::string_view(profile->m_ContendedSites[0].m_Location.function_name()).find("lambda") != std::string_view::npos);
+
+	std::ostringstream report;
+	mh::write_mutex_profile_report(report);
+	REQUIRE(report.str().find("contended 1 times") != std::string::npos);
+
+	mh::reset_mutex_profiles();
+	const auto resetProfiles = mh::get_mutex_profiles();
+	profile = find_profile(resetProfiles, "guarded_counter");
+	REQUIRE(profile);
+	REQUIRE(profile->m_AcquireCount == 0);
+	REQUIRE(profile->m_ContendedSites.empty());
+}
@@ -0,0 +1,127 @@
+#include "mh/concurrency/parallel_map.hpp"
+
+#ifdef MH_COROUTINES_SUPPORTED
+
+#include <catch2/catch.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+namespace
+{
+	mh::generator<int> count_to(int count, std::atomic_int& producedCount)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			producedCount++;
+			co_yield i;
+		}
+	}
+}
+
+TEST_CASE("parallel_map")
+{
+	mh::thread_pool pool(4);
+	std::atomic_int producedCount = 0;
+	std::atomic_int runningCount = 0;
+	std::atomic_int maxRunningCount = 0;
+
+	auto results = mh::parallel_map(count_to(100, producedCount), pool, [&](int value)
+		{
+			const int running = ++runningCount;
+			for (int max = maxRunningCount; running > max && !maxRunningCount.compare_exchange_weak(max, running); )
+				;
+
+			// Later elements finish first, but still come out in order
+			std::this_thread::sleep_for(std::chrono::microseconds((100 - value) * 10));
+			runningCount--;
+			return std::to_string(value * 2);
+		}, 8);
+
+	int expected = 0;
+	for (const std::string& result : results)
+	{
+		REQUIRE(result == std::to_string(expected * 2));
+		expected++;
+
+		// Never gets too far ahead of us
+		REQUIRE(producedCount <= expected + 8);
+	}
+
+	REQUIRE(expected == 100);
+	REQUIRE(maxRunningCount <= 4);
+
+	REQUIRE_THROWS_AS(mh::parallel_map(std::vector<int>{}, pool, [](int i) { return i; }, 0), std::invalid_argument);
+}
+
+TEST_CASE("parallel_map - exceptions and stopping early")
+{
+	mh::thread_pool pool(2);
+	std::atomic_int calledCount = 0;
+
+	const std::vector<int> input{ 1, 2, 3, 4, 5, 6 };
+	auto results = mh::parallel_map(input, pool, [&](int value)
+		{
+			calledCount++;
+			if (value == 3)
+				throw std::runtime_error("3");
+
+			return value;
+		});
+
+	auto it = results.begin();
+	REQUIRE(*it == 1);
+	++it;
+	REQUIRE(*it == 2);
+	REQUIRE_THROWS_AS(++it, std::runtime_error);
+
+	{
+		// Everything that was started is waited for, so func can't be called after it's gone
+		auto partial = mh::parallel_map(input, pool, [&](int value)
+			{
+				std::this_thread::sleep_for(10ms);
+				return value;
+			}, 4);
+
+		REQUIRE(*partial.begin() == 1);
+	}
+}
+
+TEST_CASE("parallel_map - queued work is skipped after stopping early")
+{
+	constexpr size_t MAX_IN_FLIGHT = 8;
+
+	mh::thread_pool pool(2);
+	std::atomic_int producedCount = 0;
+	std::atomic_int calledCount = 0;
+	int calledCountAtBreak = 0;
+
+	{
+		auto results = mh::parallel_map(count_to(100, producedCount), pool, [&](int value)
+			{
+				calledCount++;
+				std::this_thread::sleep_for(20ms);
+				return value;
+			}, MAX_IN_FLIGHT);
+
+		for (int result : results)
+		{
+			REQUIRE(result == 0);
+			calledCountAtBreak = calledCount;
+			break;
+		}
+	}
+
+	// At most one more call per thread gets started before the rest of the queue is cancelled
+	const int calledAfterBreak = calledCount - calledCountAtBreak;
+	REQUIRE(calledAfterBreak <= int(pool.thread_count()));
+	REQUIRE(calledAfterBreak < int(MAX_IN_FLIGHT));
+}
+
+#endif
@@ -0,0 +1,108 @@
+#include "mh/concurrency/rcu_value.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	std::atomic_int s_LiveCount = 0;
+
+	struct tracked
+	{
+		tracked(int value) : m_Values(16, value) { s_LiveCount++; }
+		tracked(const tracked& other) : m_Values(other.m_Values) { s_LiveCount++; }
+		~tracked() { s_LiveCount--; }
+
+		std::vector<int> m_Values;
+	};
+}
+
+TEST_CASE("rcu_value")
+{
+	{
+		mh::rcu_value<tracked> value(tracked(1));
+		REQUIRE(s_LiveCount == 1);
+
+		{
+			auto snapshot = value.get();
+			REQUIRE(snapshot->m_Values[0] == 1);
+
+			value.set(tracked(2));
+			value.update([](tracked& t) { t.m_Values[0] = 3; });
+
+			// Still looking at the old one
+			REQUIRE(snapshot->m_Values[0] == 1);
+			REQUIRE(value.get()->m_Values[0] == 3);
+			REQUIRE(value.get()->m_Values[1] == 2);
+			REQUIRE(s_LiveCount >= 2);
+		}
+
+		// Nobody is reading anymore, the next write cleans up everything replaced so far
+		value.set(tracked(4));
+		REQUIRE(s_LiveCount == 1);
+	}
+
+	REQUIRE(s_LiveCount == 0);
+}
+
+TEST_CASE("rcu_value - concurrent readers")
+{
+	mh::rcu_value<std::vector<int>> value(std::vector<int>(64, 0));
+	std::atomic_bool isDone = false;
+	std::atomic_int inconsistentCount = 0;
+
+	std::vector<std::thread> readers;
+	for (int i = 0; i < 3; i++)
+	{
+		readers.emplace_back([&]
+			{
+				while (!isDone)
+				{
+					auto snapshot = value.get();
+					auto nested = value.get();
+					for (int element : *snapshot)
+					{
+						if (element != snapshot->front())
+							inconsistentCount++;
+					}
+				}
+			});
+	}
+
+	for (int i = 1; i <= 20'000; i++)
+		value.set(std::vector<int>(64, i));
+
+	isDone = true;
+	for (auto& reader : readers)
+		reader.join();
+
+	REQUIRE(inconsistentCount == 0);
+	REQUIRE(value.get()->back() == 20'000);
+}
+
+TEST_CASE("rcu_value - threads come and go")
+{
+	{
+		mh::rcu_value<tracked> value(tracked(1));
+
+		// Each thread's record is handed on to the next one, and must not still look like it's reading
+		for (int i = 0; i < 4; i++)
+		{
+			std::thread([&]
+				{
+					auto snapshot = value.get();
+					auto nested = value.get();
+					REQUIRE(nested->m_Values[0] == snapshot->m_Values[0]);
+				}).join();
+
+			value.set(tracked(i + 2));
+			REQUIRE(s_LiveCount == 1);
+		}
+	}
+
+	REQUIRE(s_LiveCount == 0);
+}
@@ -0,0 +1,57 @@
+#include "mh/concurrency/seqlock_value.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	struct triple
+	{
+		std::uint64_t m_A;
+		std::uint64_t m_B;
+		std::uint32_t m_C;
+	};
+}
+
+TEST_CASE("seqlock_value")
+{
+	mh::seqlock_value<int> simple;
+	REQUIRE(simple.get() == 0);
+	simple = 5;
+	REQUIRE(simple == 5);
+	simple.update([](int& value) { value *= 2; });
+	REQUIRE(simple.get() == 10);
+
+	// Readers never see a half-written value
+	mh::seqlock_value<triple> value(triple{ 0, 0, 0 });
+	std::atomic_bool isDone = false;
+	std::atomic_int inconsistentCount = 0;
+
+	std::vector<std::thread> readers;
+	for (int i = 0; i < 3; i++)
+	{
+		readers.emplace_back([&]
+			{
+				while (!isDone)
+				{
+					const triple read = value;
+					if (read.m_A != read.m_B || read.m_C != std::uint32_t(read.m_A))
+						inconsistentCount++;
+				}
+			});
+	}
+
+	for (std::uint64_t i = 1; i <= 200'000; i++)
+		value.set(triple{ i, i, std::uint32_t(i) });
+
+	isDone = true;
+	for (auto& reader : readers)
+		reader.join();
+
+	REQUIRE(inconsistentCount == 0);
+	REQUIRE(value.get().m_A == 200'000);
+}
@@ -0,0 +1,144 @@
+#include "mh/concurrency/dispatcher.hpp"
+#include "mh/coroutine/async_generator.hpp"
+#include "mh/coroutine/channel.hpp"
+#include "mh/coroutine/future.hpp"
+
+#ifdef MH_COROUTINES_SUPPORTED
+
+#include <catch2/catch.hpp>
+
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+namespace
+{
+	mh::async_generator<int> from_promises(std::vector<mh::task<int>> tasks, int& producedCount)
+	{
+		for (mh::task<int>& task : tasks)
+		{
+			co_yield co_await task;
+			producedCount++;
+		}
+	}
+}
+
+TEST_CASE("async_generator")
+{
+	mh::promise<int> promises[3];
+	std::vector<mh::task<int>> tasks;
+	for (auto& promise : promises)
+		tasks.push_back(promise.get_task());
+
+	int producedCount = 0;
+	std::vector<int> values;
+	bool isDone = false;
+
+	auto consumer = [](mh::async_generator<int> gen, std::vector<int>& values, bool& isDone) -> mh::task<>
+	{
+		while (std::optional<int> value = co_await gen.next())
+			values.push_back(*value);
+
+		isDone = true;
+	}(from_promises(std::move(tasks), producedCount), values, isDone);
+
+	// Values come through one at a time, as they become available
+	REQUIRE(values.empty());
+	promises[0].set_value(1);
+	REQUIRE(values == std::vector<int>{ 1 });
+	REQUIRE(producedCount == 1); // The consumer asked for the next one straight away
+
+	promises[1].set_value(2);
+	REQUIRE(values == std::vector<int>{ 1, 2 });
+	REQUIRE(producedCount == 2);
+
+	REQUIRE(!isDone);
+	promises[2].set_value(3);
+	REQUIRE(values == std::vector<int>{ 1, 2, 3 });
+	REQUIRE(producedCount == 3);
+	REQUIRE(isDone);
+	REQUIRE(consumer.is_ready());
+}
+
+TEST_CASE("async_generator - co_for_each")
+{
+	mh::dispatcher dispatcher(false);
+	mh::channel<std::string> ch(4);
+
+	auto delayed = [](mh::dispatcher& dispatcher, mh::channel<std::string>& ch) -> mh::async_generator<std::string>
+	{
+		while (std::optional<std::string> str = co_await ch.co_receive())
+		{
+			co_await dispatcher.co_delay_for(1ms);
+			co_yield *str + "!";
+		}
+	};
+
+	auto consumer = [](mh::async_generator<std::string> gen) -> mh::task<std::string>
+	{
+		std::string joined;
+		co_await gen.co_for_each([&](std::string str) { joined += str; });
+		co_return joined;
+	}(delayed(dispatcher, ch));
+
+	REQUIRE(ch.try_send("a"));
+	REQUIRE(ch.try_send("b"));
+	ch.close();
+
+	while (!consumer.is_ready())
+	{
+		dispatcher.wait_tasks_for(1s);
+		dispatcher.run();
+	}
+
+	REQUIRE(consumer.get() == "a!b!");
+
+	// With an awaitable callback, and a generator that finishes without yielding anything
+	auto empty = []() -> mh::async_generator<std::unique_ptr<int>&&> { co_return; };
+	int calledCount = 0;
+	auto awaited = [](mh::async_generator<std::unique_ptr<int>&&> gen, int& calledCount) -> mh::task<>
+	{
+		co_await gen.co_for_each([&](std::unique_ptr<int>) -> mh::task<> { calledCount++; co_return; });
+	}(empty(), calledCount);
+
+	REQUIRE(awaited.is_ready());
+	REQUIRE(calledCount == 0);
+}
+
+TEST_CASE("async_generator - exceptions")
+{
+	auto gen = []() -> mh::async_generator<int>
+	{
+		co_yield 1;
+		throw std::runtime_error("oops");
+	}();
+
+	auto result = [](mh::async_generator<int>& gen) -> mh::task<std::vector<int>>
+	{
+		std::vector<int> values;
+		try
+		{
+			while (std::optional<int> value = co_await gen.next())
+				values.push_back(*value);
+		}
+		catch (const std::runtime_error&)
+		{
+			values.push_back(-1);
+		}
+
+		// Only thrown once, then it's just finished
+		REQUIRE(gen.is_done());
+		REQUIRE(!(co_await gen.next()));
+		co_return values;
+	}(gen);
+
+	REQUIRE(result.get() == std::vector<int>{ 1, -1 });
+
+	REQUIRE(!mh::async_generator<int>().valid());
+}
+
+#endif
@@ -0,0 +1,213 @@
+#include "mh/concurrency/thread_pool.hpp"
+#include "mh/coroutine/async_latch.hpp"
+#include "mh/coroutine/async_manual_reset_event.hpp"
+#include "mh/coroutine/async_mutex.hpp"
+#include "mh/coroutine/async_semaphore.hpp"
+#include "mh/coroutine/task.hpp"
+#include "mh/coroutine/when_all.hpp"
+
+#ifdef MH_COROUTINES_SUPPORTED
+
+#include <catch2/catch.hpp>
+
+#include <atomic>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+TEST_CASE("async_mutex")
+{
+	mh::async_mutex mutex;
+	std::vector<int> order;
+
+	REQUIRE(mutex.try_lock());
+	REQUIRE(!mutex.try_lock());
+
+	std::vector<mh::task<>> waiters;
+	for (int i = 0; i < 3; i++)
+	{
+		waiters.push_back([](mh::async_mutex& mutex, std::vector<int>& order, int i) -> mh::task<>
+			{
+				auto lock = co_await mutex.co_lock();
+				REQUIRE(lock.owns_lock());
+				order.push_back(i);
+			}(mutex, order, i));
+	}
+
+	for (const auto& waiter : waiters)
+		REQUIRE(!waiter.is_ready());
+
+	// Each waiter gets the lock in turn, and hands it on when it's done
+	mutex.unlock();
+	for (const auto& waiter : waiters)
+		REQUIRE(waiter.is_ready());
+
+	REQUIRE(order == std::vector<int>{ 0, 1, 2 });
+
+	// Nobody left, so it's just unlocked
+	REQUIRE(mutex.try_lock());
+	mutex.unlock();
+
+	REQUIRE([](mh::async_mutex& mutex) -> mh::task<bool>
+		{
+			auto lock = co_await mutex.co_lock();
+			auto moved = std::move(lock);
+			const bool wasLocked = !mutex.try_lock();
+			moved.unlock();
+			co_return wasLocked && !lock && mutex.try_lock();
+		}(mutex).get());
+
+	mutex.unlock();
+}
+
+TEST_CASE("async_mutex - threads")
+{
+	mh::thread_pool pool(4);
+	mh::async_mutex mutex;
+	int counter = 0; // Deliberately not atomic
+
+	std::vector<mh::task<>> tasks;
+	for (int i = 0; i < 200; i++)
+	{
+		tasks.push_back([](mh::thread_pool& pool, mh::async_mutex& mutex, int& counter) -> mh::task<>
+			{
+				co_await pool.co_add_task();
+				for (int j = 0; j < 50; j++)
+				{
+					auto lock = co_await mutex.co_lock();
+					counter++;
+				}
+			}(pool, mutex, counter));
+	}
+
+	mh::when_all(tasks).wait();
+	REQUIRE(counter == 200 * 50);
+}
+
+TEST_CASE("async_semaphore")
+{
+	mh::async_semaphore semaphore(2);
+	REQUIRE(semaphore.available() == 2);
+
+	auto acquire = [](mh::async_semaphore& semaphore) -> mh::task<>
+	{
+		co_await semaphore.co_acquire();
+	};
+
+	auto first = acquire(semaphore);
+	auto second = acquire(semaphore);
+	REQUIRE(first.is_ready());
+	REQUIRE(second.is_ready());
+	REQUIRE(!semaphore.try_acquire());
+
+	auto third = acquire(semaphore);
+	auto fourth = acquire(semaphore);
+	REQUIRE(!third.is_ready());
+	REQUIRE(!fourth.is_ready());
+
+	semaphore.release();
+	REQUIRE(third.is_ready());
+	REQUIRE(!fourth.is_ready());
+
+	// Anything left over after everyone has been woken up is still available
+	semaphore.release(3);
+	REQUIRE(fourth.is_ready());
+	REQUIRE(semaphore.available() == 2);
+	REQUIRE(semaphore.try_acquire());
+	REQUIRE(semaphore.try_acquire());
+	REQUIRE(!semaphore.try_acquire());
+}
+
+TEST_CASE("async_semaphore - threads")
+{
+	constexpr int MAX_CONCURRENCY = 3;
+
+	mh::thread_pool pool(8);
+	mh::async_semaphore semaphore(MAX_CONCURRENCY);
+	std::atomic_int running = 0;
+	std::atomic_int maxRunning = 0;
+
+	std::vector<mh::task<>> tasks;
+	for (int i = 0; i < 200; i++)
+	{
+		tasks.push_back([](mh::thread_pool& pool, mh::async_semaphore& semaphore,
+			std::atomic_int& running, std::atomic_int& maxRunning) -> mh::task<>
+			{
+				co_await pool.co_add_task();
+				co_await semaphore.co_acquire();
+
+				const int nowRunning = ++running;
+				int prevMax = maxRunning;
+				while (nowRunning > prevMax && !maxRunning.compare_exchange_weak(prevMax, nowRunning))
+				{
+				}
+
+				co_await pool.co_delay_for(10us);
+				running--;
+				semaphore.release();
+			}(pool, semaphore, running, maxRunning));
+	}
+
+	mh::when_all(tasks).wait();
+	REQUIRE(maxRunning <= MAX_CONCURRENCY);
+	REQUIRE(semaphore.available() == MAX_CONCURRENCY);
+}
+
+TEST_CASE("async_manual_reset_event")
+{
+	mh::async_manual_reset_event event;
+	REQUIRE(!event.is_set());
+
+	int resumedCount = 0;
+	auto wait = [](const mh::async_manual_reset_event& event, int& resumedCount) -> mh::task<>
+	{
+		co_await event.co_wait();
+		resumedCount++;
+	};
+
+	auto first = wait(event, resumedCount);
+	auto second = wait(event, resumedCount);
+	REQUIRE(resumedCount == 0);
+
+	event.set();
+	REQUIRE(resumedCount == 2);
+
+	// Stays set
+	auto third = wait(event, resumedCount);
+	REQUIRE(resumedCount == 3);
+
+	event.reset();
+	auto fourth = wait(event, resumedCount);
+	REQUIRE(resumedCount == 3);
+	event.set();
+	REQUIRE(resumedCount == 4);
+}
+
+TEST_CASE("async_latch")
+{
+	mh::thread_pool pool(4);
+	mh::async_latch latch(16);
+	std::atomic_int arrived = 0;
+
+	std::vector<mh::task<bool>> tasks;
+	for (int i = 0; i < 16; i++)
+	{
+		tasks.push_back([](mh::thread_pool& pool, mh::async_latch& latch, std::atomic_int& arrived) -> mh::task<bool>
+			{
+				co_await pool.co_add_task();
+				arrived++;
+				co_await latch.co_arrive_and_wait();
+
+				// Nobody gets past until everyone has arrived
+				co_return arrived == 16;
+			}(pool, latch, arrived));
+	}
+
+	for (const auto& t : tasks)
+		REQUIRE(t.get());
+
+	REQUIRE(latch.try_wait());
+	REQUIRE(mh::async_latch(0).try_wait());
+}
+
+#endif
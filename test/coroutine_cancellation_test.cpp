@@ -0,0 +1,326 @@
+#include "mh/concurrency/dispatcher.hpp"
+#include "mh/concurrency/thread_pool.hpp"
+#include "mh/coroutine/async_generator.hpp"
+#include "mh/coroutine/future.hpp"
+#include "mh/coroutine/lazy_task.hpp"
+#include "mh/coroutine/when_all.hpp"
+#include "mh/coroutine/with_timeout.hpp"
+
+#ifdef MH_COROUTINES_SUPPORTED
+
+#include <catch2/catch.hpp>
+
+#include <atomic>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+namespace
+{
+	template<typename T>
+	bool is_cancelled(const mh::task<T>& t)
+	{
+		try
+		{
+			if (auto ex = t.get_exception())
+				std::rethrow_exception(ex);
+		}
+		catch (const mh::task_cancelled&)
+		{
+			return true;
+		}
+
+		return false;
+	}
+}
+
+TEST_CASE("cancellation - delays")
+{
+	mh::dispatcher dispatcher;
+
+	auto sleeper = [](mh::dispatcher& dispatcher) -> mh::task<int>
+	{
+		co_await dispatcher.co_delay_for(1h);
+		co_return 1;
+	}(dispatcher);
+
+	REQUIRE(dispatcher.task_count() == 1);
+	REQUIRE(!sleeper.is_cancel_requested());
+	REQUIRE(sleeper.request_cancel());
+	REQUIRE(!sleeper.request_cancel());
+	REQUIRE(sleeper.is_cancel_requested());
+
+	// Resumed straight away instead of an hour from now
+	REQUIRE(!sleeper.is_ready());
+	REQUIRE(dispatcher.run_one());
+	REQUIRE(sleeper.is_ready());
+	REQUIRE(is_cancelled(sleeper));
+	REQUIRE(dispatcher.task_count() == 0);
+
+	// Cancelling a finished task doesn't change anything
+	auto finished = [](mh::dispatcher& dispatcher) -> mh::task<int>
+	{
+		co_await dispatcher.co_delay_for(0s);
+		co_return 2;
+	}(dispatcher);
+	REQUIRE(finished.request_cancel());
+	REQUIRE(finished.get() == 2);
+}
+
+TEST_CASE("cancellation - dispatcher and pool submissions")
+{
+	mh::dispatcher dispatcher(false);
+	std::atomic_int workCount = 0;
+
+	auto queued = [](mh::dispatcher& dispatcher, std::atomic_int& workCount) -> mh::task<>
+	{
+		co_await dispatcher.co_dispatch();
+		workCount++;
+	}(dispatcher, workCount);
+
+	// Already queued, so it bails out once it gets to run
+	queued.request_cancel();
+	REQUIRE(dispatcher.run_one());
+	REQUIRE(is_cancelled(queued));
+
+	// Never gets as far as the pool at all
+	mh::thread_pool pool(2);
+	mh::promise<int> input;
+
+	auto submitted = [](mh::thread_pool& pool, mh::task<int> input, std::atomic_int& workCount) -> mh::task<>
+	{
+		co_await input;
+		co_await pool.co_add_task();
+		workCount++;
+	}(pool, input.get_task(), workCount);
+
+	REQUIRE(!input.is_cancel_requested());
+	submitted.request_cancel();
+	REQUIRE(input.is_cancel_requested()); // Passed on to whatever it was waiting on
+
+	input.set_value(1);
+	REQUIRE(submitted.is_ready());
+	REQUIRE(is_cancelled(submitted));
+	REQUIRE(pool.task_count() == 0);
+	REQUIRE(workCount == 0);
+}
+
+TEST_CASE("cancellation - propagates to children")
+{
+	mh::dispatcher dispatcher;
+
+	auto child = [](mh::dispatcher& dispatcher) -> mh::task<int>
+	{
+		co_await dispatcher.co_delay_for(1h);
+		co_return 1;
+	}(dispatcher);
+
+	auto parent = [](mh::task<int> child) -> mh::task<int>
+	{
+		co_return co_await child + 1;
+	}(child);
+
+	parent.request_cancel();
+	REQUIRE(child.is_cancel_requested());
+	REQUIRE(dispatcher.run_one());
+	REQUIRE(is_cancelled(child));
+	REQUIRE(is_cancelled(parent)); // Rethrown from the co_await
+
+	auto checker = [](mh::dispatcher& dispatcher) -> mh::task<bool>
+	{
+		try
+		{
+			co_await dispatcher.co_delay_for(1h);
+		}
+		catch (const mh::task_cancelled&)
+		{
+		}
+
+		const bool wasCancelled = co_await mh::co_is_cancel_requested();
+
+		// Even tasks that didn't exist yet get cancelled
+		auto grandchild = [](mh::dispatcher& dispatcher) -> mh::task<>
+		{
+			co_await dispatcher.co_delay_for(1h);
+		}(dispatcher);
+
+		try
+		{
+			co_await grandchild;
+		}
+		catch (const mh::task_cancelled&)
+		{
+			co_return wasCancelled && grandchild.is_cancel_requested();
+		}
+
+		co_return false;
+	}(dispatcher);
+
+	checker.request_cancel();
+	dispatcher.run();
+	REQUIRE(checker.get());
+}
+
+TEST_CASE("cancellation - when_all")
+{
+	mh::dispatcher dispatcher;
+
+	std::vector<mh::task<int>> tasks;
+	for (int i = 0; i < 4; i++)
+	{
+		tasks.push_back([](mh::dispatcher& dispatcher, int i) -> mh::task<int>
+			{
+				while (true)
+				{
+					co_await mh::co_throw_if_cancelled();
+					co_await dispatcher.co_delay_for(std::chrono::minutes(i + 1));
+				}
+
+				co_return i;
+			}(dispatcher, i));
+	}
+
+	auto all = mh::when_all(tasks);
+	REQUIRE(dispatcher.task_count() == 4);
+	all.request_cancel();
+	REQUIRE(dispatcher.run() == 4);
+
+	REQUIRE(all.is_ready());
+	REQUIRE_THROWS_AS(all.get(), mh::task_cancelled);
+	for (const auto& t : tasks)
+		REQUIRE(is_cancelled(t));
+}
+
+TEST_CASE("cancellation - threads")
+{
+	mh::thread_pool pool(4);
+
+	for (int round = 0; round < 20; round++)
+	{
+		std::atomic_int iterations = 0;
+
+		std::vector<mh::task<>> tasks;
+		for (int i = 0; i < 64; i++)
+		{
+			tasks.push_back([](mh::thread_pool& pool, std::atomic_int& iterations) -> mh::task<>
+				{
+					co_await pool.co_add_task();
+					while (true)
+					{
+						iterations++;
+						co_await pool.co_delay_for(std::chrono::microseconds(iterations % 100));
+					}
+				}(pool, iterations));
+		}
+
+		auto all = mh::when_all(tasks);
+
+		// Let them get going, and cancel them wherever they happen to be
+		std::this_thread::sleep_for(std::chrono::microseconds(round * 50));
+		all.request_cancel();
+
+		REQUIRE(all.wait_for(10s) == std::future_status::ready);
+		for (const auto& t : tasks)
+			REQUIRE(is_cancelled(t));
+	}
+}
+
+
+TEST_CASE("cancellation - lazy tasks")
+{
+	mh::dispatcher dispatcher;
+
+	auto parent = [](mh::dispatcher& dispatcher) -> mh::task<int>
+	{
+		auto child = [](mh::dispatcher& dispatcher) -> mh::lazy_task<int>
+		{
+			co_await dispatcher.co_delay_for(1h);
+			co_return 1;
+		};
+
+		co_return co_await child(dispatcher) + 1;
+	}(dispatcher);
+
+	REQUIRE(dispatcher.task_count() == 1);
+	REQUIRE(parent.request_cancel());
+
+	// The child's delay is cut short, and the exception comes out through both of them
+	REQUIRE(dispatcher.run_one());
+	REQUIRE(is_cancelled(parent));
+	REQUIRE(dispatcher.task_count() == 0);
+
+	// Already cancelled before the child even starts
+	auto cancelledFirst = [](mh::promise<int>& start) -> mh::task<bool>
+	{
+		co_await start.get_task();
+		co_return co_await []() -> mh::lazy_task<bool>
+		{
+			co_return co_await mh::co_is_cancel_requested();
+		}();
+	};
+
+	mh::promise<int> start;
+	auto early = cancelledFirst(start);
+	early.request_cancel();
+	start.set_value(0);
+	REQUIRE(early.get());
+}
+
+TEST_CASE("cancellation - async generators")
+{
+	mh::dispatcher dispatcher;
+	int produced = 0;
+
+	auto consumer = [](mh::dispatcher& dispatcher, int& produced) -> mh::task<int>
+	{
+		auto numbers = [](mh::dispatcher& dispatcher, int& produced) -> mh::async_generator<int>
+		{
+			for (int i = 0; ; i++)
+			{
+				co_await dispatcher.co_delay_for(1h);
+				produced++;
+				co_yield i;
+			}
+		}(dispatcher, produced);
+
+		int sum = 0;
+		while (auto value = co_await numbers.next())
+			sum += *value;
+
+		co_return sum;
+	}(dispatcher, produced);
+
+	REQUIRE(dispatcher.task_count() == 1);
+	REQUIRE(consumer.request_cancel());
+	REQUIRE(dispatcher.run_one());
+	REQUIRE(is_cancelled(consumer));
+	REQUIRE(produced == 0);
+}
+
+TEST_CASE("cancellation - with_timeout")
+{
+	mh::dispatcher dispatcher;
+
+	auto sleeper = [](mh::dispatcher& dispatcher) -> mh::task<int>
+	{
+		co_await dispatcher.co_delay_for(1h);
+		co_return 1;
+	}(dispatcher);
+
+	auto parent = [](mh::task<int> t, mh::dispatcher& dispatcher) -> mh::task<mh::timeout_result_t<int>>
+	{
+		co_return co_await mh::with_timeout(t, 2h, dispatcher);
+	}(sleeper, dispatcher);
+
+	REQUIRE(dispatcher.task_count() == 2); // The delay and the timeout
+	REQUIRE(parent.request_cancel());
+	REQUIRE(sleeper.is_cancel_requested());
+
+	// Cancelling the delay completes the task, which removes the timeout
+	REQUIRE(dispatcher.run_one());
+	REQUIRE(is_cancelled(sleeper));
+	REQUIRE(is_cancelled(parent));
+	REQUIRE(dispatcher.task_count() == 0);
+}
+
+#endif
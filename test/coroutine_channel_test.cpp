@@ -0,0 +1,252 @@
+#include "mh/concurrency/thread_pool.hpp"
+#include "mh/coroutine/channel.hpp"
+#include "mh/coroutine/task.hpp"
+#include "mh/coroutine/when_all.hpp"
+
+#ifdef MH_COROUTINES_SUPPORTED
+
+#include <catch2/catch.hpp>
+
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST_CASE("channel")
+{
+	mh::channel<std::string> ch(2);
+	REQUIRE(ch.capacity() == 2);
+	REQUIRE(!ch.try_receive());
+
+	REQUIRE(ch.try_send("hello"));
+	REQUIRE(ch.try_send("world"));
+
+	std::string full = "full";
+	REQUIRE(!ch.try_send(std::move(full)));
+	REQUIRE(full == "full"); // Not moved from if it wasn't sent
+
+	REQUIRE(ch.try_receive() == "hello");
+	REQUIRE(ch.try_receive() == "world");
+	REQUIRE(!ch.try_receive());
+
+	// Wraps around
+	for (int i = 0; i < 10; i++)
+	{
+		REQUIRE(ch.try_send(std::to_string(i)));
+		REQUIRE(ch.try_receive() == std::to_string(i));
+	}
+
+	REQUIRE_THROWS_AS(mh::channel<int>(0), std::invalid_argument);
+}
+
+TEST_CASE("channel - backpressure")
+{
+	mh::channel<int> ch(1);
+
+	auto send = [](mh::channel<int>& ch, int value) -> mh::task<bool>
+	{
+		co_return co_await ch.co_send(value);
+	};
+	auto receive = [](mh::channel<int>& ch) -> mh::task<std::optional<int>>
+	{
+		co_return co_await ch.co_receive();
+	};
+
+	auto first = send(ch, 1);
+	auto second = send(ch, 2);
+	auto third = send(ch, 3);
+	REQUIRE(first.is_ready());
+	REQUIRE(!second.is_ready());
+	REQUIRE(!third.is_ready());
+
+	// Receiving makes room, which lets the next sender in (in the order they started waiting)
+	REQUIRE(receive(ch).get() == 1);
+	REQUIRE(second.is_ready());
+	REQUIRE(!third.is_ready());
+	REQUIRE(receive(ch).get() == 2);
+	REQUIRE(third.is_ready());
+	REQUIRE(receive(ch).get() == 3);
+
+	// And the other way around
+	auto receiver = receive(ch);
+	REQUIRE(!receiver.is_ready());
+	REQUIRE(ch.try_send(4));
+	REQUIRE(receiver.is_ready());
+	REQUIRE(receiver.get() == 4);
+}
+
+TEST_CASE("channel - close")
+{
+	mh::channel<std::unique_ptr<int>> ch(1);
+
+	auto send = [](mh::channel<std::unique_ptr<int>>& ch, int value) -> mh::task<bool>
+	{
+		co_return co_await ch.co_send(std::make_unique<int>(value));
+	};
+	auto receive = [](mh::channel<std::unique_ptr<int>>& ch) -> mh::task<int>
+	{
+		auto value = co_await ch.co_receive();
+		co_return value ? **value : -1;
+	};
+
+	auto sent = send(ch, 1);
+	auto blocked = send(ch, 2);
+	REQUIRE(sent.get());
+	REQUIRE(!blocked.is_ready());
+
+	ch.close();
+	REQUIRE(ch.is_closed());
+	REQUIRE(!blocked.get());
+	REQUIRE(!send(ch, 3).get());
+	REQUIRE(!ch.try_send(std::make_unique<int>(4)));
+
+	// Whatever was sent before closing can still be received
+	REQUIRE(receive(ch).get() == 1);
+	REQUIRE(receive(ch).get() == -1);
+
+	mh::channel<int> empty(1);
+	auto waiting = [](mh::channel<int>& ch) -> mh::task<bool>
+	{
+		co_return !(co_await ch.co_receive()).has_value();
+	}(empty);
+	REQUIRE(!waiting.is_ready());
+	empty.close();
+	REQUIRE(waiting.get());
+}
+
+TEST_CASE("channel - cancellation")
+{
+	mh::channel<int> ch(1);
+	REQUIRE(ch.try_send(1));
+
+	auto sender = [](mh::channel<int>& ch) -> mh::task<bool>
+	{
+		co_return co_await ch.co_send(2);
+	}(ch);
+	REQUIRE(!sender.is_ready());
+
+	auto receiver = [](mh::channel<int>& ch) -> mh::task<std::optional<int>>
+	{
+		co_return co_await ch.co_receive();
+	}(ch);
+	REQUIRE(receiver.is_ready()); // Got 1, and let the sender in
+	REQUIRE(receiver.get() == 1);
+	REQUIRE(sender.get());
+
+	auto cancelled = [](mh::channel<int>& ch) -> mh::task<bool>
+	{
+		co_return co_await ch.co_send(3);
+	}(ch);
+	REQUIRE(!cancelled.is_ready());
+	REQUIRE(cancelled.request_cancel());
+	REQUIRE(cancelled.is_ready());
+	REQUIRE_THROWS_AS(cancelled.get(), mh::task_cancelled);
+
+	// The cancelled send never happened
+	REQUIRE(ch.try_receive() == 2);
+	REQUIRE(!ch.try_receive());
+}
+
+TEST_CASE("channel - sending while closing")
+{
+	// Every send that reports success must be received, however close() interleaves with it
+	for (int iteration = 0; iteration < 200; iteration++)
+	{
+		mh::channel<int> ch(4);
+		std::atomic_int sentCount = 0;
+		std::atomic_int receivedCount = 0;
+
+		auto receiver = [](mh::channel<int>& ch, std::atomic_int& receivedCount) -> mh::task<>
+		{
+			while (co_await ch.co_receive())
+				receivedCount++;
+		}(ch, receivedCount);
+
+		std::vector<std::thread> senders;
+		for (int i = 0; i < 2; i++)
+		{
+			senders.emplace_back([&]
+				{
+					while (!ch.is_closed())
+					{
+						if (ch.try_send(1))
+							sentCount++;
+					}
+				});
+			senders.emplace_back([&]
+				{
+					[](mh::channel<int>& ch, std::atomic_int& sentCount) -> mh::task<>
+					{
+						while (co_await ch.co_send(1))
+							sentCount++;
+					}(ch, sentCount).wait();
+				});
+		}
+
+		std::this_thread::sleep_for(std::chrono::microseconds(iteration * 5));
+		ch.close();
+
+		for (auto& sender : senders)
+			sender.join();
+
+		receiver.wait();
+		REQUIRE(receivedCount == sentCount);
+	}
+}
+
+TEST_CASE("channel - threads")
+{
+	constexpr int PRODUCERS = 4;
+	constexpr int CONSUMERS = 4;
+	constexpr int VALUES_PER_PRODUCER = 2000;
+
+	mh::thread_pool pool(4);
+	mh::channel<int> ch(8);
+	std::atomic<long long> receivedSum = 0;
+	std::atomic_int receivedCount = 0;
+
+	std::vector<mh::task<bool>> producers;
+	for (int p = 0; p < PRODUCERS; p++)
+	{
+		producers.push_back([](mh::thread_pool& pool, mh::channel<int>& ch, int p) -> mh::task<bool>
+			{
+				co_await pool.co_add_task();
+				for (int i = 0; i < VALUES_PER_PRODUCER; i++)
+				{
+					if (!co_await ch.co_send(p * VALUES_PER_PRODUCER + i))
+						co_return false;
+				}
+
+				co_return true;
+			}(pool, ch, p));
+	}
+
+	std::vector<mh::task<>> consumers;
+	for (int c = 0; c < CONSUMERS; c++)
+	{
+		consumers.push_back([](mh::thread_pool& pool, mh::channel<int>& ch,
+			std::atomic<long long>& receivedSum, std::atomic_int& receivedCount) -> mh::task<>
+			{
+				co_await pool.co_add_task();
+				while (auto value = co_await ch.co_receive())
+				{
+					receivedSum += *value;
+					receivedCount++;
+				}
+			}(pool, ch, receivedSum, receivedCount));
+	}
+
+	for (const auto& producer : producers)
+		REQUIRE(producer.get());
+
+	ch.close();
+	mh::when_all(consumers).wait();
+
+	constexpr long long TOTAL = PRODUCERS * VALUES_PER_PRODUCER;
+	REQUIRE(receivedCount == TOTAL);
+	REQUIRE(receivedSum == TOTAL * (TOTAL - 1) / 2);
+}
+
+#endif
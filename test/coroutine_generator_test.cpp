@@ -0,0 +1,312 @@
+#include "mh/coroutine/generator.hpp"
+
+#ifdef MH_COROUTINES_SUPPORTED
+
+#include <catch2/catch.hpp>
+
+#include <array>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace
+{
+	mh::generator<int> count_to(int count)
+	{
+		for (int i = 0; i < count; i++)
+			co_yield i;
+	}
+
+	struct tree_node
+	{
+		explicit tree_node(int value) : m_Value(value) {}
+
+		int m_Value;
+		std::vector<std::unique_ptr<tree_node>> m_Children;
+	};
+
+	mh::generator<int> walk_tree(const tree_node& node)
+	{
+		co_yield node.m_Value;
+
+		for (const auto& child : node.m_Children)
+			co_yield mh::elements_of(walk_tree(*child));
+	}
+
+	mh::generator<int> count_to_chunked(int count)
+	{
+		std::array<int, 4> buffer;
+		for (int i = 0; i < count; )
+		{
+			size_t size = 0;
+			for (; size < buffer.size() && i < count; size++)
+				buffer[size] = i++;
+
+			co_yield std::span(buffer.data(), size);
+		}
+	}
+
+	struct counting_allocator_state
+	{
+		size_t m_AllocatedCount = 0;
+		size_t m_FreedCount = 0;
+		size_t m_OutstandingBytes = 0;
+	};
+
+	template<typename T>
+	struct counting_allocator
+	{
+		using value_type = T;
+
+		counting_allocator(counting_allocator_state& state) : m_State(&state) {}
+		template<typename U> counting_allocator(const counting_allocator<U>& other) : m_State(other.m_State) {}
+
+		T* allocate(size_t count)
+		{
+			m_State->m_AllocatedCount++;
+			m_State->m_OutstandingBytes += count * sizeof(T);
+			return std::allocator<T>{}.allocate(count);
+		}
+		void deallocate(T* ptr, size_t count)
+		{
+			m_State->m_FreedCount++;
+			m_State->m_OutstandingBytes -= count * sizeof(T);
+			std::allocator<T>{}.deallocate(ptr, count);
+		}
+
+		bool operator==(const counting_allocator&) const = default;
+
+		counting_allocator_state* m_State;
+	};
+
+	template<typename TAlloc>
+	mh::generator<int> count_to_with(std::allocator_arg_t, const TAlloc&, int count)
+	{
+		for (int i = 0; i < count; i++)
+			co_yield i;
+	}
+
+	struct counter
+	{
+		template<typename TAlloc>
+		mh::generator<int> count_to(std::allocator_arg_t, const TAlloc&, int count) const
+		{
+			for (int i = 0; i < count; i++)
+				co_yield i + m_Offset;
+		}
+
+		int m_Offset;
+	};
+
+	mh::generator<int> nest(int depth)
+	{
+		if (depth > 0)
+		{
+			co_yield depth;
+			co_yield mh::elements_of(nest(depth - 1));
+		}
+	}
+}
+
+TEST_CASE("generator")
+{
+	std::vector<int> values;
+	for (int value : count_to(5))
+		values.push_back(value);
+
+	REQUIRE(values == std::vector<int>{ 0, 1, 2, 3, 4 });
+
+	const std::vector<std::string> strings{ "a", "b", "c" };
+	std::string joined;
+	for (const std::string& str : mh::make_generator(strings.begin(), strings.end()))
+		joined += str;
+
+	REQUIRE(joined == "abc");
+}
+
+TEST_CASE("generator - elements_of")
+{
+	tree_node root(1);
+	root.m_Children.push_back(std::make_unique<tree_node>(2));
+	root.m_Children.push_back(std::make_unique<tree_node>(4));
+	root.m_Children.front()->m_Children.push_back(std::make_unique<tree_node>(3));
+	root.m_Children.back()->m_Children.push_back(std::make_unique<tree_node>(5));
+
+	std::vector<int> values;
+	for (int value : walk_tree(root))
+		values.push_back(value);
+
+	REQUIRE(values == std::vector<int>{ 1, 2, 3, 4, 5 });
+
+	// Lvalue generators, other ranges, and generators that turn out to be empty
+	auto gen = []() -> mh::generator<int>
+	{
+		auto inner = count_to(2);
+		const std::vector<int> vec{ 10, 11 };
+		co_yield mh::elements_of(inner);
+		co_yield mh::elements_of(vec);
+		co_yield mh::elements_of(count_to(0));
+		co_yield 20;
+	}();
+
+	values.clear();
+	for (int value : gen)
+		values.push_back(value);
+
+	REQUIRE(values == std::vector<int>{ 0, 1, 10, 11, 20 });
+}
+
+TEST_CASE("generator - deep nesting")
+{
+	// Each element goes straight from the innermost generator to us, instead of being passed back up
+	// through every level in between
+	constexpr int DEPTH = 5'000;
+
+	int expected = DEPTH;
+	for (int value : nest(DEPTH))
+		REQUIRE(value == expected--);
+
+	REQUIRE(expected == 0);
+}
+
+TEST_CASE("generator - spans")
+{
+	std::vector<int> values;
+	for (int value : count_to_chunked(10))
+		values.push_back(value);
+
+	REQUIRE(values == std::vector<int>{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9 });
+
+	// Empty spans are skipped over, and can be mixed with everything else
+	auto gen = []() -> mh::generator<int>
+	{
+		const std::vector<int> vec{ 3, 4 };
+		const int array[] = { 1, 2 };
+
+		co_yield std::span<const int>();
+		co_yield std::span(array);
+		co_yield std::span<const int>();
+		co_yield mh::elements_of(vec);
+		co_yield 5;
+		co_yield mh::elements_of(count_to_chunked(2));
+		co_yield std::span<const int>();
+	}();
+
+	values.clear();
+	for (int value : gen)
+		values.push_back(value);
+
+	REQUIRE(values == std::vector<int>{ 1, 2, 3, 4, 5, 0, 1 });
+
+	values.clear();
+	for (int value : []() -> mh::generator<int> { co_yield std::span<const int>(); }())
+		values.push_back(value);
+
+	REQUIRE(values.empty());
+}
+
+TEST_CASE("generator - allocators")
+{
+	counting_allocator_state state;
+	std::vector<int> values;
+
+	{
+		auto gen = count_to_with(std::allocator_arg, counting_allocator<std::byte>(state), 3);
+		REQUIRE(state.m_AllocatedCount == 1);
+
+		for (int value : gen)
+			values.push_back(value);
+	}
+
+	REQUIRE(values == std::vector<int>{ 0, 1, 2 });
+	REQUIRE(state.m_FreedCount == 1);
+	REQUIRE(state.m_OutstandingBytes == 0);
+
+	// Member functions, and the allocator getting rebound
+	const counter offsetCounter{ 10 };
+	values.clear();
+	for (int value : offsetCounter.count_to(std::allocator_arg, counting_allocator<std::string>(state), 2))
+		values.push_back(value);
+
+	REQUIRE(values == std::vector<int>{ 10, 11 });
+	REQUIRE(state.m_AllocatedCount == 2);
+	REQUIRE(state.m_FreedCount == 2);
+	REQUIRE(state.m_OutstandingBytes == 0);
+
+	const std::vector<int> vec{ 4, 5 };
+	values.clear();
+	for (int value : mh::make_generator(std::allocator_arg, counting_allocator<int>(state), vec.begin(), vec.end()))
+		values.push_back(value);
+
+	REQUIRE(values == vec);
+	REQUIRE(state.m_AllocatedCount == 3);
+	REQUIRE(state.m_FreedCount == 3);
+
+	// Nesting works across both kinds of frame
+	values.clear();
+	for (int value : [](counting_allocator_state& state) -> mh::generator<int>
+		{
+			co_yield mh::elements_of(count_to_with(std::allocator_arg, counting_allocator<std::byte>(state), 2));
+			co_yield mh::elements_of(count_to(2));
+		}(state))
+	{
+		values.push_back(value);
+	}
+
+	REQUIRE(values == std::vector<int>{ 0, 1, 0, 1 });
+	REQUIRE(state.m_AllocatedCount == 4);
+	REQUIRE(state.m_FreedCount == 4);
+	REQUIRE(state.m_OutstandingBytes == 0);
+}
+
+TEST_CASE("generator - nested exceptions")
+{
+	auto gen = []() -> mh::generator<int>
+	{
+		co_yield 1;
+		co_yield mh::elements_of([]() -> mh::generator<int>
+			{
+				co_yield 2;
+				throw std::runtime_error("inner");
+			}());
+		co_yield 3;
+	}();
+
+	auto it = gen.begin();
+	REQUIRE(*it == 1);
+	++it;
+	REQUIRE(*it == 2);
+	REQUIRE_THROWS_AS(++it, std::runtime_error);
+
+	// Caught by the outer generator
+	auto caught = []() -> mh::generator<int>
+	{
+		bool wasCaught = false;
+		try
+		{
+			co_yield mh::elements_of([]() -> mh::generator<int>
+				{
+					throw std::runtime_error("inner");
+					co_return;
+				}());
+		}
+		catch (const std::runtime_error&)
+		{
+			wasCaught = true;
+		}
+
+		if (wasCaught)
+			co_yield -1;
+	}();
+
+	std::vector<int> values;
+	for (int value : caught)
+		values.push_back(value);
+
+	REQUIRE(values == std::vector<int>{ -1 });
+}
+
+#endif
@@ -0,0 +1,116 @@
+#include "mh/concurrency/thread_pool.hpp"
+#include "mh/coroutine/lazy_task.hpp"
+
+#ifdef MH_COROUTINES_SUPPORTED
+
+#include <catch2/catch.hpp>
+
+#include <memory>
+#include <stdexcept>
+#include <thread>
+
+namespace
+{
+	mh::lazy_task<int> add(int a, int b, int& startedCount)
+	{
+		startedCount++;
+		co_return a + b;
+	}
+
+	mh::lazy_task<int> sum_to(int n)
+	{
+		if (n <= 0)
+			co_return 0;
+
+		co_return n + co_await sum_to(n - 1);
+	}
+}
+
+TEST_CASE("lazy_task - does not start until awaited")
+{
+	int startedCount = 0;
+
+	auto outer = [](int& startedCount) -> mh::lazy_task<int>
+	{
+		mh::lazy_task<int> inner = add(1, 2, startedCount);
+		REQUIRE(startedCount == 0);
+		const int& value = co_await inner;
+		REQUIRE(startedCount == 1);
+
+		// Already complete
+		REQUIRE(co_await inner == value);
+		co_return value + co_await add(3, 4, startedCount);
+	}(startedCount);
+
+	REQUIRE(startedCount == 0);
+	REQUIRE(!outer.is_ready());
+
+	mh::task<int> started = std::move(outer).start();
+	REQUIRE(!outer.valid());
+	REQUIRE(started.is_ready());
+	REQUIRE(started.get() == 10);
+	REQUIRE(startedCount == 2);
+
+	REQUIRE(std::move(sum_to(1000)).start().get() == 500500);
+}
+
+TEST_CASE("lazy_task - results")
+{
+	auto moveOnly = []() -> mh::lazy_task<std::unique_ptr<int>>
+	{
+		co_return std::make_unique<int>(5);
+	};
+
+	REQUIRE([&]() -> mh::task<int>
+		{
+			std::unique_ptr<int> value = co_await moveOnly();
+			co_return *value;
+		}().get() == 5);
+
+	auto throws = []() -> mh::lazy_task<>
+	{
+		throw std::runtime_error("oops");
+		co_return;
+	};
+
+	REQUIRE_THROWS_AS(std::rethrow_exception(throws().start().get_exception()), std::runtime_error);
+	REQUIRE_THROWS_AS(mh::lazy_task<int>().start().get(), std::future_error);
+}
+
+TEST_CASE("lazy_task - never started")
+{
+	auto param = std::make_shared<int>(1);
+
+	{
+		auto lazy = []([[maybe_unused]] std::shared_ptr<int> param) -> mh::lazy_task<>
+		{
+			FAIL("Should never run");
+			co_return;
+		}(param);
+
+		REQUIRE(param.use_count() == 2);
+	}
+
+	// Destroying the task frees the frame (and everything in it) without running it
+	REQUIRE(param.use_count() == 1);
+}
+
+TEST_CASE("lazy_task - caller picks the thread")
+{
+	mh::thread_pool pool(2);
+
+	auto getThread = []() -> mh::lazy_task<std::thread::id>
+	{
+		co_return std::this_thread::get_id();
+	};
+
+	const auto threadId = [](mh::thread_pool& pool, mh::lazy_task<std::thread::id> lazy) -> mh::task<std::thread::id>
+	{
+		co_await pool.co_add_task();
+		co_return co_await std::move(lazy);
+	}(pool, getThread()).get();
+
+	REQUIRE(threadId != std::this_thread::get_id());
+}
+
+#endif
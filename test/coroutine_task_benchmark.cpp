@@ -0,0 +1,282 @@
+#include "mh/concurrency/dispatcher.hpp"
+#include "mh/coroutine/future.hpp"
+#include "mh/coroutine/generator.hpp"
+#include "mh/coroutine/lazy_task.hpp"
+#include "mh/coroutine/task.hpp"
+
+#ifdef MH_COROUTINES_SUPPORTED
+
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <array>
+#include <cstdint>
+#include <iostream>
+#include <span>
+#include <thread>
+#include <vector>
+
+// These are hidden by default (they are not correctness tests). Run them with:
+//   coroutine_task_benchmark "[benchmark]"
+
+namespace
+{
+	using bench_clock = std::chrono::steady_clock;
+
+	template<typename TFunc>
+	void run_benchmark(const char* name, size_t iterations, TFunc&& func)
+	{
+		func(iterations / 10); // warm up
+
+		const auto start = bench_clock::now();
+		func(iterations);
+		const auto end = bench_clock::now();
+
+		const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+		std::cout << name << ": " << iterations << " iterations, "
+			<< (double(ns) / iterations) << " ns/op, "
+			<< (iterations / (double(ns) / 1'000'000'000)) << " ops/sec" << std::endl;
+	}
+
+	mh::task<int> await_ready_task(mh::task<int> t, size_t iterations)
+	{
+		int sum = 0;
+		for (size_t i = 0; i < iterations; i++)
+			sum += co_await t;
+
+		co_return sum;
+	}
+
+	mh::task<int> await_make_ready_task(size_t iterations)
+	{
+		int sum = 0;
+		for (size_t i = 0; i < iterations; i++)
+			sum += co_await mh::make_ready_task<int>(1);
+
+		co_return sum;
+	}
+
+	mh::lazy_task<int> lazy_return_value(int value)
+	{
+		co_return value;
+	}
+
+	mh::task<int> await_lazy_tasks(size_t iterations)
+	{
+		int sum = 0;
+		for (size_t i = 0; i < iterations; i++)
+			sum += co_await lazy_return_value(1);
+
+		co_return sum;
+	}
+
+	mh::task<int> await_one(mh::task<int> t)
+	{
+		co_return co_await t;
+	}
+
+	mh::task<int> return_value(int value)
+	{
+		co_return value;
+	}
+}
+
+TEST_CASE("task - benchmark await ready", "[.][benchmark]")
+{
+	run_benchmark("co_await ready task", 10'000'000, [](size_t iterations)
+		{
+			const auto ready = mh::make_ready_task<int>(1);
+			REQUIRE(await_ready_task(ready, iterations).get() == int(iterations));
+		});
+}
+
+TEST_CASE("task - benchmark make ready task", "[.][benchmark]")
+{
+	run_benchmark("co_await make_ready_task", 20'000'000, [](size_t iterations)
+		{
+			REQUIRE(await_make_ready_task(iterations).get() == int(iterations));
+		});
+}
+
+TEST_CASE("task - benchmark create and complete", "[.][benchmark]")
+{
+	run_benchmark("create + complete coroutine", 5'000'000, [](size_t iterations)
+		{
+			int64_t sum = 0;
+			for (size_t i = 0; i < iterations; i++)
+				sum += return_value(1).get();
+
+			REQUIRE(sum == int64_t(iterations));
+		});
+}
+
+TEST_CASE("task - benchmark lazy task", "[.][benchmark]")
+{
+	// Every co_await of a lazy_task that completes synchronously costs some stack until the awaiting
+	// coroutine finishes when GCC doesn't turn symmetric transfer into tail calls (anything below -O2)
+#if defined(__GNUC__) && !defined(__clang__) && !defined(__OPTIMIZE__)
+	constexpr size_t ITERATIONS = 10'000;
+#else
+	constexpr size_t ITERATIONS = 5'000'000;
+#endif
+
+	run_benchmark("create + co_await lazy_task", ITERATIONS, [](size_t iterations)
+		{
+			REQUIRE(await_lazy_tasks(iterations).get() == int(iterations));
+		});
+}
+
+TEST_CASE("task - benchmark await then complete", "[.][benchmark]")
+{
+	run_benchmark("suspend on promise + set_value", 2'000'000, [](size_t iterations)
+		{
+			int64_t sum = 0;
+			for (size_t i = 0; i < iterations; i++)
+			{
+				mh::promise<int> promise;
+				auto waiter = await_one(promise.get_task());
+				promise.set_value(1);
+				sum += waiter.get();
+			}
+
+			REQUIRE(sum == int64_t(iterations));
+		});
+}
+
+TEST_CASE("task - benchmark then", "[.][benchmark]")
+{
+	mh::dispatcher dispatcher(false);
+
+	run_benchmark("then() + set_value + run", 2'000'000, [&](size_t iterations)
+		{
+			int64_t sum = 0;
+			for (size_t i = 0; i < iterations; i++)
+			{
+				mh::promise<int> promise;
+				auto continuation = promise.get_task().then(dispatcher, [](int value) { return value; });
+				promise.set_value(1);
+				dispatcher.run_one();
+				sum += continuation.get();
+			}
+
+			REQUIRE(sum == int64_t(iterations));
+		});
+
+	run_benchmark("equivalent coroutine + set_value + run", 2'000'000, [&](size_t iterations)
+		{
+			int64_t sum = 0;
+			for (size_t i = 0; i < iterations; i++)
+			{
+				mh::promise<int> promise;
+				auto continuation = [](mh::dispatcher& dispatcher, mh::task<int> t) -> mh::task<int>
+				{
+					const int value = co_await t;
+					co_await dispatcher.co_dispatch();
+					co_return value;
+				}(dispatcher, promise.get_task());
+				promise.set_value(1);
+				dispatcher.run_one();
+				sum += continuation.get();
+			}
+
+			REQUIRE(sum == int64_t(iterations));
+		});
+}
+
+TEST_CASE("task - benchmark many waiters", "[.][benchmark]")
+{
+	constexpr size_t WAITER_COUNT = 64;
+
+	run_benchmark("64 waiters on one promise", 50'000, [](size_t iterations)
+		{
+			std::vector<mh::task<int>> waiters;
+			waiters.reserve(WAITER_COUNT);
+
+			int64_t sum = 0;
+			for (size_t i = 0; i < iterations; i++)
+			{
+				mh::promise<int> promise;
+				const auto task = promise.get_task();
+				for (size_t w = 0; w < WAITER_COUNT; w++)
+					waiters.push_back(await_one(task));
+
+				promise.set_value(1);
+
+				for (auto& waiter : waiters)
+					sum += waiter.get();
+
+				waiters.clear();
+			}
+
+			REQUIRE(sum == int64_t(iterations * WAITER_COUNT));
+		});
+}
+
+TEST_CASE("task - benchmark cross thread complete", "[.][benchmark]")
+{
+	run_benchmark("complete from another thread", 200'000, [](size_t iterations)
+		{
+			std::vector<mh::promise<int>> promises(iterations);
+			std::vector<mh::task<int>> waiters;
+			waiters.reserve(iterations);
+			for (auto& promise : promises)
+				waiters.push_back(await_one(promise.get_task()));
+
+			std::thread producer([&]
+				{
+					for (auto& promise : promises)
+						promise.set_value(1);
+				});
+
+			int64_t sum = 0;
+			for (auto& waiter : waiters)
+				sum += waiter.get();
+
+			producer.join();
+			REQUIRE(sum == int64_t(iterations));
+		});
+}
+
+#endif
+
+TEST_CASE("generator - benchmark", "[.][benchmark]")
+{
+	constexpr size_t COUNT = 10'000'000;
+
+	run_benchmark("generator, one element per co_yield", COUNT, [](size_t iterations)
+		{
+			auto gen = [](size_t count) -> mh::generator<size_t>
+			{
+				for (size_t i = 0; i < count; i++)
+					co_yield i;
+			}(iterations);
+
+			size_t sum = 0;
+			for (size_t value : gen)
+				sum += value;
+
+			REQUIRE(sum == iterations * (iterations - 1) / 2);
+		});
+
+	run_benchmark("generator, 64 elements per co_yield", COUNT, [](size_t iterations)
+		{
+			auto gen = [](size_t count) -> mh::generator<size_t>
+			{
+				std::array<size_t, 64> buffer;
+				for (size_t i = 0; i < count; )
+				{
+					size_t size = 0;
+					for (; size < buffer.size() && i < count; size++)
+						buffer[size] = i++;
+
+					co_yield std::span(buffer.data(), size);
+				}
+			}(iterations);
+
+			size_t sum = 0;
+			for (size_t value : gen)
+				sum += value;
+
+			REQUIRE(sum == iterations * (iterations - 1) / 2);
+		});
+}
@@ -0,0 +1,146 @@
+#include "mh/concurrency/task_watchdog.hpp"
+#include "mh/coroutine/future.hpp"
+#include "mh/coroutine/task.hpp"
+
+#ifdef MH_COROUTINES_SUPPORTED
+
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+#if MH_COROUTINE_TASK_REGISTRY
+
+namespace
+{
+	mh::task<int> registry_test_coroutine(mh::task<int> inner)
+	{
+		co_return co_await inner;
+	}
+
+	mh::task<> blocking_coroutine(mh::dispatcher& dispatcher)
+	{
+		co_await dispatcher.co_dispatch();
+		std::this_thread::sleep_for(300ms); // Holding up the dispatcher
+	}
+
+	// Always changes its mind about suspending
+	struct declining_awaiter
+	{
+		bool await_ready() const noexcept { return false; }
+		bool await_suspend(mh::detail::coro::coroutine_handle<>) const noexcept { return false; }
+		void await_resume() const noexcept {}
+	};
+
+	mh::task<> non_suspending_coroutine(std::vector<mh::task_info>& before, std::vector<mh::task_info>& after)
+	{
+		before = mh::get_registered_tasks();
+		std::this_thread::sleep_for(10ms);
+		co_await declining_awaiter{};
+		after = mh::get_registered_tasks();
+	}
+
+	const mh::task_info* find_task(const std::vector<mh::task_info>& tasks, std::string_view functionName)
+	{
+		auto found = std::find_if(tasks.begin(), tasks.end(), [&](const mh::task_info& info)
+			{
+				return std::string_view(info.m_Location.function_name()).find(functionName) != std::string_view::npos;
+			});
+
+		return found != tasks.end() ? &*found : nullptr;
+	}
+}
+
+TEST_CASE("task registry")
+{
+	mh::promise<int> promise;
+
+	{
+		auto task = registry_test_coroutine(promise.get_task());
+
+		auto tasks = mh::get_registered_tasks();
+		auto info = find_task(tasks, "registry_test_coroutine");
+		REQUIRE(info);
+		REQUIRE(info->m_State == mh::task_state::running);
+		REQUIRE(!info->m_IsRunning); // Suspended
+		REQUIRE(info->m_ResumeCount == 0);
+		REQUIRE(info->m_CreationTime <= mh::task_info::clock_t::now());
+
+		promise.set_value(5);
+		REQUIRE(task.get() == 5);
+
+		// Still around for as long as someone holds on to it
+		tasks = mh::get_registered_tasks();
+		info = find_task(tasks, "registry_test_coroutine");
+		REQUIRE(info);
+		REQUIRE(info->m_State == mh::task_state::value);
+		REQUIRE(!info->m_IsRunning);
+		REQUIRE(info->m_ResumeCount == 1);
+	}
+
+	REQUIRE(!find_task(mh::get_registered_tasks(), "registry_test_coroutine"));
+
+	// Plain promises aren't coroutines, so they don't count
+	REQUIRE(mh::get_registered_tasks().empty());
+}
+
+TEST_CASE("task registry - awaiter that doesn't suspend")
+{
+	std::vector<mh::task_info> before, after;
+	auto task = non_suspending_coroutine(before, after);
+	REQUIRE(task.is_ready());
+
+	auto beforeInfo = find_task(before, "non_suspending_coroutine");
+	auto afterInfo = find_task(after, "non_suspending_coroutine");
+	REQUIRE(beforeInfo);
+	REQUIRE(afterInfo);
+
+	// Still running since it was called, and never resumed
+	REQUIRE(afterInfo->m_IsRunning);
+	REQUIRE(afterInfo->m_RunningSince == beforeInfo->m_RunningSince);
+	REQUIRE(afterInfo->m_ResumeCount == 0);
+}
+
+TEST_CASE("task registry - watchdog")
+{
+	mh::dispatcher dispatcher(false);
+	std::atomic_int reportCount = 0;
+
+	mh::task_watchdog watchdog(dispatcher, 50ms, [&](const mh::task_info& info, mh::task_watchdog::clock_t::duration runningFor)
+		{
+			if (std::string_view(info.m_Location.function_name()).find("blocking_coroutine") != std::string_view::npos &&
+				runningFor >= 50ms)
+			{
+				reportCount++;
+			}
+		});
+
+	auto task = blocking_coroutine(dispatcher);
+
+	std::thread runner([&] { dispatcher.run_one(); });
+	std::this_thread::sleep_for(150ms);
+	watchdog.check();
+	runner.join();
+
+	// Only reported once, whether the background thread or check() got there first
+	REQUIRE(task.is_ready());
+	REQUIRE(reportCount == 1);
+	REQUIRE(watchdog.check() == 0);
+}
+
+#else
+
+TEST_CASE("task registry - disabled")
+{
+	auto task = []() -> mh::task<int> { co_return 1; }();
+	REQUIRE(mh::get_registered_tasks().empty());
+}
+
+#endif
+
+#endif
@@ -1,4 +1,5 @@
 #include "mh/concurrency/thread_pool.hpp"
+#include "mh/coroutine/future.hpp"
 #include "mh/coroutine/task.hpp"
 
 #ifdef MH_COROUTINES_SUPPORTED
@@ -8,7 +9,10 @@
 #include <atomic>
 #include <cstring>
 #include <iostream>
+#include <new>
+#include <string>
 #include <thread>
+#include <vector>
 
 #ifdef _WIN32
 #include <Windows.h>
@@ -162,6 +166,306 @@ TEST_CASE("task - exceptions in discarded tasks")
 	REQUIRE(value == 50030);
 }
 
+TEST_CASE("task - multiple waiters")
+{
+	mh::promise<int> promise;
+	const mh::task<int> producer = promise.get_task();
+
+	std::vector<int> resumeOrder;
+	std::vector<mh::task<int>> waiters;
+	for (int i = 0; i < 16; i++)
+	{
+		waiters.push_back([](mh::task<int> producer, std::vector<int>& resumeOrder, int index) -> mh::task<int>
+			{
+				const int value = co_await producer;
+				resumeOrder.push_back(index);
+				co_return value + index;
+			}(producer, resumeOrder, i));
+	}
+
+	for (const auto& waiter : waiters)
+		REQUIRE(waiter.state() == mh::task_state::running);
+
+	promise.set_value(100);
+	REQUIRE_THROWS_AS(promise.set_value(200), std::future_error);
+
+	for (int i = 0; i < 16; i++)
+	{
+		REQUIRE(waiters[i].is_ready());
+		REQUIRE(waiters[i].get() == 100 + i);
+		REQUIRE(resumeOrder[i] == i); // Resumed in the order they started waiting
+	}
+
+	// Already complete, should not suspend at all
+	REQUIRE([](mh::task<int> producer) -> mh::task<int> { co_return co_await producer; }(producer).get() == 100);
+}
+
+TEST_CASE("task - ready tasks")
+{
+	// Small values are stored in the task itself
+	{
+		mh::task<int> ready = mh::make_ready_task<int>(42);
+		REQUIRE(ready.is_ready());
+		REQUIRE(ready.valid());
+		REQUIRE(ready.state() == mh::task_state::value);
+		REQUIRE(ready.wait_for(0s) == std::future_status::ready);
+		REQUIRE(ready.get() == 42);
+		REQUIRE(*ready.try_get() == 42);
+
+		mh::task<int> copy = ready;
+		REQUIRE(copy.get() == 42);
+
+		ready = {};
+		REQUIRE(ready.empty());
+		REQUIRE(ready.state() == mh::task_state::empty);
+		REQUIRE(copy.get() == 42);
+
+		REQUIRE([](mh::task<int> t) -> mh::task<int> { co_return co_await t + 1; }(copy).get() == 43);
+
+		const mh::task<void> voidTask = mh::make_ready_task<void>();
+		REQUIRE(voidTask.is_ready());
+		[](mh::task<void> t) -> mh::task<> { co_await t; }(voidTask).wait();
+	}
+
+	// Larger values still go through a promise
+	{
+		const std::string str(100, 'x');
+		const mh::task<std::string> ready = mh::make_ready_task<std::string>(str);
+		REQUIRE(ready.is_ready());
+		REQUIRE(ready.get() == str);
+		REQUIRE([](mh::task<std::string> t) -> mh::task<size_t> { co_return (co_await t).size(); }(ready).get() == 100);
+	}
+}
+
+TEST_CASE("task - blocking waits")
+{
+	mh::promise<int> promise;
+	const mh::task<int> task = promise.get_task();
+
+	REQUIRE(task.wait_for(10ms) == std::future_status::timeout);
+	REQUIRE(task.wait_until(std::chrono::steady_clock::now() - 1s) == std::future_status::timeout);
+
+	std::thread producer([&]
+		{
+			std::this_thread::sleep_for(50ms);
+			promise.set_value(1234);
+		});
+
+	REQUIRE(task.wait_for(10s) == std::future_status::ready);
+	task.wait();
+	REQUIRE(task.get() == 1234);
+	REQUIRE(task.wait_until(std::chrono::steady_clock::now() - 1s) == std::future_status::ready);
+
+	producer.join();
+}
+
+TEST_CASE("task - deep await chains")
+{
+	// Completing the innermost task should not resume each link of the chain recursively. GCC only
+	// turns symmetric transfer into a tail call when sibling call optimization is enabled (-O2), so
+	// debug builds still use a little stack per link and get a chain that fits anyway. There's no way to
+	// tell -O1 apart from -O2 here, and none of the CMake configurations use it.
+#if defined(__GNUC__) && !defined(__clang__) && !defined(__OPTIMIZE__)
+	constexpr int CHAIN_LENGTH = 10'000;
+#else
+	constexpr int CHAIN_LENGTH = 200'000;
+#endif
+
+	mh::promise<int> promise;
+	std::vector<mh::task<int>> chain;
+	chain.reserve(CHAIN_LENGTH + 1);
+	chain.push_back(promise.get_task());
+
+	for (int i = 0; i < CHAIN_LENGTH; i++)
+	{
+		chain.push_back([](mh::task<int> inner) -> mh::task<int>
+			{
+				co_return co_await inner + 1;
+			}(chain.back()));
+	}
+
+	REQUIRE(!chain.back().is_ready());
+	promise.set_value(0);
+	REQUIRE(chain.back().get() == CHAIN_LENGTH);
+
+	// Each frame holds a reference to the previous one, so free them outermost first (otherwise
+	// freeing the outermost one would recursively free the whole chain)
+	while (!chain.empty())
+		chain.pop_back();
+}
+
+TEST_CASE("task - multiple waiters on an executor")
+{
+	mh::dispatcher dispatcher(false);
+	mh::promise<int> promise;
+
+	const auto inner = [](mh::task<int> producer) -> mh::task<int>
+	{
+		co_return co_await producer;
+	}(promise.get_task());
+
+	int resumedCount = 0;
+	std::vector<mh::task<>> waiters;
+	for (int i = 0; i < 8; i++)
+	{
+		waiters.push_back([](mh::task<int> inner, int& resumedCount) -> mh::task<>
+			{
+				REQUIRE(co_await inner == 5);
+				resumedCount++;
+			}(inner, resumedCount));
+	}
+
+	// Complete the promise from a coroutine running on the dispatcher
+	[](mh::dispatcher& dispatcher, mh::promise<int> promise) -> mh::task<>
+	{
+		co_await dispatcher.co_dispatch();
+		promise.set_value(5);
+	}(dispatcher, promise);
+
+	REQUIRE(dispatcher.run_one());
+
+	// One waiter gets control transferred to it directly, the rest are queued on the dispatcher
+	REQUIRE(resumedCount == 1);
+	REQUIRE(dispatcher.task_count() == 7);
+	dispatcher.run();
+	REQUIRE(resumedCount == 8);
+}
+
+TEST_CASE("task - multiple waiters on a failing executor")
+{
+	mh::promise<int> promise;
+
+	const auto inner = [](mh::task<int> producer) -> mh::task<int>
+	{
+		co_return co_await producer;
+	}(promise.get_task());
+
+	int resumedCount = 0;
+	std::vector<mh::task<>> waiters;
+	for (int i = 0; i < 4; i++)
+	{
+		waiters.push_back([](mh::task<int> inner, int& resumedCount) -> mh::task<>
+			{
+				REQUIRE(co_await inner == 5);
+				resumedCount++;
+			}(inner, resumedCount));
+	}
+
+	// An executor that can't queue anything, so everyone gets resumed here instead
+	{
+		mh::detail::current_executor_hpp::current_executor_scope scope(nullptr,
+			[](void*, mh::detail::coro::coroutine_handle<>) { throw std::bad_alloc(); });
+
+		promise.set_value(5);
+	}
+
+	REQUIRE(resumedCount == 4);
+}
+
+TEST_CASE("task - then")
+{
+	mh::dispatcher dispatcher(false);
+	mh::promise<int> promise;
+
+	auto doubled = promise.get_task().then(dispatcher, [](int value) { return value * 2; });
+	auto described = doubled.then(dispatcher, [](int value) { return std::to_string(value); });
+	int sideEffect = 0;
+	auto done = described.then(dispatcher, [&](const std::string& value) { sideEffect = int(value.size()); });
+	auto after = done.then(dispatcher, [&] { return sideEffect + 1; });
+
+	// Nothing runs until the task completes, and then only on the executor
+	REQUIRE(dispatcher.task_count() == 0);
+	promise.set_value(21);
+	REQUIRE(!doubled.is_ready());
+	dispatcher.run();
+	REQUIRE(doubled.get() == 42);
+	REQUIRE(described.get() == "42");
+	REQUIRE(sideEffect == 2);
+	REQUIRE(after.get() == 3);
+
+	// Already complete tasks are posted straight away
+	auto ready = mh::make_ready_task<int>(1).then(dispatcher, [](int value) { return value + 1; });
+	REQUIRE(dispatcher.task_count() == 1);
+	dispatcher.run();
+	REQUIRE(ready.get() == 2);
+
+	// Exceptions skip the continuation
+	bool called = false;
+	auto failed = [](mh::dispatcher& dispatcher) -> mh::task<int>
+	{
+		co_await dispatcher.co_dispatch();
+		throw std::runtime_error("failed");
+	}(dispatcher).then(dispatcher, [&](int) { called = true; return 0; });
+	auto thrown = ready.then(dispatcher, [](int) -> int { throw std::logic_error("thrown"); });
+	dispatcher.run();
+	REQUIRE(!called);
+	REQUIRE_THROWS_AS(failed.get(), std::runtime_error);
+	REQUIRE_THROWS_AS(thrown.get(), std::logic_error);
+
+	// So does cancelling the returned task before it runs
+	auto cancelled = ready.then(dispatcher, [&](int) { called = true; return 0; });
+	REQUIRE(cancelled.request_cancel());
+	dispatcher.run();
+	REQUIRE(!called);
+	REQUIRE_THROWS_AS(cancelled.get(), mh::task_cancelled);
+}
+
+TEST_CASE("task - then with a failing executor")
+{
+	struct throwing_executor
+	{
+		void post(void (*)(void*), void*) { throw std::bad_alloc(); }
+	} executor;
+
+	// Posted straight away, so then() itself throws (and doesn't leak the continuation)
+	REQUIRE_THROWS_AS(mh::make_ready_task<int>(1).then(executor, [](int value) { return value; }), std::bad_alloc);
+
+	// Posted once the task completes, so the returned task fails instead
+	mh::promise<int> promise;
+	bool called = false;
+	auto failed = promise.get_task().then(executor, [&](int value) { called = true; return value; });
+	promise.set_value(1);
+	REQUIRE(!called);
+	REQUIRE_THROWS_AS(failed.get(), std::bad_alloc);
+}
+
+TEST_CASE("task - then on a thread pool")
+{
+	mh::thread_pool pool(4);
+
+	std::vector<mh::task<int>> tasks;
+	for (int i = 0; i < 200; i++)
+	{
+		tasks.push_back(pool.add_task([i] { return i; })
+			.then(pool, [](int value) { return value * 2; }));
+	}
+
+	for (int i = 0; i < 200; i++)
+		REQUIRE(tasks[i].get() == i * 2);
+}
+
+TEST_CASE("task - frames freed on other threads")
+{
+	mh::thread_pool pool(4);
+
+	// Frames are created on this thread but freed on the pool threads, which pushes them through the shared free lists
+	for (int round = 0; round < 20; round++)
+	{
+		std::vector<mh::task<int>> tasks;
+		for (int i = 0; i < 200; i++)
+		{
+			tasks.push_back([](mh::thread_pool& pool, int value) -> mh::task<int>
+				{
+					co_await pool.co_add_task();
+					co_return value * 2;
+				}(pool, i));
+		}
+
+		for (int i = 0; i < 200; i++)
+			REQUIRE(tasks[i].get() == i * 2);
+	}
+}
+
 #if !defined(__clang_major__) || (__clang_major__ >= 10)
 TEST_CASE("task - contained object lifetime")
 {
@@ -0,0 +1,48 @@
+#include "mh/coroutine/task.hpp"
+#include "mh/coroutine/thread.hpp"
+
+#ifdef MH_COROUTINES_SUPPORTED
+
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <thread>
+
+using namespace std::chrono_literals;
+
+TEST_CASE("co_create_thread")
+{
+	const auto mainThread = std::this_thread::get_id();
+
+	auto task = []() -> mh::task<bool>
+	{
+		co_await mh::co_create_thread();
+		const auto first = std::this_thread::get_id();
+
+		co_await mh::co_create_thread();
+		const auto second = std::this_thread::get_id();
+
+		// Gives the first thread a chance to go idle. One of the idle threads (including this one, once
+		// we're off it) gets reused instead of starting another one.
+		std::this_thread::sleep_for(100ms);
+		co_await mh::co_create_thread();
+		const auto third = std::this_thread::get_id();
+
+		co_return first != second && (third == first || third == second);
+	}();
+
+	REQUIRE(task.get());
+
+	// Already off the main thread, stays where it is
+	auto background = [](std::thread::id mainThread) -> mh::task<bool>
+	{
+		co_await mh::co_create_background_thread();
+		const auto first = std::this_thread::get_id();
+		co_await mh::co_create_background_thread();
+		co_return first != mainThread && std::this_thread::get_id() == first;
+	}(mainThread);
+
+	REQUIRE(background.get());
+}
+
+#endif
@@ -0,0 +1,251 @@
+#include "mh/concurrency/dispatcher.hpp"
+#include "mh/concurrency/thread_pool.hpp"
+#include "mh/coroutine/future.hpp"
+#include "mh/coroutine/when_all.hpp"
+#include "mh/coroutine/when_any.hpp"
+
+#ifdef MH_COROUTINES_SUPPORTED
+
+#include <catch2/catch.hpp>
+
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+TEST_CASE("when_all - variadic")
+{
+	mh::promise<int> p1;
+	mh::promise<std::string> p2;
+	mh::promise<int> p3;
+	const mh::task<> voidTask = [](mh::task<int> t) -> mh::task<> { co_await t; }(p3.get_task());
+
+	auto all = mh::when_all(p1.get_task(), p2.get_task(), voidTask, mh::make_ready_task<int>(4));
+	REQUIRE(!all.is_ready());
+
+	p2.set_value("two");
+	p1.set_value(1);
+	REQUIRE(!all.is_ready());
+	p3.set_value(3);
+
+	REQUIRE(all.is_ready());
+	const auto& [one, two, three, four] = all.get();
+	REQUIRE(one == 1);
+	REQUIRE(two == "two");
+	REQUIRE(four == 4);
+
+	// Nothing to wait on
+	REQUIRE(mh::when_all().is_ready());
+	REQUIRE(mh::when_all(mh::make_ready_task<int>(5)).is_ready());
+}
+
+TEST_CASE("when_all - range")
+{
+	std::vector<mh::promise<int>> promises(10);
+	std::vector<mh::task<int>> tasks;
+	for (const auto& p : promises)
+		tasks.push_back(p.get_task());
+
+	auto all = mh::when_all(tasks);
+	for (int i = 9; i >= 0; i--)
+	{
+		REQUIRE(!all.is_ready());
+		promises[i].set_value(i * 10);
+	}
+
+	const std::vector<int>& results = all.get();
+	REQUIRE(results.size() == 10);
+	for (int i = 0; i < 10; i++)
+		REQUIRE(results[i] == i * 10);
+
+	std::vector<mh::task<>> voidTasks{ mh::make_ready_task<void>(), mh::make_ready_task<void>() };
+	mh::task<> allVoid = mh::when_all(voidTasks.begin(), voidTasks.end());
+	REQUIRE(allVoid.is_ready());
+	REQUIRE(!allVoid.get_exception());
+}
+
+TEST_CASE("when_all - exceptions")
+{
+	mh::promise<int> p1;
+	mh::promise<int> p2;
+	mh::promise<int> p3;
+
+	auto all = mh::when_all(p1.get_task(), p2.get_task(), p3.get_task());
+
+	p3.set_exception(std::make_exception_ptr(std::runtime_error("three")));
+	p2.set_exception(std::make_exception_ptr(std::logic_error("two")));
+	REQUIRE(!all.is_ready()); // Still waits for everyone
+	p1.set_value(1);
+
+	// The first one in argument order wins, not the first one to fail
+	REQUIRE_THROWS_AS(all.get(), std::logic_error);
+
+	REQUIRE_THROWS_AS(mh::when_all(mh::task<int>{}).get(), std::future_error);
+}
+
+TEST_CASE("when_all - threads")
+{
+	mh::thread_pool pool(4);
+
+	for (int round = 0; round < 50; round++)
+	{
+		std::vector<mh::task<int>> tasks;
+		for (int i = 0; i < 32; i++)
+		{
+			tasks.push_back([](mh::thread_pool& pool, int value) -> mh::task<int>
+				{
+					co_await pool.co_add_task();
+					co_return value;
+				}(pool, i));
+		}
+
+		const auto sum = [](mh::task<std::vector<int>> all) -> mh::task<int>
+		{
+			int sum = 0;
+			for (int value : co_await all)
+				sum += value;
+
+			co_return sum;
+		}(mh::when_all(tasks));
+
+		REQUIRE(sum.get() == (31 * 32) / 2);
+	}
+}
+
+TEST_CASE("when_any")
+{
+	mh::promise<int> p1;
+	mh::promise<std::string> p2;
+
+	auto any = mh::when_any(p1.get_task(), p2.get_task());
+	REQUIRE(!any.is_ready());
+
+	p2.set_value("two");
+	REQUIRE(any.is_ready());
+	REQUIRE(any.get() == 1);
+
+	// The losers finish after when_any() is gone
+	any = {};
+	p1.set_value(1);
+
+	// Already complete
+	REQUIRE(mh::when_any(p1.get_task(), mh::promise<int>().get_task()).get() == 0);
+
+	// Exceptions are still a result
+	{
+		std::vector<mh::promise<int>> promises(4);
+		std::vector<mh::task<int>> tasks;
+		for (const auto& p : promises)
+			tasks.push_back(p.get_task());
+
+		auto anyRange = mh::when_any(tasks);
+		promises[2].set_exception(std::make_exception_ptr(std::runtime_error("fail")));
+		promises[1].set_value(1);
+		REQUIRE(anyRange.get() == 2);
+		REQUIRE_THROWS_AS(tasks[anyRange.get()].get(), std::runtime_error);
+
+		// The losers have to finish too, or the state shared with them is never freed
+		promises[0].set_value(0);
+		promises[3].set_value(3);
+	}
+
+	REQUIRE_THROWS_AS(mh::when_any(std::vector<mh::task<int>>{}).get(), std::invalid_argument);
+}
+
+TEST_CASE("when_any - losers are cancelled")
+{
+	mh::dispatcher dispatcher;
+
+	const auto sleeper = [](mh::dispatcher& dispatcher, std::chrono::hours duration) -> mh::task<int>
+	{
+		co_await dispatcher.co_delay_for(duration);
+		co_return 1;
+	};
+
+	mh::promise<int> winner;
+	auto loser = sleeper(dispatcher, 1h);
+	auto any = mh::when_any(loser, winner.get_task());
+	REQUIRE(dispatcher.task_count() == 1);
+
+	winner.set_value(2);
+	REQUIRE(any.get() == 1);
+	REQUIRE(loser.is_cancel_requested());
+
+	// Resumed straight away instead of an hour from now
+	REQUIRE(dispatcher.run_one());
+	REQUIRE(loser.is_ready());
+	REQUIRE_THROWS_AS(loser.get(), mh::task_cancelled);
+	REQUIRE(dispatcher.task_count() == 0);
+
+	// The winner is left alone
+	auto fast = sleeper(dispatcher, 0h);
+	auto slow = sleeper(dispatcher, 1h);
+	auto anyRange = mh::when_any(std::vector<mh::task<int>>{ slow, fast });
+	while (!anyRange.is_ready())
+		dispatcher.run_one();
+
+	REQUIRE(anyRange.get() == 1);
+	REQUIRE(!fast.is_cancel_requested());
+	REQUIRE(fast.get() == 1);
+	REQUIRE(slow.is_cancel_requested());
+	dispatcher.run();
+	REQUIRE(slow.is_ready());
+}
+
+#if MH_WHEN_ANY_STOP_SOURCE
+TEST_CASE("when_any - cancelling the losers")
+{
+	mh::thread_pool pool(4);
+	std::stop_source stopSource;
+	std::atomic_int cancelledCount = 0;
+
+	std::vector<mh::task<int>> tasks;
+	for (int i = 0; i < 8; i++)
+	{
+		tasks.push_back([](mh::thread_pool& pool, std::stop_token stop, int index, std::atomic_int& cancelledCount) -> mh::task<int>
+			{
+				co_await pool.co_add_task();
+				if (index == 5)
+					co_return index;
+
+				try
+				{
+					while (!stop.stop_requested())
+						co_await pool.co_delay_for(1ms);
+				}
+				catch (const mh::task_cancelled&)
+				{
+					// when_any() cancels the losers itself too, whichever gets there first
+				}
+
+				cancelledCount++;
+				co_return -1;
+			}(pool, stopSource.get_token(), i, cancelledCount));
+	}
+
+	REQUIRE(mh::when_any(stopSource, tasks).get() == 5);
+	REQUIRE(stopSource.stop_requested());
+
+	mh::when_all(tasks).wait();
+
+	// Anyone that hadn't even started running yet never gets that far
+	int bailedOutCount = 0;
+	for (const auto& task : tasks)
+	{
+		try
+		{
+			task.get();
+		}
+		catch (const mh::task_cancelled&)
+		{
+			bailedOutCount++;
+		}
+	}
+
+	REQUIRE(cancelledCount + bailedOutCount == 7);
+}
+#endif
+
+#endif
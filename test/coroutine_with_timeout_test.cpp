@@ -0,0 +1,153 @@
+#include "mh/concurrency/thread_pool.hpp"
+#include "mh/coroutine/future.hpp"
+#include "mh/coroutine/with_timeout.hpp"
+
+#ifdef MH_COROUTINES_SUPPORTED
+
+#include <catch2/catch.hpp>
+
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+TEST_CASE("with_timeout - completes in time")
+{
+	mh::dispatcher dispatcher;
+	mh::promise<int> promise;
+
+	auto result = [](mh::task<int> t, mh::dispatcher& dispatcher) -> mh::task<mh::timeout_result_t<int>>
+	{
+		co_return co_await mh::with_timeout(t, 50ms, dispatcher);
+	}(promise.get_task(), dispatcher);
+
+	REQUIRE(!result.is_ready());
+	promise.set_value(5);
+	REQUIRE(result.is_ready());
+	REQUIRE(result.get().has_value());
+	REQUIRE(result.get().value() == 5);
+
+	// The timer is gone, nothing left to run once it would have expired
+	std::this_thread::sleep_for(100ms);
+	REQUIRE(!dispatcher.run_one());
+
+	// Already complete, doesn't go near the timer
+	REQUIRE([](mh::dispatcher& dispatcher) -> mh::task<int>
+		{
+			co_return (co_await mh::with_timeout(mh::make_ready_task<int>(6), 0s, dispatcher)).value();
+		}(dispatcher).get() == 6);
+}
+
+TEST_CASE("with_timeout - move-only results")
+{
+	mh::dispatcher dispatcher;
+	mh::promise<std::unique_ptr<int>> promise;
+
+	auto result = [](mh::task<std::unique_ptr<int>> t, mh::dispatcher& dispatcher) -> mh::task<int>
+	{
+		auto value = co_await mh::with_timeout(std::move(t), 1s, dispatcher);
+		co_return *value.value();
+	}(promise.get_task(), dispatcher);
+
+	promise.set_value(std::make_unique<int>(7));
+	REQUIRE(result.get() == 7);
+}
+
+TEST_CASE("with_timeout - times out")
+{
+	mh::dispatcher dispatcher;
+	mh::promise<int> promise;
+
+	auto result = [](mh::task<int> t, mh::dispatcher& dispatcher) -> mh::task<mh::timeout_result_t<int>>
+	{
+		co_return co_await mh::with_timeout(t, 10ms, dispatcher);
+	}(promise.get_task(), dispatcher);
+
+	REQUIRE(!dispatcher.run_one());
+	REQUIRE(dispatcher.wait_tasks_for(1s));
+	REQUIRE(dispatcher.run_one());
+
+	REQUIRE(result.is_ready());
+	REQUIRE(result.get().has_error());
+	REQUIRE(result.get().error() == mh::timeout{});
+
+	// Completing it afterwards is fine, nobody is waiting any more
+	promise.set_value(5);
+	REQUIRE(!dispatcher.run_one());
+}
+
+TEST_CASE("with_timeout - exceptions")
+{
+	mh::dispatcher dispatcher;
+	mh::promise<int> promise;
+
+	auto result = [](mh::task<int> t, mh::dispatcher& dispatcher) -> mh::task<int>
+	{
+		co_return (co_await mh::with_timeout(t, 1s, dispatcher)).value();
+	}(promise.get_task(), dispatcher);
+
+	promise.set_exception(std::make_exception_ptr(std::runtime_error("oops")));
+	REQUIRE_THROWS_AS(result.get(), std::runtime_error);
+
+	auto voidResult = [](mh::task<> t, mh::dispatcher& dispatcher) -> mh::task<bool>
+	{
+		co_return (co_await mh::with_timeout(t, 1s, dispatcher)).has_value();
+	}(mh::make_ready_task<void>(), dispatcher);
+	REQUIRE(voidResult.get());
+}
+
+TEST_CASE("with_timeout - threads")
+{
+	mh::thread_pool pool(4);
+	mh::dispatcher timerDispatcher(false);
+
+	std::atomic_bool done = false;
+	std::thread timerThread([&]
+		{
+			while (!done)
+			{
+				timerDispatcher.wait_tasks_for(10ms);
+				timerDispatcher.run();
+			}
+		});
+
+	std::atomic_int completedCount = 0;
+	std::atomic_int timedOutCount = 0;
+
+	std::vector<mh::task<>> waiters;
+	for (int i = 0; i < 2000; i++)
+	{
+		auto work = [](mh::thread_pool& pool, int i) -> mh::task<int>
+		{
+			co_await pool.co_add_task();
+			if (i % 3 == 0)
+				co_await pool.co_delay_for(std::chrono::microseconds(i % 500));
+
+			co_return i;
+		}(pool, i);
+
+		waiters.push_back([](mh::task<int> work, mh::dispatcher& dispatcher, int i,
+			std::atomic_int& completedCount, std::atomic_int& timedOutCount) -> mh::task<>
+			{
+				auto result = co_await mh::with_timeout(work, std::chrono::microseconds(200), dispatcher);
+				// Catch isn't thread safe, so mismatched values just don't get counted
+				if (result.has_error())
+					timedOutCount++;
+				else if (result.value() == i)
+					completedCount++;
+			}(work, timerDispatcher, i, completedCount, timedOutCount));
+	}
+
+	for (const auto& waiter : waiters)
+		waiter.wait();
+
+	REQUIRE(completedCount + timedOutCount == 2000);
+
+	done = true;
+	timerThread.join();
+}
+
+#endif
@@ -0,0 +1,184 @@
+#include "mh/error/status.hpp"
+#include "mh/coroutine/task.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	enum class state
+	{
+		idle,
+		working,
+		done,
+	};
+}
+
+TEST_CASE("status")
+{
+	mh::status_source<state> source;
+	auto reader = source.get_reader();
+
+	REQUIRE(!reader.has_value());
+	REQUIRE(reader.version() == 0);
+
+	REQUIRE(source.set(state::working, "loading"));
+	REQUIRE(reader.has_value());
+	REQUIRE(reader.version() == 1);
+	REQUIRE(reader.get().m_Status == state::working);
+	REQUIRE(reader.get().m_Message == "loading");
+
+	// Nothing changed, so neither does the version
+	REQUIRE(!source.set(state::working, "loading"));
+	REQUIRE(reader.version() == 1);
+
+	{
+		const auto snapshot = reader.get_snapshot();
+		REQUIRE(source.set(state::working, "still loading"));
+
+		// Snapshots don't change underneath us
+		REQUIRE(snapshot->m_Message == "loading");
+		REQUIRE(snapshot->m_Version == 1);
+		REQUIRE(reader.get_snapshot()->m_Message == "still loading");
+		REQUIRE(reader.version() == 2);
+	}
+
+	// Snapshots can be let go of anywhere, not just where they were taken
+	auto snapshot = reader.get_snapshot();
+	REQUIRE(source.set(state::done, "done"));
+	std::thread([snapshot = std::move(snapshot)]() mutable
+		{
+			REQUIRE(snapshot->m_Message == "still loading");
+			snapshot.reset();
+		}).join();
+
+	REQUIRE(reader.get_snapshot()->m_Message == "done");
+}
+
+#ifdef MH_COROUTINES_SUPPORTED
+TEST_CASE("status - co_changed")
+{
+	mh::status_source<state> source;
+	auto reader = source.get_reader();
+	source.set(state::idle, "starting");
+	REQUIRE(reader.version() == 1);
+
+	std::vector<std::string> seen;
+	auto watcher = [](mh::status_reader<state> reader, std::vector<std::string>& seen) -> mh::task<>
+	{
+		std::uint64_t lastVersion = 0;
+		while (true)
+		{
+			co_await reader.co_changed(lastVersion);
+
+			const auto snapshot = reader.get_snapshot();
+			lastVersion = snapshot->m_Version;
+			seen.push_back(snapshot->m_Message);
+
+			if (snapshot->m_Status == state::done)
+				co_return;
+		}
+	}(reader, seen);
+
+	// Already changed since version 0, so it doesn't wait for the first one
+	REQUIRE(seen == std::vector<std::string>{ "starting" });
+	REQUIRE(!watcher.is_ready());
+
+	// Setting the same thing again isn't a change
+	source.set(state::idle, "starting");
+	REQUIRE(seen.size() == 1);
+
+	source.set(state::working, "working");
+	REQUIRE(seen == std::vector<std::string>{ "starting", "working" });
+	REQUIRE(!watcher.is_ready());
+
+	source.set(state::done, "done");
+	REQUIRE(watcher.is_ready());
+	REQUIRE(seen == std::vector<std::string>{ "starting", "working", "done" });
+
+	// Already out of date
+	REQUIRE([](mh::status_reader<state> reader) -> mh::task<bool>
+		{
+			co_await reader.co_changed(1);
+			co_return true;
+		}(reader).get());
+}
+
+TEST_CASE("status - co_changed cancellation")
+{
+	mh::status_source<state> source;
+	auto reader = source.get_reader();
+	source.set(state::idle, "starting");
+
+	auto waiter = [](mh::status_reader<state> reader) -> mh::task<bool>
+	{
+		co_await reader.co_changed(reader.version());
+		co_return true;
+	};
+
+	auto first = waiter(reader);
+	auto second = waiter(reader);
+	auto third = waiter(reader);
+	REQUIRE(!first.is_ready());
+	REQUIRE(!second.is_ready());
+	REQUIRE(!third.is_ready());
+
+	// Leaves from the middle of the list, the others are still woken by the next change
+	REQUIRE(second.request_cancel());
+	REQUIRE(second.is_ready());
+	REQUIRE_THROWS_AS(second.get(), mh::task_cancelled);
+	REQUIRE(!first.is_ready());
+	REQUIRE(!third.is_ready());
+
+	source.set(state::working, "working");
+	REQUIRE(first.is_ready());
+	REQUIRE(third.is_ready());
+	REQUIRE(first.get());
+	REQUIRE(third.get());
+
+	// Cancelled after it has already been woken up
+	auto late = waiter(reader);
+	source.set(state::done, "done");
+	REQUIRE(late.is_ready());
+	late.request_cancel();
+	REQUIRE(late.get());
+}
+
+TEST_CASE("status - co_changed cancellation racing set()")
+{
+	mh::status_source<state> source;
+	auto reader = source.get_reader();
+
+	for (int i = 0; i < 1000; i++)
+	{
+		auto waiter = [](mh::status_reader<state> reader) -> mh::task<bool>
+		{
+			co_await reader.co_changed(reader.version());
+			co_return true;
+		}(reader);
+
+		std::thread canceller([&] { waiter.request_cancel(); });
+		source.set((i % 2) ? state::working : state::idle);
+		canceller.join();
+
+		// Whichever got there first, it's woken exactly once
+		REQUIRE(waiter.is_ready());
+		bool wasChanged = false;
+		bool wasCancelled = false;
+		try
+		{
+			wasChanged = waiter.get();
+		}
+		catch (const mh::task_cancelled&)
+		{
+			wasCancelled = true;
+		}
+
+		REQUIRE(wasChanged != wasCancelled);
+	}
+}
+#endif
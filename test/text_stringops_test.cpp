@@ -42,3 +42,29 @@ TEST_CASE("trim - non-empty string", "[text][stringops]")
 		REQUIRE(str == "hello.........\r.");
 	}
 }
+
+#ifdef MH_COROUTINES_SUPPORTED
+#include <memory_resource>
+#include <string_view>
+#include <vector>
+
+TEST_CASE("split_string", "[text][stringops]")
+{
+	const std::string str = "a,b;;c";
+	std::vector<std::string_view> parts;
+	for (std::string_view part : mh::split_string(str, ",;"))
+		parts.push_back(part);
+
+	REQUIRE(parts == std::vector<std::string_view>{ "a", "b", "", "c" });
+
+	// Frame comes from the caller's allocator
+	std::byte buffer[1024];
+	std::pmr::monotonic_buffer_resource resource(buffer, sizeof(buffer), std::pmr::null_memory_resource());
+
+	parts.clear();
+	for (std::string_view part : mh::split_string(std::allocator_arg, std::pmr::polymorphic_allocator<>(&resource), "x y", " "))
+		parts.push_back(part);
+
+	REQUIRE(parts == std::vector<std::string_view>{ "x", "y" });
+}
+#endif